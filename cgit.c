@@ -17,8 +17,11 @@
 #include "ui-shared.h"
 #include "ui-stats.h"
 #include "ui-blob.h"
+#include "ui-clone.h"
+#include "ui-snapshot.h"
 #include "ui-summary.h"
 #include "scan-tree.h"
+#include "repo-cache.h"
 
 const char *cgit_version = CGIT_VERSION;
 
@@ -110,6 +113,8 @@ static void repo_config(struct cgit_repo *repo, const char *name, const char *va
 		repo->enable_html_serving = atoi(value);
 	else if (!strcmp(name, "enable-subtree"))
 		repo->enable_subtree = atoi(value);
+	else if (!strcmp(name, "enable-tree-lastcommit"))
+		repo->enable_tree_lastcommit = atoi(value);
 	else if (!strcmp(name, "branch-sort")) {
 		if (!strcmp(value, "age"))
 			repo->branch_sort = 1;
@@ -201,6 +206,8 @@ static void config_cb(const char *name, const char *value)
 		ctx.cfg.head_include = xstrdup(value);
 	else if (!strcmp(name, "header"))
 		ctx.cfg.header = xstrdup(value);
+	else if (!strcmp(name, "header-branches"))
+		ctx.cfg.header_branches = atoi(value);
 	else if (!strcmp(name, "logo"))
 		ctx.cfg.logo = xstrdup(value);
 	else if (!strcmp(name, "logo-link"))
@@ -217,12 +224,16 @@ static void config_cb(const char *name, const char *value)
 		ctx.cfg.noheader = atoi(value);
 	else if (!strcmp(name, "snapshots"))
 		ctx.cfg.snapshots = cgit_parse_snapshots_mask(value);
+	else if (skip_prefix(name, "snapshot-threads.", &arg))
+		cgit_set_snapshot_threads(arg, value);
 	else if (!strcmp(name, "enable-filter-overrides"))
 		ctx.cfg.enable_filter_overrides = atoi(value);
 	else if (!strcmp(name, "enable-follow-links"))
 		ctx.cfg.enable_follow_links = atoi(value);
 	else if (!strcmp(name, "enable-http-clone"))
 		ctx.cfg.enable_http_clone = atoi(value);
+	else if (!strcmp(name, "enable-smart-http"))
+		ctx.cfg.enable_smart_http = atoi(value);
 	else if (!strcmp(name, "enable-index-links"))
 		ctx.cfg.enable_index_links = atoi(value);
 	else if (!strcmp(name, "enable-index-owner"))
@@ -243,6 +254,8 @@ static void config_cb(const char *name, const char *value)
 		ctx.cfg.enable_html_serving = atoi(value);
 	else if (!strcmp(name, "enable-subtree"))
 		ctx.cfg.enable_subtree = atoi(value);
+	else if (!strcmp(name, "enable-tree-lastcommit"))
+		ctx.cfg.enable_tree_lastcommit = atoi(value);
 	else if (!strcmp(name, "enable-tree-linenumbers"))
 		ctx.cfg.enable_tree_linenumbers = atoi(value);
 	else if (!strcmp(name, "enable-git-config"))
@@ -253,6 +266,12 @@ static void config_cb(const char *name, const char *value)
 		ctx.cfg.cache_size = atoi(value);
 	else if (!strcmp(name, "cache-root"))
 		ctx.cfg.cache_root = xstrdup(expand_macros(value));
+	else if (!strcmp(name, "index-root"))
+		ctx.cfg.index_root = xstrdup(expand_macros(value));
+	else if (!strcmp(name, "index-cache-size"))
+		ctx.cfg.index_cache_size = atoi(value);
+	else if (!strcmp(name, "snapshot-store"))
+		ctx.cfg.snapshot_store = xstrdup(expand_macros(value));
 	else if (!strcmp(name, "cache-root-ttl"))
 		ctx.cfg.cache_root_ttl = atoi(value);
 	else if (!strcmp(name, "cache-repo-ttl"))
@@ -297,6 +316,8 @@ static void config_cb(const char *name, const char *value)
 		ctx.cfg.max_commit_count = atoi(value);
 	else if (!strcmp(name, "max-subtree-commits"))
 		ctx.cfg.max_subtree_commits = atoi(value);
+	else if (!strcmp(name, "max-tree-entries"))
+		ctx.cfg.max_tree_entries = atoi(value);
 	else if (!strcmp(name, "project-list"))
 		ctx.cfg.project_list = xstrdup(expand_macros(value));
 	else if (!strcmp(name, "scan-path"))
@@ -412,6 +433,12 @@ static void querystring_cb(const char *name, const char *value)
 		ctx.qry.ignorews = atoi(value);
 	} else if (!strcmp(name, "follow")) {
 		ctx.qry.follow = atoi(value);
+	} else if (!strcmp(name, "after")) {
+		ctx.qry.after = xstrdup(value);
+	} else if (!strcmp(name, "lines")) {
+		ctx.qry.lines = xstrdup(value);
+	} else if (!strcmp(name, "service")) {
+		ctx.qry.service = xstrdup(value);
 	}
 }
 
@@ -420,6 +447,7 @@ static void prepare_context(void)
 	memset(&ctx, 0, sizeof(ctx));
 	ctx.cfg.agefile = "info/web/last-modified";
 	ctx.cfg.cache_size = 0;
+	ctx.cfg.index_cache_size = 1000;
 	ctx.cfg.cache_max_create_time = 5;
 	ctx.cfg.cache_root = CGIT_CACHE_ROOT;
 	ctx.cfg.cache_about_ttl = 15;
@@ -440,9 +468,12 @@ static void prepare_context(void)
 	ctx.cfg.enable_tree_linenumbers = 1;
 	ctx.cfg.enable_git_config = 0;
 	ctx.cfg.enable_subtree = 0;
+	ctx.cfg.enable_tree_lastcommit = 0;
+	ctx.cfg.header_branches = 100;
 	ctx.cfg.max_repo_count = 50;
 	ctx.cfg.max_commit_count = 50;
 	ctx.cfg.max_subtree_commits = 2000;
+	ctx.cfg.max_tree_entries = 1000;
 	ctx.cfg.max_lock_attempts = 5;
 	ctx.cfg.max_msg_len = 80;
 	ctx.cfg.max_repodesc_len = 80;
@@ -921,6 +952,8 @@ static void print_repo(FILE *f, struct cgit_repo *repo)
 	fprintf(f, "repo.enable-subject-links=%d\n", repo->enable_subject_links);
 	fprintf(f, "repo.enable-html-serving=%d\n", repo->enable_html_serving);
 	fprintf(f, "repo.enable-subtree=%d\n", repo->enable_subtree);
+	fprintf(f, "repo.enable-tree-lastcommit=%d\n",
+		repo->enable_tree_lastcommit);
 	if (repo->branch_sort == 1)
 		fprintf(f, "repo.branch-sort=age\n");
 	if (repo->commit_sort) {
@@ -944,6 +977,213 @@ static void print_repolist(FILE *f, struct cgit_repolist *list, int start)
 		print_repo(f, &list->repos[i]);
 }
 
+/*
+ * Next to a cached repolist "<cached_rc>.idx" records where the block of
+ * each repo starts and ends, as "<url>\t<start>\t<end>" lines sorted by
+ * url, plus the block of the last repo under an empty url. Its header is
+ * tied to the inode and size of the cached repolist it was written for.
+ */
+#define REPOLIST_INDEX_VERSION "repolist 1"
+
+static char *repolist_index_token(const struct stat *st)
+{
+	return xstrfmt("%s %lu %lu", REPOLIST_INDEX_VERSION,
+		       (unsigned long)st->st_ino, (unsigned long)st->st_size);
+}
+
+static int is_indexable_url(const char *url)
+{
+	if (!url || !*url)
+		return 0;
+	for (; *url; url++)
+		if ((unsigned char)*url < ' ')
+			return 0;
+	return 1;
+}
+
+static void print_indexed_repolist(FILE *f, int start, const char *cached_rc)
+{
+	struct string_list lines = STRING_LIST_INIT_DUP;
+	struct strbuf index = STRBUF_INIT;
+	struct strbuf line = STRBUF_INIT;
+	struct string_list_item *item;
+	struct stat st;
+	char *token;
+	off_t begin = 0, end = 0;
+	int i, indexable = 1;
+	FILE *out;
+
+	for (i = start; i < cgit_repolist.count; i++) {
+		struct cgit_repo *repo = &cgit_repolist.repos[i];
+
+		begin = ftello(f);
+		print_repo(f, repo);
+		end = ftello(f);
+		if (!is_indexable_url(repo->url))
+			indexable = 0;
+		strbuf_reset(&line);
+		strbuf_addf(&line, "%s\t%"PRIuMAX"\t%"PRIuMAX"\n", repo->url,
+			    (uintmax_t)begin, (uintmax_t)end);
+		string_list_append(&lines, line.buf);
+	}
+	if (!indexable || !lines.nr || fflush(f) || fstat(fileno(f), &st))
+		goto out;
+	strbuf_reset(&line);
+	strbuf_addf(&line, "\t%"PRIuMAX"\t%"PRIuMAX"\n",
+		    (uintmax_t)begin, (uintmax_t)end);
+	string_list_append(&lines, line.buf);
+	string_list_sort(&lines);
+
+	token = repolist_index_token(&st);
+	strbuf_addf(&index, "%s.idx.lock", cached_rc);
+	out = fopen(index.buf, "wx");
+	if (out) {
+		fprintf(out, "%s\n", token);
+		for_each_string_list_item(item, &lines)
+			fputs(item->string, out);
+		if (fclose(out) || rename(index.buf, fmt("%s.idx", cached_rc)))
+			unlink(index.buf);
+	}
+	free(token);
+out:
+	strbuf_release(&line);
+	strbuf_release(&index);
+	string_list_clear(&lines, 0);
+}
+
+/* Repo urls the request may be for: the "r" parameter and every leading
+ * part of the url, so that a lazily parsed repolist finds the same repo
+ * as cgit_parse_url() would.
+ */
+static struct string_list wanted_urls = STRING_LIST_INIT_DUP;
+static int wanted_url_in_query;
+
+static void add_wanted_url(const char *url)
+{
+	const char *p;
+
+	if (*url == '/')
+		url++;
+	for (p = strchr(url, '/'); p; p = strchr(p + 1, '/'))
+		string_list_append_nodup(&wanted_urls, xmemdupz(url, p - url));
+	string_list_append(&wanted_urls, url);
+}
+
+static void wanted_url_cb(const char *name, const char *value)
+{
+	if (!value)
+		return;
+	if (!strcmp(name, "url")) {
+		add_wanted_url(value);
+		wanted_url_in_query = 1;
+	} else if (!strcmp(name, "r"))
+		string_list_append(&wanted_urls, value);
+}
+
+static void find_wanted_urls(void)
+{
+	http_parse_querystring(ctx.qry.raw, wanted_url_cb);
+	if (!wanted_url_in_query && ctx.env.path_info)
+		add_wanted_url(ctx.env.path_info);
+}
+
+struct repo_block {
+	off_t start, end;
+};
+
+static int cmp_repo_blocks(const void *a, const void *b)
+{
+	const struct repo_block *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static void add_repo_blocks(struct repo_block **blocks, size_t *nr,
+			    size_t *alloc, const char *buf, size_t len,
+			    const char *url)
+{
+	const char *line = repo_cache_lookup(buf, len, url);
+	char *p;
+
+	/* The index ends with '\n', so that the numbers can be parsed
+	 * right out of the mapped file.
+	 */
+	for (; line; line = repo_cache_next(buf, len, line)) {
+		struct repo_block block;
+
+		p = (char *)line + strcspn(line, "\t\n");
+		if (*p != '\t')
+			continue;
+		block.start = strtoumax(p + 1, &p, 10);
+		if (*p != '\t')
+			continue;
+		block.end = strtoumax(p + 1, &p, 10);
+		if (*p != '\n' || block.end < block.start)
+			continue;
+		ALLOC_GROW(*blocks, *nr + 1, *alloc);
+		(*blocks)[(*nr)++] = block;
+	}
+}
+
+/* Parse only the blocks of the cached repolist the request can be for,
+ * and that of the last repo which later settings in cgitrc apply to.
+ * Returns -1 when the whole repolist has to be parsed instead.
+ */
+static int parse_wanted_repos(const char *cached_rc, const struct stat *st)
+{
+	struct repo_block *blocks = NULL;
+	size_t nr = 0, alloc = 0, i;
+	struct stat idx_st;
+	const char *buf, *eol;
+	char *token, *map;
+	size_t len;
+	int fd, ret = -1;
+
+	if (!wanted_urls.nr)
+		return -1;
+	fd = open(fmt("%s.idx", cached_rc), O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &idx_st) || !idx_st.st_size) {
+		close(fd);
+		return -1;
+	}
+	len = xsize_t(idx_st.st_size);
+	map = xmmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	token = repolist_index_token(st);
+	eol = memchr(map, '\n', len);
+	if (!eol || (size_t)(eol - map) != strlen(token) ||
+	    memcmp(map, token, eol - map))
+		goto out;
+	buf = eol + 1;
+	len -= buf - map;
+	if (len && buf[len - 1] != '\n')
+		goto out;
+
+	for (i = 0; i < wanted_urls.nr; i++)
+		if (*wanted_urls.items[i].string)
+			add_repo_blocks(&blocks, &nr, &alloc, buf, len,
+					wanted_urls.items[i].string);
+	if (!nr)
+		goto out;
+	add_repo_blocks(&blocks, &nr, &alloc, buf, len, "");
+
+	/* Keep the order of the repolist and parse each block once. */
+	QSORT(blocks, nr, cmp_repo_blocks);
+	for (i = 0; i < nr; i++)
+		if (!i || blocks[i].start != blocks[i - 1].start)
+			parse_configfile_range(cached_rc, blocks[i].start,
+					       blocks[i].end, config_cb);
+	ret = 0;
+out:
+	free(token);
+	free(blocks);
+	munmap(map, xsize_t(idx_st.st_size));
+	return ret;
+}
+
 /* Scan 'path' for git repositories, save the resulting repolist in 'cached_rc'
  * and return 0 on success.
  */
@@ -971,7 +1211,7 @@ static int generate_cached_repolist(const char *path, const char *cached_rc)
 		scan_projects(path, ctx.cfg.project_list, repo_config);
 	else
 		scan_tree(path, repo_config);
-	print_repolist(f, &cgit_repolist, idx);
+	print_indexed_repolist(f, idx, cached_rc);
 	if (rename(locked_rc.buf, cached_rc))
 		fprintf(stderr, "[cgit] Error renaming %s to %s: %s (%d)\n",
 			locked_rc.buf, cached_rc, strerror(errno), errno);
@@ -1008,7 +1248,8 @@ static void process_cached_repolist(const char *path)
 		goto out;
 	}
 
-	parse_configfile(cached_rc.buf, config_cb);
+	if (parse_wanted_repos(cached_rc.buf, &st))
+		parse_configfile(cached_rc.buf, config_cb);
 
 	/* If the cached configfile hasn't expired, lets exit now */
 	age = time(NULL) - st.st_mtime;
@@ -1027,6 +1268,9 @@ out:
 	strbuf_release(&cached_rc);
 }
 
+/* Number of tags to pre-generate snapshots for, -1 unless requested. */
+static int pregenerate_tags = -1;
+
 static void cgit_parse_args(int argc, const char **argv)
 {
 	int i;
@@ -1069,6 +1313,10 @@ static void cgit_parse_args(int argc, const char **argv)
 			ctx.qry.has_oid = 1;
 		} else if (skip_prefix(argv[i], "--ofs=", &arg)) {
 			ctx.qry.ofs = atoi(arg);
+		} else if (!strcmp(argv[i], "--pregenerate-snapshots")) {
+			pregenerate_tags = 10;
+		} else if (skip_prefix(argv[i], "--pregenerate-snapshots=", &arg)) {
+			pregenerate_tags = atoi(arg);
 		} else if (skip_prefix(argv[i], "--scan-tree=", &arg) ||
 		           skip_prefix(argv[i], "--scan-path=", &arg)) {
 			/*
@@ -1133,8 +1381,11 @@ int cmd_main(int argc, const char **argv)
 	cgit_repolist.repos = NULL;
 
 	cgit_parse_args(argc, argv);
+	find_wanted_urls();
 	parse_configfile(expand_macros(ctx.env.cgit_config), config_cb);
 	ctx.repo = NULL;
+	if (pregenerate_tags >= 0)
+		return cgit_pregenerate_snapshots(pregenerate_tags);
 	http_parse_querystring(ctx.qry.raw, querystring_cb);
 
 	/* If virtual-root isn't specified in cgitrc, lets pretend
@@ -1175,6 +1426,9 @@ int cmd_main(int argc, const char **argv)
 		ctx.page.expires += ttl * 60;
 	if (!ctx.env.authenticated || (ctx.env.request_method && !strcmp(ctx.env.request_method, "HEAD")))
 		ctx.cfg.cache_size = 0;
+	/* Smart HTTP requests and responses are specific to each client. */
+	if (cgit_clone_is_smart())
+		ctx.cfg.cache_size = 0;
 	err = cache_process(ctx.cfg.cache_size, ctx.cfg.cache_root,
 			    ctx.qry.raw, ttl, process_request);
 	cgit_cleanup_filters();
@@ -109,6 +109,7 @@ struct cgit_repo {
 	int enable_subject_links;
 	int enable_html_serving;
 	int enable_subtree;
+	int enable_tree_lastcommit;
 	int max_stats;
 	int max_subtree_commits;
 	int branch_sort;
@@ -197,6 +198,9 @@ struct cgit_query {
 	int ignorews;
 	int follow;
 	char *vpath;
+	char *after;
+	char *lines;
+	char *service;
 };
 
 struct cgit_config {
@@ -208,6 +212,8 @@ struct cgit_config {
 	char *footer;
 	char *head_include;
 	char *header;
+	char *index_root;
+	char *snapshot_store;
 	char *logo;
 	char *logo_link;
 	char *mimetype_file;
@@ -230,6 +236,7 @@ struct cgit_config {
 	char *virtual_root;	/* Always ends with '/'. */
 	char *strict_export;
 	int cache_size;
+	int index_cache_size;
 	int cache_dynamic_ttl;
 	int cache_max_create_time;
 	int cache_repo_ttl;
@@ -243,6 +250,7 @@ struct cgit_config {
 	int enable_filter_overrides;
 	int enable_follow_links;
 	int enable_http_clone;
+	int enable_smart_http;
 	int enable_index_links;
 	int enable_index_owner;
 	int enable_blame;
@@ -253,13 +261,16 @@ struct cgit_config {
 	int enable_subject_links;
 	int enable_html_serving;
 	int enable_subtree;
+	int enable_tree_lastcommit;
 	int enable_tree_linenumbers;
 	int enable_git_config;
 	int local_time;
 	int max_atom_items;
+	int header_branches;
 	int max_repo_count;
 	int max_commit_count;
 	int max_subtree_commits;
+	int max_tree_entries;
 	int max_lock_attempts;
 	int max_msg_len;
 	int max_repodesc_len;
@@ -344,6 +355,7 @@ extern const struct cgit_snapshot_format cgit_snapshot_formats[];
 extern char *cgit_default_repo_desc;
 extern struct cgit_repo *cgit_add_repo(const char *url);
 extern struct cgit_repo *cgit_get_repoinfo(const char *url);
+extern void cgit_repo_set_url(struct cgit_repo *repo, char *url);
 extern void cgit_repo_config_cb(const char *name, const char *value);
 
 extern int chk_zero(int result, char *msg);
@@ -386,19 +398,24 @@ __attribute__((format (printf,1,2)))
 extern char *fmtalloc(const char *format,...);
 
 extern struct commitinfo *cgit_parse_commit(struct commit *commit);
+extern char *cgit_parse_commit_author(struct commit *commit);
 extern struct taginfo *cgit_parse_tag(struct tag *tag);
 extern void cgit_parse_url(const char *url);
 
 extern const char *cgit_repobasename(const char *reponame);
 
 extern int cgit_parse_snapshots_mask(const char *str);
+extern void cgit_set_snapshot_threads(const char *format, const char *value);
 extern const struct object_id *cgit_snapshot_get_sig(const char *ref,
 						     const struct cgit_snapshot_format *f);
+extern unsigned cgit_snapshot_sig_formats(const char *ref);
 extern const unsigned cgit_snapshot_format_bit(const struct cgit_snapshot_format *f);
 
 extern int cgit_open_filter(struct cgit_filter *filter, ...);
 extern int cgit_close_filter(struct cgit_filter *filter);
 extern void cgit_fprintf_filter(struct cgit_filter *filter, FILE *f, const char *prefix);
+extern void cgit_set_filter_blob(struct cgit_filter *filter,
+				 const struct object_id *oid);
 extern void cgit_exec_filter_init(struct cgit_exec_filter *filter, char *cmd, char **argv);
 extern struct cgit_filter *cgit_new_filter(const char *cmd, filter_type filtertype);
 extern void cgit_cleanup_filters(void);
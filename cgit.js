@@ -67,20 +67,27 @@ document.addEventListener("DOMContentLoaded", function() {
 
 	var treeFilter = document.getElementById("tree-filter");
 	if (treeFilter) {
-		var table = treeFilter.parentNode.nextElementSibling;
-		var rows = table ? table.querySelectorAll("tr[data-name]") : [];
 		var count = document.getElementById("tree-filter-count");
 
+		/*
+		 * A complete listing is filtered right here. When the server
+		 * only sent one page (or an already filtered listing), the
+		 * filter is sent to the server instead and the listing is
+		 * replaced with its answer.
+		 */
+		function listing() {
+			return document.getElementById("tree-listing");
+		}
+
 		function updateTreeFilter() {
 			var q = treeFilter.value.toLowerCase();
+			var rows = listing().querySelectorAll("tr[data-name]");
 			var shown = 0;
 			var total = rows.length;
 
 			for (var i = 0; i < rows.length; i++) {
 				var name = rows[i].getAttribute("data-name") || "";
-				var path = rows[i].getAttribute("data-path") || "";
-				var hay = (name + " " + path).toLowerCase();
-				if (!q || hay.indexOf(q) !== -1) {
+				if (!q || name.toLowerCase().indexOf(q) !== -1) {
 					rows[i].style.display = "";
 					shown++;
 				} else {
@@ -96,8 +103,90 @@ document.addEventListener("DOMContentLoaded", function() {
 			}
 		}
 
-		treeFilter.addEventListener("input", updateTreeFilter, false);
-		updateTreeFilter();
+		var pending = null, request = null;
+
+		function queryTreeFilter() {
+			var form = treeFilter.form;
+			var params = new URLSearchParams(new FormData(form));
+			var url = form.getAttribute("action") || window.location.pathname;
+
+			if (request)
+				request.abort();
+			request = new XMLHttpRequest();
+			request.open("GET", url + (url.indexOf("?") === -1 ? "?" : "&") + params.toString());
+			request.responseType = "document";
+			request.onload = function() {
+				var current = listing();
+				var update = this.response && this.response.getElementById("tree-listing");
+
+				if (this.status !== 200 || !update || !current)
+					return;
+				current.parentNode.replaceChild(document.importNode(update, true), current);
+				if (count)
+					count.textContent = treeFilter.value && update.getAttribute("data-total") !== null ?
+						update.getAttribute("data-total") + " found" : "";
+			};
+			request.send();
+		}
+
+		treeFilter.addEventListener("input", function() {
+			if (!listing().hasAttribute("data-partial")) {
+				updateTreeFilter();
+				return;
+			}
+			window.clearTimeout(pending);
+			pending = window.setTimeout(queryTreeFilter, 250);
+		}, false);
+		treeFilter.form.addEventListener("submit", function(e) {
+			if (!listing().hasAttribute("data-partial")) {
+				e.preventDefault();
+				updateTreeFilter();
+			}
+		}, false);
+		if (!listing().hasAttribute("data-partial"))
+			updateTreeFilter();
+	}
+
+	/*
+	 * The header only lists the most recent branches; fetch all of
+	 * them the first time the branch selector is used.
+	 */
+	var branchSelect = document.querySelector("select[data-branches]");
+	if (branchSelect) {
+		var branchesLoaded = false;
+
+		function loadBranches() {
+			if (branchesLoaded)
+				return;
+			branchesLoaded = true;
+
+			var xhr = new XMLHttpRequest();
+			xhr.open("GET", branchSelect.getAttribute("data-branches"));
+			xhr.onload = function() {
+				var names;
+
+				if (xhr.status !== 200)
+					return;
+				try {
+					names = JSON.parse(xhr.responseText);
+				} catch (e) {
+					return;
+				}
+				var current = branchSelect.value;
+				while (branchSelect.options.length)
+					branchSelect.remove(0);
+				for (var i = 0; i < names.length; i++) {
+					var option = new Option(names[i], names[i]);
+					option.selected = names[i] === current;
+					branchSelect.add(option);
+				}
+				branchSelect.value = current;
+			};
+			xhr.send();
+		}
+
+		branchSelect.addEventListener("focus", loadBranches, false);
+		branchSelect.addEventListener("mousedown", loadBranches, false);
 	}
 }, false);
 
@@ -72,8 +72,13 @@ CGIT_OBJ_NAMES += cache.o
 CGIT_OBJ_NAMES += cmd.o
 CGIT_OBJ_NAMES += configfile.o
 CGIT_OBJ_NAMES += filter.o
+CGIT_OBJ_NAMES += highlight.o
 CGIT_OBJ_NAMES += html.o
+CGIT_OBJ_NAMES += markdown.o
+CGIT_OBJ_NAMES += parallel-gzip.o
 CGIT_OBJ_NAMES += parsing.o
+CGIT_OBJ_NAMES += ref-snapshot.o
+CGIT_OBJ_NAMES += repo-cache.o
 CGIT_OBJ_NAMES += scan-tree.o
 CGIT_OBJ_NAMES += shared.o
 CGIT_OBJ_NAMES += ui-atom.o
@@ -131,6 +131,11 @@ static void rawdiff_fn(void)
 	cgit_print_diff(ctx.qry.oid, ctx.qry.oid2, ctx.qry.path, 1, 1);
 }
 
+static void git_upload_pack_fn(void)
+{
+	cgit_clone_upload_pack();
+}
+
 static void info_fn(void)
 {
 	cgit_clone_info();
@@ -172,6 +177,11 @@ static void plain_fn(void)
 	cgit_print_plain();
 }
 
+static void branches_fn(void)
+{
+	cgit_print_branch_names();
+}
+
 static void refs_fn(void)
 {
 	cgit_print_refs();
@@ -214,10 +224,12 @@ struct cgit_cmd *cgit_get_cmd(void)
 		def_cmd(about, 0, 0, 0),
 		def_cmd(blame, 1, 1, 0),
 		def_cmd(blob, 1, 0, 0),
+		def_cmd(branches, 1, 0, 0),
 		def_cmd(cla, 0, 0, 0),
 		def_cmd(commit, 1, 1, 0),
 		def_cmd(coc, 0, 0, 0),
 		def_cmd(diff, 1, 1, 0),
+		{"git-upload-pack", git_upload_pack_fn, 1, 0, 1},
 		def_cmd(info, 1, 0, 1),
 		def_cmd(log, 1, 1, 0),
 		def_cmd(ls_cache, 0, 0, 0),
@@ -31,7 +31,8 @@ static void skip_line(FILE *f)
 		;
 }
 
-static int read_config_line(FILE *f, struct strbuf *name, struct strbuf *value)
+static int read_config_line(FILE *f, off_t end, struct strbuf *name,
+			    struct strbuf *value)
 {
 	int c = next_char(f);
 
@@ -49,6 +50,10 @@ static int read_config_line(FILE *f, struct strbuf *name, struct strbuf *value)
 		c = next_char(f);
 	}
 
+	/* Stop at the first line starting at or after `end`. */
+	if (end >= 0 && ftello(f) > end)
+		return 0;
+
 	/* Read variable name. */
 	while (c != '=') {
 		if (c == '\n' || c == EOF)
@@ -67,7 +72,8 @@ static int read_config_line(FILE *f, struct strbuf *name, struct strbuf *value)
 	return 1;
 }
 
-int parse_configfile(const char *filename, configfile_value_fn fn)
+int parse_configfile_range(const char *filename, off_t start, off_t end,
+			   configfile_value_fn fn)
 {
 	static int nesting;
 	struct strbuf name = STRBUF_INIT;
@@ -79,8 +85,12 @@ int parse_configfile(const char *filename, configfile_value_fn fn)
 		return -1;
 	if (!(f = fopen(filename, "r")))
 		return -1;
+	if (start && fseeko(f, start, SEEK_SET)) {
+		fclose(f);
+		return -1;
+	}
 	nesting++;
-	while (read_config_line(f, &name, &value))
+	while (read_config_line(f, end, &name, &value))
 		fn(name.buf, value.buf);
 	nesting--;
 	fclose(f);
@@ -89,3 +99,7 @@ int parse_configfile(const char *filename, configfile_value_fn fn)
 	return 0;
 }
 
+int parse_configfile(const char *filename, configfile_value_fn fn)
+{
+	return parse_configfile_range(filename, 0, -1, fn);
+}
@@ -7,4 +7,11 @@ typedef void (*configfile_value_fn)(const char *name, const char *value);
 
 extern int parse_configfile(const char *filename, configfile_value_fn fn);
 
+/* Parse the lines of `filename` starting between offsets `start` and
+ * `end` (the end of the file if negative). `start` must be at the
+ * beginning of a line.
+ */
+extern int parse_configfile_range(const char *filename, off_t start,
+				  off_t end, configfile_value_fn fn);
+
 #endif /* CONFIGFILE_H */
@@ -9,6 +9,10 @@
 
 #include "cgit.h"
 #include "html.h"
+#include "highlight.h"
+#include "markdown.h"
+#include "unix-socket.h"
+#include "strmap.h"
 #ifndef NO_LUA
 #include <dlfcn.h>
 #include <lua.h>
@@ -137,6 +141,401 @@ void cgit_exec_filter_init(struct cgit_exec_filter *filter, char *cmd, char **ar
 	filter->base.argument_count = 0;
 }
 
+/*
+ * Filters which process their input as a whole capture whatever is
+ * written to stdout while they are open in a temporary file, which is
+ * reused for every use of the filter.
+ */
+struct filter_capture {
+	FILE *file;
+	int old_stdout;
+};
+
+static void begin_capture(struct filter_capture *capture, const char *name)
+{
+	if (!capture->file)
+		capture->file = tmpfile();
+	else if (ftruncate(fileno(capture->file), 0) ||
+		 lseek(fileno(capture->file), 0, SEEK_SET) < 0)
+		die_errno("Unable to reset temporary file for filter %s", name);
+	if (!capture->file)
+		die_errno("Unable to create temporary file for filter %s", name);
+	capture->old_stdout = chk_positive(dup(STDOUT_FILENO),
+		"Unable to duplicate STDOUT");
+	chk_non_negative(dup2(fileno(capture->file), STDOUT_FILENO),
+		"Unable to redirect STDOUT");
+}
+
+static void end_capture(struct filter_capture *capture, struct strbuf *buf,
+			const char *name)
+{
+	int fd = fileno(capture->file);
+
+	chk_non_negative(dup2(capture->old_stdout, STDOUT_FILENO),
+		"Unable to restore STDOUT");
+	close(capture->old_stdout);
+
+	if (lseek(fd, 0, SEEK_SET) < 0 || strbuf_read(buf, fd, 0) < 0)
+		die_errno("Unable to read output for filter %s", name);
+}
+
+static void release_capture(struct filter_capture *capture)
+{
+	if (capture->file)
+		fclose(capture->file);
+	capture->file = NULL;
+}
+
+/*
+ * Built-in filters run inside the cgit process, and are handed the
+ * captured text in one piece when they are closed, along with the id of
+ * the blob it was read from if the caller knows it.
+ */
+struct builtin_filter_spec {
+	const char *name;
+	void (*fn)(const char *buf, size_t len, char **argv,
+		   const struct object_id *oid);
+};
+
+static void highlight_builtin_filter(const char *buf, size_t len, char **argv,
+				     const struct object_id *oid)
+{
+	cgit_highlight(buf, len, argv[0], oid);
+}
+
+static void markdown_builtin_filter(const char *buf, size_t len, char **argv,
+				    const struct object_id *oid)
+{
+	cgit_render_about(buf, len, argv[0], oid);
+}
+
+static const struct builtin_filter_spec builtin_filters[] = {
+	{ "highlight", highlight_builtin_filter },
+	{ "markdown", markdown_builtin_filter },
+};
+
+struct builtin_filter {
+	struct cgit_filter base;
+	const struct builtin_filter_spec *spec;
+	char **argv;
+	const struct object_id *oid;
+	struct filter_capture capture;
+};
+
+static int open_builtin_filter(struct cgit_filter *base, va_list ap)
+{
+	struct builtin_filter *filter = (struct builtin_filter *)base;
+	int i;
+
+	for (i = 0; i < filter->base.argument_count; i++)
+		filter->argv[i] = va_arg(ap, char *);
+	begin_capture(&filter->capture, filter->spec->name);
+	return 0;
+}
+
+static int close_builtin_filter(struct cgit_filter *base)
+{
+	struct builtin_filter *filter = (struct builtin_filter *)base;
+	struct strbuf buf = STRBUF_INIT;
+	int i;
+
+	end_capture(&filter->capture, &buf, filter->spec->name);
+	filter->spec->fn(buf.buf, buf.len, filter->argv, filter->oid);
+	strbuf_release(&buf);
+
+	for (i = 0; i < filter->base.argument_count; i++)
+		filter->argv[i] = NULL;
+	filter->oid = NULL;
+	return 0;
+}
+
+static void fprintf_builtin_filter(struct cgit_filter *base, FILE *f,
+				   const char *prefix)
+{
+	struct builtin_filter *filter = (struct builtin_filter *)base;
+	fprintf(f, "%sbuiltin:%s\n", prefix, filter->spec->name);
+}
+
+static void cleanup_builtin_filter(struct cgit_filter *base)
+{
+	struct builtin_filter *filter = (struct builtin_filter *)base;
+
+	release_capture(&filter->capture);
+	FREE_AND_NULL(filter->argv);
+}
+
+static struct cgit_filter *new_builtin_filter(const char *cmd,
+					      int argument_count)
+{
+	struct builtin_filter *filter;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(builtin_filters); i++)
+		if (!strcmp(builtin_filters[i].name, cmd))
+			break;
+	if (i == ARRAY_SIZE(builtin_filters))
+		die("Invalid builtin filter: %s", cmd);
+
+	filter = xcalloc(1, sizeof(*filter));
+	filter->base.open = open_builtin_filter;
+	filter->base.close = close_builtin_filter;
+	filter->base.fprintfp = fprintf_builtin_filter;
+	filter->base.cleanup = cleanup_builtin_filter;
+	filter->base.argument_count = argument_count;
+	filter->spec = &builtin_filters[i];
+	filter->argv = xcalloc(argument_count + 1, sizeof(char *));
+	return &filter->base;
+}
+
+/*
+ * Co-process filters are started once and then serve every use of the
+ * filter for the rest of the request, or connect to a server listening
+ * on a UNIX socket which may outlive it. Each use is one request and
+ * one response, made of length-prefixed frames:
+ *
+ *   request:  "<argc>\n", then argc times "<len>\n<arg>",
+ *             then "<len>\n<input>"
+ *   response: "<status> <len>\n<output>"
+ */
+struct coproc_filter {
+	struct cgit_filter base;
+	char *cmd;
+	char **argv;
+	pid_t pid;
+	int to_fd;
+	int from_fd;
+	struct filter_capture capture;
+};
+
+/* Writes must not block, see exchange(). */
+static void set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		die_errno("Unable to make filter pipe non-blocking");
+}
+
+static void start_coproc(struct coproc_filter *filter)
+{
+	const char *path;
+	int to[2], from[2];
+
+	if (filter->to_fd >= 0)
+		return;
+
+	if (skip_prefix(filter->cmd, "unix:", &path)) {
+		filter->to_fd = unix_stream_connect(path, 0);
+		if (filter->to_fd < 0)
+			die_errno("Unable to connect to filter socket %s", path);
+		filter->from_fd = chk_positive(dup(filter->to_fd),
+			"Unable to duplicate filter socket");
+		set_nonblock(filter->to_fd);
+		return;
+	}
+
+	chk_zero(pipe(to), "Unable to create pipe to subprocess");
+	chk_zero(pipe(from), "Unable to create pipe from subprocess");
+	filter->pid = chk_non_negative(fork(), "Unable to create subprocess");
+	if (filter->pid == 0) {
+		close(to[1]);
+		close(from[0]);
+		chk_non_negative(dup2(to[0], STDIN_FILENO),
+			"Unable to use pipe as STDIN");
+		chk_non_negative(dup2(from[1], STDOUT_FILENO),
+			"Unable to use pipe as STDOUT");
+		close(to[0]);
+		close(from[1]);
+		execlp(filter->cmd, filter->cmd, (char *)NULL);
+		die_errno("Unable to exec subprocess %s", filter->cmd);
+	}
+	close(to[0]);
+	close(from[1]);
+	filter->to_fd = to[1];
+	filter->from_fd = from[0];
+
+	/* Other subprocesses must not keep the co-process alive. */
+	fcntl(filter->to_fd, F_SETFD, FD_CLOEXEC);
+	fcntl(filter->from_fd, F_SETFD, FD_CLOEXEC);
+	set_nonblock(filter->to_fd);
+}
+
+static void add_frame(struct strbuf *request, const char *buf, size_t len)
+{
+	strbuf_addf(request, "%"PRIuMAX"\n", (uintmax_t)len);
+	strbuf_add(request, buf, len);
+}
+
+/* Returns 1 once `raw` holds a whole response, which is then parsed
+ * into `status` and `out`.
+ */
+static int parse_response(struct coproc_filter *filter, struct strbuf *raw,
+			  int *status, struct strbuf *out)
+{
+	const char *eol = memchr(raw->buf, '\n', raw->len);
+	uintmax_t len;
+	size_t avail;
+	char *end;
+
+	if (!eol) {
+		if (raw->len >= 64)
+			die("Invalid response from filter %s", filter->cmd);
+		return 0;
+	}
+	*status = strtol(raw->buf, &end, 10);
+	if (*end != ' ')
+		die("Invalid response from filter %s", filter->cmd);
+	len = strtoumax(end + 1, &end, 10);
+	if (end != eol)
+		die("Invalid response from filter %s", filter->cmd);
+	avail = raw->len - (eol + 1 - raw->buf);
+	if (avail < len)
+		return 0;
+	if (avail > len)
+		die("Unexpected output from filter %s", filter->cmd);
+	strbuf_add(out, eol + 1, len);
+	return 1;
+}
+
+/*
+ * Send `request` while reading the response, so that a co-process which
+ * starts answering before it has read all of its input cannot block on
+ * a full pipe to cgit while cgit blocks on a full pipe to it.
+ */
+static int exchange(struct coproc_filter *filter, const struct strbuf *request,
+		    struct strbuf *out)
+{
+	struct strbuf raw = STRBUF_INIT;
+	struct pollfd pfd[2];
+	size_t written = 0;
+	int nr, status = 0, done = 0;
+	ssize_t n;
+
+	while (!done) {
+		nr = 0;
+		if (written < request->len) {
+			pfd[nr].fd = filter->to_fd;
+			pfd[nr].events = POLLOUT;
+			nr++;
+		}
+		pfd[nr].fd = filter->from_fd;
+		pfd[nr].events = POLLIN;
+		nr++;
+		if (poll(pfd, nr, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			die_errno("Unable to wait for filter %s", filter->cmd);
+		}
+
+		if (nr == 2 && pfd[0].revents) {
+			n = write(filter->to_fd, request->buf + written,
+				  request->len - written);
+			if (n < 0 && errno != EAGAIN && errno != EINTR)
+				die_errno("Unable to write to filter %s",
+					  filter->cmd);
+			if (n > 0)
+				written += n;
+		}
+		if (pfd[nr - 1].revents) {
+			n = strbuf_read_once(&raw, filter->from_fd, 0);
+			if (n < 0 && errno != EAGAIN && errno != EINTR)
+				die_errno("Unable to read from filter %s",
+					  filter->cmd);
+			if (!n)
+				die("Filter %s closed its output", filter->cmd);
+			if (n > 0)
+				done = parse_response(filter, &raw, &status,
+						      out);
+		}
+	}
+	if (written < request->len)
+		die("Filter %s responded before reading its input",
+		    filter->cmd);
+	strbuf_release(&raw);
+	return status;
+}
+
+static int open_coproc_filter(struct cgit_filter *base, va_list ap)
+{
+	struct coproc_filter *filter = (struct coproc_filter *)base;
+	int i;
+
+	for (i = 0; i < filter->base.argument_count; i++)
+		filter->argv[i] = va_arg(ap, char *);
+	start_coproc(filter);
+	begin_capture(&filter->capture, filter->cmd);
+	return 0;
+}
+
+static int close_coproc_filter(struct cgit_filter *base)
+{
+	struct coproc_filter *filter = (struct coproc_filter *)base;
+	struct strbuf request = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	int i, status;
+
+	end_capture(&filter->capture, &buf, filter->cmd);
+
+	strbuf_addf(&request, "%d\n", filter->base.argument_count);
+	for (i = 0; i < filter->base.argument_count; i++) {
+		const char *arg = filter->argv[i] ? filter->argv[i] : "";
+
+		add_frame(&request, arg, strlen(arg));
+		filter->argv[i] = NULL;
+	}
+	add_frame(&request, buf.buf, buf.len);
+
+	strbuf_reset(&buf);
+	status = exchange(filter, &request, &buf);
+	html_raw(buf.buf, buf.len);
+	strbuf_release(&request);
+	strbuf_release(&buf);
+	return status;
+}
+
+static void fprintf_coproc_filter(struct cgit_filter *base, FILE *f,
+				  const char *prefix)
+{
+	struct coproc_filter *filter = (struct coproc_filter *)base;
+	fprintf(f, "%scoproc:%s\n", prefix, filter->cmd);
+}
+
+static void cleanup_coproc_filter(struct cgit_filter *base)
+{
+	struct coproc_filter *filter = (struct coproc_filter *)base;
+
+	if (filter->to_fd >= 0) {
+		/* EOF on its input tells the co-process to exit. */
+		close(filter->to_fd);
+		close(filter->from_fd);
+		filter->to_fd = filter->from_fd = -1;
+	}
+	if (filter->pid > 0) {
+		waitpid(filter->pid, NULL, 0);
+		filter->pid = 0;
+	}
+	release_capture(&filter->capture);
+	FREE_AND_NULL(filter->argv);
+	FREE_AND_NULL(filter->cmd);
+}
+
+static struct cgit_filter *new_coproc_filter(const char *cmd,
+					     int argument_count)
+{
+	struct coproc_filter *filter;
+
+	filter = xcalloc(1, sizeof(*filter));
+	filter->base.open = open_coproc_filter;
+	filter->base.close = close_coproc_filter;
+	filter->base.fprintfp = fprintf_coproc_filter;
+	filter->base.cleanup = cleanup_coproc_filter;
+	filter->base.argument_count = argument_count;
+	filter->cmd = xstrdup(cmd);
+	filter->argv = xcalloc(argument_count + 1, sizeof(char *));
+	filter->to_fd = filter->from_fd = -1;
+	return &filter->base;
+}
+
 #ifdef NO_LUA
 void cgit_init_filters(void)
 {
@@ -179,10 +578,20 @@ static inline void unhook_write(void)
 	current_write_filter = NULL;
 }
 
+/*
+ * Output is collected in a buffer and handed to filter_write() in large
+ * chunks, since html() and friends produce many tiny writes. Scripts
+ * which set filter_mode = "document" get all of it in a single call
+ * when the filter is closed.
+ */
+#define LUA_FILTER_CHUNK_SIZE (64 * 1024)
+
 struct lua_filter {
 	struct cgit_filter base;
 	char *script_file;
 	lua_State *lua_state;
+	struct strbuf buffer;
+	int document_mode;
 };
 
 static void error_lua_filter(struct lua_filter *filter)
@@ -191,14 +600,29 @@ static void error_lua_filter(struct lua_filter *filter)
 	lua_pop(filter->lua_state, 1);
 }
 
-static ssize_t write_lua_filter(struct cgit_filter *base, const void *buf, size_t count)
+static int flush_lua_filter(struct lua_filter *filter)
 {
-	struct lua_filter *filter = (struct lua_filter *)base;
-
+	if (!filter->buffer.len)
+		return 0;
 	lua_getglobal(filter->lua_state, "filter_write");
-	lua_pushlstring(filter->lua_state, buf, count);
+	lua_pushlstring(filter->lua_state, filter->buffer.buf,
+			filter->buffer.len);
+	strbuf_reset(&filter->buffer);
 	if (lua_pcall(filter->lua_state, 1, 0, 0)) {
 		error_lua_filter(filter);
+		return -1;
+	}
+	return 0;
+}
+
+static ssize_t write_lua_filter(struct cgit_filter *base, const void *buf, size_t count)
+{
+	struct lua_filter *filter = (struct lua_filter *)base;
+
+	strbuf_add(&filter->buffer, buf, count);
+	if (!filter->document_mode &&
+	    filter->buffer.len >= LUA_FILTER_CHUNK_SIZE &&
+	    flush_lua_filter(filter)) {
 		errno = EIO;
 		return -1;
 	}
@@ -263,6 +687,7 @@ static void cleanup_lua_filter(struct cgit_filter *base)
 
 	lua_close(filter->lua_state);
 	filter->lua_state = NULL;
+	strbuf_release(&filter->buffer);
 	if (filter->script_file) {
 		free(filter->script_file);
 		filter->script_file = NULL;
@@ -271,6 +696,8 @@ static void cleanup_lua_filter(struct cgit_filter *base)
 
 static int init_lua_filter(struct lua_filter *filter)
 {
+	const char *mode;
+
 	if (filter->lua_state)
 		return 0;
 
@@ -298,6 +725,11 @@ static int init_lua_filter(struct lua_filter *filter)
 		filter->lua_state = NULL;
 		return 1;
 	}
+
+	lua_getglobal(filter->lua_state, "filter_mode");
+	mode = lua_tostring(filter->lua_state, -1);
+	filter->document_mode = mode && !strcmp(mode, "document");
+	lua_pop(filter->lua_state, 1);
 	return 0;
 }
 
@@ -309,6 +741,7 @@ static int open_lua_filter(struct cgit_filter *base, va_list ap)
 	if (init_lua_filter(filter))
 		return 1;
 
+	strbuf_reset(&filter->buffer);
 	hook_write(base, write_lua_filter);
 
 	lua_getglobal(filter->lua_state, "filter_open");
@@ -326,6 +759,11 @@ static int close_lua_filter(struct cgit_filter *base)
 	struct lua_filter *filter = (struct lua_filter *)base;
 	int ret = 0;
 
+	if (flush_lua_filter(filter)) {
+		unhook_write();
+		return -1;
+	}
+
 	lua_getglobal(filter->lua_state, "filter_close");
 	if (lua_pcall(filter->lua_state, 0, 1, 0)) {
 		error_lua_filter(filter);
@@ -358,6 +796,7 @@ static struct cgit_filter *new_lua_filter(const char *cmd, int argument_count)
 	filter->base.cleanup = cleanup_lua_filter;
 	filter->base.argument_count = argument_count;
 	filter->script_file = xstrdup(cmd);
+	strbuf_init(&filter->buffer, 0);
 
 	return &filter->base;
 }
@@ -365,6 +804,122 @@ static struct cgit_filter *new_lua_filter(const char *cmd, int argument_count)
 #endif
 
 
+/*
+ * Email and owner filters are used for every row of a page, but mostly
+ * for the same few authors. Their results are remembered for the rest
+ * of the request, keyed by arguments and input, so that the actual
+ * filter only runs once for each of them.
+ */
+struct memo_result {
+	char *output;
+	size_t len;
+	int status;
+};
+
+struct memo_filter {
+	struct cgit_filter base;
+	struct cgit_filter *filter;
+	char *argv[2];
+	struct filter_capture input;
+	struct filter_capture output;
+	struct strmap results;
+};
+
+static int open_memo_filter(struct cgit_filter *base, va_list ap)
+{
+	struct memo_filter *memo = (struct memo_filter *)base;
+	int i;
+
+	for (i = 0; i < memo->base.argument_count; i++)
+		memo->argv[i] = va_arg(ap, char *);
+	begin_capture(&memo->input, "memo");
+	return 0;
+}
+
+static int close_memo_filter(struct cgit_filter *base)
+{
+	struct memo_filter *memo = (struct memo_filter *)base;
+	struct strbuf input = STRBUF_INIT;
+	struct strbuf key = STRBUF_INIT;
+	struct memo_result *result;
+	int i;
+
+	end_capture(&memo->input, &input, "memo");
+
+	for (i = 0; i < memo->base.argument_count; i++) {
+		const char *arg = memo->argv[i] ? memo->argv[i] : "";
+
+		strbuf_addf(&key, "%"PRIuMAX":%s", (uintmax_t)strlen(arg), arg);
+	}
+	strbuf_addbuf(&key, &input);
+
+	result = strmap_get(&memo->results, key.buf);
+	if (!result) {
+		struct strbuf output = STRBUF_INIT;
+
+		CALLOC_ARRAY(result, 1);
+		begin_capture(&memo->output, "memo");
+		cgit_open_filter(memo->filter, memo->argv[0], memo->argv[1]);
+		html_raw(input.buf, input.len);
+		result->status = cgit_close_filter(memo->filter);
+		end_capture(&memo->output, &output, "memo");
+		result->output = strbuf_detach(&output, &result->len);
+		strmap_put(&memo->results, key.buf, result);
+	}
+	html_raw(result->output, result->len);
+
+	/* The arguments only live as long as the caller's open/close. */
+	for (i = 0; i < memo->base.argument_count; i++)
+		memo->argv[i] = NULL;
+
+	strbuf_release(&key);
+	strbuf_release(&input);
+	return result->status;
+}
+
+static void fprintf_memo_filter(struct cgit_filter *base, FILE *f,
+				const char *prefix)
+{
+	struct memo_filter *memo = (struct memo_filter *)base;
+
+	cgit_fprintf_filter(memo->filter, f, prefix);
+}
+
+static void cleanup_memo_filter(struct cgit_filter *base)
+{
+	struct memo_filter *memo = (struct memo_filter *)base;
+	struct hashmap_iter iter;
+	struct strmap_entry *entry;
+
+	reap_filter(memo->filter);
+	release_capture(&memo->input);
+	release_capture(&memo->output);
+	strmap_for_each_entry(&memo->results, &iter, entry) {
+		struct memo_result *result = entry->value;
+
+		free(result->output);
+	}
+	strmap_clear(&memo->results, 1);
+}
+
+static struct cgit_filter *new_memo_filter(struct cgit_filter *filter)
+{
+	struct memo_filter *memo;
+
+	if (filter->argument_count > ARRAY_SIZE(memo->argv))
+		BUG("too many arguments for a memoized filter");
+
+	memo = xcalloc(1, sizeof(*memo));
+	memo->base.open = open_memo_filter;
+	memo->base.close = close_memo_filter;
+	memo->base.fprintfp = fprintf_memo_filter;
+	memo->base.cleanup = cleanup_memo_filter;
+	memo->base.argument_count = filter->argument_count;
+	memo->filter = filter;
+	strmap_init(&memo->results);
+	return &memo->base;
+}
+
 int cgit_open_filter(struct cgit_filter *filter, ...)
 {
 	int result;
@@ -389,6 +944,14 @@ void cgit_fprintf_filter(struct cgit_filter *filter, FILE *f, const char *prefix
 	filter->fprintfp(filter, f, prefix);
 }
 
+void cgit_set_filter_blob(struct cgit_filter *filter,
+			  const struct object_id *oid)
+{
+	/* Only built-in filters have a use for it, to key their caches. */
+	if (filter && filter->open == open_builtin_filter)
+		((struct builtin_filter *)filter)->oid = oid;
+}
+
 
 
 static const struct {
@@ -396,6 +959,8 @@ static const struct {
 	struct cgit_filter *(*ctor)(const char *cmd, int argument_count);
 } filter_specs[] = {
 	{ "exec", new_exec_filter },
+	{ "builtin", new_builtin_filter },
+	{ "coproc", new_coproc_filter },
 #ifndef NO_LUA
 	{ "lua", new_lua_filter },
 #endif
@@ -403,6 +968,7 @@ static const struct {
 
 struct cgit_filter *cgit_new_filter(const char *cmd, filter_type filtertype)
 {
+	struct cgit_filter *filter;
 	char *colon;
 	int i;
 	size_t len;
@@ -445,14 +1011,25 @@ struct cgit_filter *cgit_new_filter(const char *cmd, filter_type filtertype)
 	}
 
 	/* If no prefix is given, exec filter is the default. */
-	if (!colon)
-		return new_exec_filter(cmd, argument_count);
-
-	for (i = 0; i < ARRAY_SIZE(filter_specs); i++) {
-		if (len == strlen(filter_specs[i].prefix) &&
-		    !strncmp(filter_specs[i].prefix, cmd, len))
-			return filter_specs[i].ctor(colon + 1, argument_count);
+	if (!colon) {
+		filter = new_exec_filter(cmd, argument_count);
+	} else {
+		for (i = 0; i < ARRAY_SIZE(filter_specs); i++) {
+			if (len == strlen(filter_specs[i].prefix) &&
+			    !strncmp(filter_specs[i].prefix, cmd, len))
+				break;
+		}
+		if (i == ARRAY_SIZE(filter_specs))
+			die("Invalid filter type: %.*s", (int) len, cmd);
+		/* The auth filter writes headers and reads POST bodies. */
+		if (filtertype == AUTH &&
+		    (filter_specs[i].ctor == new_coproc_filter ||
+		     filter_specs[i].ctor == new_builtin_filter))
+			die("Invalid auth filter type: %.*s", (int) len, cmd);
+		filter = filter_specs[i].ctor(colon + 1, argument_count);
 	}
 
-	die("Invalid filter type: %.*s", (int) len, cmd);
+	if (filtertype == EMAIL || filtertype == OWNER)
+		return new_memo_filter(filter);
+	return filter;
 }
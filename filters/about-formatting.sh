@@ -2,6 +2,8 @@
 
 # This may be used with the about-filter or repo.about-filter setting in cgitrc.
 # It passes formatting of about pages to differing programs, depending on the usage.
+# For markdown, html and text files only, "about-filter=builtin:markdown" does the
+# same inside cgit without starting any process.
 
 # Markdown support requires python and markdown-python.
 # RestructuredText support requires python and docutils.
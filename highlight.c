@@ -0,0 +1,338 @@
+/* highlight.c: built-in syntax highlighting
+ *
+ * Copyright (C) 2026 Project Tick
+ *
+ * Licensed under GNU General Public License v2
+ *   (see COPYING for full license text)
+ *
+ *
+ * This is a deliberately simple table-driven tokenizer: each language
+ * is described by its keywords, comment markers and string quotes,
+ * which is enough to get comments, strings, numbers and keywords right
+ * for the common cases without forking an external highlighter.
+ *
+ * Highlighted output is stored below index-root, keyed by the blob id
+ * of the content, the language and HIGHLIGHT_VERSION, so that a file
+ * which did not change between commits is only highlighted once.
+ */
+
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "cgit.h"
+#include "highlight.h"
+#include "html.h"
+#include "repo-cache.h"
+#include "object-file.h"
+
+/* Bump whenever the generated markup changes. */
+#define HIGHLIGHT_VERSION "highlight 1"
+
+struct hl_lang {
+	const char *name;
+	const char *exts;		/* extensions or basenames */
+	const char *const *keywords;	/* sorted */
+	size_t nr_keywords;
+	const char *line_comment;
+	const char *block_open;
+	const char *block_close;
+	const char *quotes;
+	int preprocessor;
+};
+
+static const char *const c_keywords[] = {
+	"auto", "bool", "break", "case", "catch", "char", "class", "const",
+	"constexpr", "continue", "default", "delete", "do", "double", "else",
+	"enum", "explicit", "extern", "false", "float", "for", "friend",
+	"goto", "if", "inline", "int", "long", "namespace", "new", "noexcept",
+	"nullptr", "operator", "private", "protected", "public", "register",
+	"restrict", "return", "short", "signed", "sizeof", "static",
+	"static_assert", "struct", "switch", "template", "this", "throw",
+	"true", "try", "typedef", "typename", "union", "unsigned", "using",
+	"virtual", "void", "volatile", "while",
+};
+
+static const char *const python_keywords[] = {
+	"False", "None", "True", "and", "as", "assert", "async", "await",
+	"break", "class", "continue", "def", "del", "elif", "else", "except",
+	"finally", "for", "from", "global", "if", "import", "in", "is",
+	"lambda", "nonlocal", "not", "or", "pass", "raise", "return", "try",
+	"while", "with", "yield",
+};
+
+static const char *const shell_keywords[] = {
+	"case", "do", "done", "elif", "else", "esac", "exit", "export", "fi",
+	"for", "function", "if", "in", "local", "readonly", "return", "then",
+	"until", "while",
+};
+
+static const char *const js_keywords[] = {
+	"async", "await", "break", "case", "catch", "class", "const",
+	"continue", "default", "delete", "do", "else", "export", "extends",
+	"false", "finally", "for", "function", "if", "import", "in",
+	"instanceof", "interface", "let", "new", "null", "return", "static",
+	"super", "switch", "this", "throw", "true", "try", "type", "typeof",
+	"undefined", "var", "void", "while", "yield",
+};
+
+static const char *const go_keywords[] = {
+	"break", "case", "chan", "const", "continue", "default", "defer",
+	"else", "fallthrough", "false", "for", "func", "go", "goto", "if",
+	"import", "interface", "map", "nil", "package", "range", "return",
+	"select", "struct", "switch", "true", "type", "var",
+};
+
+static const char *const rust_keywords[] = {
+	"as", "async", "await", "break", "const", "continue", "crate", "dyn",
+	"else", "enum", "extern", "false", "fn", "for", "if", "impl", "in",
+	"let", "loop", "match", "mod", "move", "mut", "pub", "ref", "return",
+	"self", "static", "struct", "super", "trait", "true", "type",
+	"unsafe", "use", "where", "while",
+};
+
+static const char *const java_keywords[] = {
+	"abstract", "boolean", "break", "byte", "case", "catch", "char",
+	"class", "continue", "default", "do", "double", "else", "enum",
+	"extends", "false", "final", "finally", "float", "for", "if",
+	"implements", "import", "instanceof", "int", "interface", "long",
+	"new", "null", "package", "private", "protected", "public", "return",
+	"short", "static", "super", "switch", "synchronized", "this", "throw",
+	"throws", "true", "try", "void", "volatile", "while",
+};
+
+static const char *const lua_keywords[] = {
+	"and", "break", "do", "else", "elseif", "end", "false", "for",
+	"function", "goto", "if", "in", "local", "nil", "not", "or", "repeat",
+	"return", "then", "true", "until", "while",
+};
+
+static const char *const perl_keywords[] = {
+	"else", "elsif", "for", "foreach", "if", "last", "local", "my", "next",
+	"our", "package", "return", "sub", "unless", "until", "use", "while",
+};
+
+static const char *const ruby_keywords[] = {
+	"begin", "class", "def", "do", "else", "elsif", "end", "ensure",
+	"false", "if", "module", "next", "nil", "require", "rescue", "return",
+	"self", "true", "unless", "until", "when", "while", "yield",
+};
+
+static const char *const no_keywords[] = { NULL };
+
+#define LANG(name, exts, kw, line, open, close, quotes, pp) \
+	{ name, exts, kw, ARRAY_SIZE(kw) - (kw == no_keywords), \
+	  line, open, close, quotes, pp }
+
+static const struct hl_lang languages[] = {
+	LANG("c", "c h cc cpp cxx hh hpp hxx ino", c_keywords,
+	     "//", "/*", "*/", "\"'", 1),
+	LANG("python", "py pyw", python_keywords,
+	     "#", "\"\"\"", "\"\"\"", "\"'", 0),
+	LANG("shell", "sh bash zsh ksh", shell_keywords,
+	     "#", NULL, NULL, "\"'", 0),
+	LANG("js", "js mjs cjs ts jsx tsx", js_keywords,
+	     "//", "/*", "*/", "\"'`", 0),
+	LANG("go", "go", go_keywords, "//", "/*", "*/", "\"'`", 0),
+	LANG("rust", "rs", rust_keywords, "//", "/*", "*/", "\"", 0),
+	LANG("java", "java kt scala cs", java_keywords,
+	     "//", "/*", "*/", "\"'", 0),
+	LANG("lua", "lua", lua_keywords, "--", "--[[", "]]", "\"'", 0),
+	LANG("perl", "pl pm", perl_keywords, "#", NULL, NULL, "\"'", 0),
+	LANG("ruby", "rb", ruby_keywords, "#", NULL, NULL, "\"'", 0),
+	LANG("css", "css", no_keywords, NULL, "/*", "*/", "\"'", 0),
+	LANG("make", "mk mak Makefile GNUmakefile", no_keywords,
+	     "#", NULL, NULL, NULL, 0),
+};
+
+static int has_word(const char *list, const char *word, size_t len)
+{
+	while (*list) {
+		size_t n = strcspn(list, " ");
+
+		if (n == len && !strncmp(list, word, len))
+			return 1;
+		list += n;
+		while (*list == ' ')
+			list++;
+	}
+	return 0;
+}
+
+static const struct hl_lang *find_language(const char *filename)
+{
+	const char *base, *ext;
+	size_t i;
+
+	if (!filename)
+		return NULL;
+	base = strrchr(filename, '/');
+	base = base ? base + 1 : filename;
+	ext = strrchr(base, '.');
+	for (i = 0; i < ARRAY_SIZE(languages); i++) {
+		if (has_word(languages[i].exts, base, strlen(base)) ||
+		    (ext && has_word(languages[i].exts, ext + 1, strlen(ext + 1))))
+			return &languages[i];
+	}
+	return NULL;
+}
+
+static int cmp_keyword(const void *key, const void *elem)
+{
+	return strcmp(key, *(const char *const *)elem);
+}
+
+static int is_keyword(const struct hl_lang *lang, const char *word,
+		      size_t len)
+{
+	char buf[32];
+
+	if (!lang->nr_keywords || len >= sizeof(buf))
+		return 0;
+	memcpy(buf, word, len);
+	buf[len] = '\0';
+	return bsearch(buf, lang->keywords, lang->nr_keywords,
+		       sizeof(*lang->keywords), cmp_keyword) != NULL;
+}
+
+static void add_escaped(struct strbuf *out, const char *s, size_t len)
+{
+	for (; len--; s++) {
+		if (*s == '<')
+			strbuf_addstr(out, "&lt;");
+		else if (*s == '>')
+			strbuf_addstr(out, "&gt;");
+		else if (*s == '&')
+			strbuf_addstr(out, "&amp;");
+		else
+			strbuf_addch(out, *s);
+	}
+}
+
+static void add_token(struct strbuf *out, const char *class, const char *s,
+		      size_t len)
+{
+	strbuf_addf(out, "<span class='hl-%s'>", class);
+	add_escaped(out, s, len);
+	strbuf_addstr(out, "</span>");
+}
+
+static int at(const char *p, const char *end, const char *marker)
+{
+	size_t len = marker ? strlen(marker) : 0;
+
+	return len && (size_t)(end - p) >= len && !memcmp(p, marker, len);
+}
+
+static const char *line_end(const char *p, const char *end)
+{
+	const char *eol = memchr(p, '\n', end - p);
+
+	return eol ? eol : end;
+}
+
+static const char *string_end(const char *p, const char *end)
+{
+	char quote = *p++;
+
+	while (p < end && *p != quote && *p != '\n') {
+		if (*p == '\\' && p + 1 < end)
+			p++;
+		p++;
+	}
+	return p < end && *p == quote ? p + 1 : p;
+}
+
+static void highlight_buffer(const struct hl_lang *lang, const char *p,
+			     const char *end, struct strbuf *out)
+{
+	int line_start = 1;
+
+	while (p < end) {
+		unsigned char c = *p;
+		const char *q;
+
+		if (c == '\n') {
+			strbuf_addch(out, c);
+			line_start = 1;
+			p++;
+			continue;
+		}
+		if (c == ' ' || c == '\t') {
+			strbuf_addch(out, c);
+			p++;
+			continue;
+		}
+		if (line_start && lang->preprocessor && c == '#') {
+			q = line_end(p, end);
+			add_token(out, "cp", p, q - p);
+		} else if (at(p, end, lang->block_open)) {
+			const char *start = p + strlen(lang->block_open);
+
+			q = memmem(start, end - start, lang->block_close,
+				   strlen(lang->block_close));
+			q = q ? q + strlen(lang->block_close) : end;
+			add_token(out, "c", p, q - p);
+		} else if (at(p, end, lang->line_comment)) {
+			q = line_end(p, end);
+			add_token(out, "c", p, q - p);
+		} else if (c && lang->quotes && strchr(lang->quotes, c)) {
+			q = string_end(p, end);
+			add_token(out, "s", p, q - p);
+		} else if (isdigit(c)) {
+			for (q = p; q < end && (isalnum((unsigned char)*q) ||
+						*q == '.' || *q == '_'); q++)
+				;
+			add_token(out, "m", p, q - p);
+		} else if (isalpha(c) || c == '_') {
+			for (q = p; q < end && (isalnum((unsigned char)*q) ||
+						*q == '_'); q++)
+				;
+			if (is_keyword(lang, p, q - p))
+				add_token(out, "k", p, q - p);
+			else
+				strbuf_add(out, p, q - p);
+		} else {
+			q = p + 1;
+			add_escaped(out, p, 1);
+		}
+		line_start = 0;
+		p = q;
+	}
+}
+
+void cgit_highlight(const char *buf, size_t len, const char *filename,
+		    const struct object_id *oid)
+{
+	const struct hl_lang *lang = find_language(filename);
+	struct strbuf out = STRBUF_INIT;
+	struct repo_cache_map map;
+	struct object_id blob;
+	char *name = NULL;
+
+	if (!lang) {
+		html_ntxt(buf, len);
+		return;
+	}
+
+	if (repo_cache_enabled()) {
+		if (!oid) {
+			hash_object_file(the_hash_algo, buf, len, OBJ_BLOB,
+					 &blob);
+			oid = &blob;
+		}
+		name = xstrfmt("highlight/%s.%s", oid_to_hex(oid), lang->name);
+		if (!repo_cache_open(&map, name, HIGHLIGHT_VERSION)) {
+			html_raw(map.buf, map.len);
+			repo_cache_close(&map);
+			free(name);
+			return;
+		}
+	}
+
+	highlight_buffer(lang, buf, buf + len, &out);
+	html_raw(out.buf, out.len);
+	if (name)
+		repo_cache_store_bounded(name, HIGHLIGHT_VERSION, out.buf,
+					 out.len);
+	strbuf_release(&out);
+	free(name);
+}
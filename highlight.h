@@ -0,0 +1,13 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+/*
+ * Syntax highlighting done inside cgit, used by the "builtin:highlight"
+ * source filter. Output is HTML to be placed inside <pre><code>, with
+ * tokens wrapped in <span class='hl-*'> elements. `oid` is the blob the
+ * buffer was read from, or NULL if it has to be hashed to key the cache.
+ */
+extern void cgit_highlight(const char *buf, size_t len, const char *filename,
+			   const struct object_id *oid);
+
+#endif /* HIGHLIGHT_H */
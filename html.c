@@ -10,6 +10,9 @@
 #include "cgit.h"
 #include "html.h"
 #include "url.h"
+#ifdef HAVE_LINUX_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 /* Percent-encoding of each character, except: a-zA-Z0-9!$()*,./:;@- */
 static const char* url_escape_table[256] = {
@@ -79,9 +82,23 @@ char *fmtalloc(const char *format, ...)
 	return strbuf_detach(&sb, NULL);
 }
 
+static struct strbuf *html_capture;
+
+void html_begin_capture(struct strbuf *buf)
+{
+	html_capture = buf;
+}
+
+void html_end_capture(void)
+{
+	html_capture = NULL;
+}
+
 void html_raw(const char *data, size_t size)
 {
-	if (write(STDOUT_FILENO, data, size) != size)
+	if (html_capture)
+		strbuf_add(html_capture, data, size);
+	else if (write(STDOUT_FILENO, data, size) != size)
 		die_errno("write error on html output");
 }
 
@@ -257,6 +274,33 @@ void html_header_arg_in_quotes(const char *txt)
 
 }
 
+void html_json_str(const char *txt)
+{
+	const char *t = txt;
+
+	html("\"");
+	while (t && *t) {
+		unsigned char c = *t;
+		const char *e = NULL;
+		if (c == '\\')
+			e = "\\\\";
+		else if (c == '"')
+			e = "\\\"";
+		if (e || c < 0x20) {
+			html_raw(txt, t - txt);
+			if (e)
+				html(e);
+			else
+				htmlf("\\u%04x", c);
+			txt = t + 1;
+		}
+		t++;
+	}
+	if (t != txt)
+		html(txt);
+	html("\"");
+}
+
 void html_hidden(const char *name, const char *value)
 {
 	html("<input type='hidden' name='");
@@ -329,6 +373,41 @@ int html_include(const char *filename)
 	return 0;
 }
 
+void html_sendfile(int fd, off_t off, off_t size)
+{
+	char buf[8192];
+	ssize_t len;
+
+	if (html_capture) {
+		if (lseek(fd, off, SEEK_SET) != off)
+			return;
+		while (off < size && (len = xread(fd, buf, sizeof(buf))) > 0) {
+			html_raw(buf, len);
+			off += len;
+		}
+		return;
+	}
+#ifdef HAVE_LINUX_SENDFILE
+	while (off < size) {
+		len = sendfile(STDOUT_FILENO, fd, &off, size - off);
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		/* Fall back to read/write on EINVAL or ENOSYS */
+		if (len < 0 && (errno == EINVAL || errno == ENOSYS))
+			break;
+		if (len <= 0)
+			return;
+	}
+#endif
+	if (lseek(fd, off, SEEK_SET) != off)
+		return;
+	while (off < size && (len = xread(fd, buf, sizeof(buf))) > 0) {
+		if (write_in_full(STDOUT_FILENO, buf, len) < 0)
+			return;
+		off += len;
+	}
+}
+
 void http_parse_querystring(const char *txt, void (*fn)(const char *name, const char *value))
 {
 	const char *t = txt;
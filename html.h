@@ -4,6 +4,12 @@
 #include "cgit.h"
 
 extern void html_raw(const char *txt, size_t size);
+
+/* Append html output to `buf` instead of writing it to stdout, until
+ * html_end_capture() is called.
+ */
+extern void html_begin_capture(struct strbuf *buf);
+extern void html_end_capture(void);
 extern void html(const char *txt);
 
 __attribute__((format (printf,1,2)))
@@ -24,6 +30,7 @@ extern void html_attr(const char *txt);
 extern void html_url_path(const char *txt);
 extern void html_url_arg(const char *txt);
 extern void html_header_arg_in_quotes(const char *txt);
+extern void html_json_str(const char *txt);
 extern void html_hidden(const char *name, const char *value);
 extern void html_option(const char *value, const char *text, const char *selected_value);
 extern void html_intoption(int value, const char *text, int selected_value);
@@ -32,6 +39,9 @@ extern void html_link_close(void);
 extern void html_fileperm(unsigned short mode);
 extern int html_include(const char *filename);
 
+/* Write bytes `off` to `size` of `fd`, with sendfile(2) when available. */
+extern void html_sendfile(int fd, off_t off, off_t size);
+
 extern void http_parse_querystring(const char *txt, void (*fn)(const char *name, const char *value));
 
 #endif /* HTML_H */
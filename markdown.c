@@ -0,0 +1,1381 @@
+/* markdown.c: built-in markdown renderer for about pages
+ *
+ * Copyright (C) 2026 Project Tick
+ *
+ * Licensed under GNU General Public License v2
+ *   (see COPYING for full license text)
+ *
+ *
+ * This renders the parts of CommonMark which READMEs actually use: ATX
+ * and setext headings, paragraphs, block quotes, nested lists, fenced
+ * and indented code, thematic breaks, raw HTML, emphasis, code spans,
+ * inline and reference links and images, autolinks, and the tables and
+ * strikethrough of GitHub flavored markdown. It does not try to be a
+ * conforming implementation for the corner cases of the specification.
+ *
+ * Rendered output is stored below index-root, keyed by the blob id of
+ * the file and MARKDOWN_VERSION, so that a README which did not change
+ * is neither parsed nor rendered again.
+ */
+
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "cgit.h"
+#include "markdown.h"
+#include "html.h"
+#include "repo-cache.h"
+#include "object-file.h"
+
+/* Bump whenever the generated markup changes. */
+#define MARKDOWN_VERSION "markdown 1"
+
+/* Nesting of block quotes, lists, emphasis and links rendered as such. */
+#define MARKDOWN_MAX_DEPTH 32
+
+/*
+ * Closing delimiters of inline constructs are only looked for this far,
+ * which keeps rendering linear for paragraphs full of unmatched ones.
+ */
+#define MARKDOWN_MAX_SPAN 1024
+
+struct md_line {
+	const char *buf;
+	size_t len;
+};
+
+struct md_lines {
+	struct md_line *items;
+	size_t nr, alloc;
+};
+
+struct md_fence {
+	char ch;
+	size_t len;
+	size_t indent;
+};
+
+struct md_marker {
+	int ordered;
+	char ch;		/* bullet, or delimiter of ordered items */
+	int start;
+	size_t width;		/* columns up to the content of the item */
+	struct md_line content;	/* first line of the item */
+};
+
+struct md_ref {
+	char *url;
+	char *title;
+};
+
+struct md_render {
+	struct strbuf *out;
+	struct string_list refs;
+	int depth;
+};
+
+static void render_blocks(struct md_render *r, struct md_line *lines,
+			  size_t nr, int tight);
+static void render_inline(struct md_render *r, const char *s, size_t len);
+
+static void add_line(struct md_lines *lines, struct md_line line)
+{
+	ALLOC_GROW(lines->items, lines->nr + 1, lines->alloc);
+	lines->items[lines->nr++] = line;
+}
+
+static void add_escaped(struct strbuf *out, const char *s, size_t len)
+{
+	for (; len--; s++) {
+		if (*s == '<')
+			strbuf_addstr(out, "&lt;");
+		else if (*s == '>')
+			strbuf_addstr(out, "&gt;");
+		else if (*s == '&')
+			strbuf_addstr(out, "&amp;");
+		else if (*s == '"')
+			strbuf_addstr(out, "&quot;");
+		else if (*s == '\'')
+			strbuf_addstr(out, "&#39;");
+		else
+			strbuf_addch(out, *s);
+	}
+}
+
+/* Escape `s` for an attribute, dropping backslashes of escaped punctuation. */
+static void add_unescaped(struct strbuf *out, const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] == '\\' && i + 1 < len && ispunct(s[i + 1]))
+			i++;
+		add_escaped(out, s + i, 1);
+	}
+}
+
+static int is_blank(const struct md_line *line)
+{
+	size_t i;
+
+	for (i = 0; i < line->len; i++)
+		if (!isspace(line->buf[i]))
+			return 0;
+	return 1;
+}
+
+/* Columns of leading whitespace, with tab stops every four columns. */
+static size_t indent_of(const struct md_line *line)
+{
+	size_t i, col = 0;
+
+	for (i = 0; i < line->len; i++) {
+		if (line->buf[i] == ' ')
+			col++;
+		else if (line->buf[i] == '\t')
+			col += 4 - col % 4;
+		else
+			break;
+	}
+	return col;
+}
+
+/* Remove up to `cols` columns of leading whitespace. */
+static struct md_line strip_indent(struct md_line line, size_t cols)
+{
+	size_t col = 0;
+
+	while (line.len && col < cols) {
+		if (*line.buf == ' ')
+			col++;
+		else if (*line.buf == '\t')
+			col += 4 - col % 4;
+		else
+			break;
+		line.buf++;
+		line.len--;
+	}
+	return line;
+}
+
+static struct md_line trim(struct md_line line)
+{
+	while (line.len && isspace(*line.buf)) {
+		line.buf++;
+		line.len--;
+	}
+	while (line.len && isspace(line.buf[line.len - 1]))
+		line.len--;
+	return line;
+}
+
+static size_t skip_ws(const char *s, size_t len, size_t i)
+{
+	while (i < len && isspace(s[i]))
+		i++;
+	return i;
+}
+
+static size_t run_length(const char *s, size_t len, size_t i)
+{
+	size_t n = i;
+
+	while (n < len && s[n] == s[i])
+		n++;
+	return n - i;
+}
+
+static int atx_heading(struct md_line line, struct md_line *text)
+{
+	size_t level = 0, end;
+
+	if (indent_of(&line) > 3)
+		return 0;
+	line = strip_indent(line, 3);
+	while (level < line.len && line.buf[level] == '#')
+		level++;
+	if (!level || level > 6 ||
+	    (level < line.len && !isspace(line.buf[level])))
+		return 0;
+
+	text->buf = line.buf + level;
+	text->len = line.len - level;
+	*text = trim(*text);
+
+	/* drop an optional closing sequence of '#' */
+	for (end = text->len; end && text->buf[end - 1] == '#'; end--)
+		;
+	if (!end || isspace(text->buf[end - 1])) {
+		text->len = end;
+		*text = trim(*text);
+	}
+	return level;
+}
+
+static int is_hr(struct md_line line)
+{
+	size_t i, n = 0;
+	char c = 0;
+
+	if (indent_of(&line) > 3)
+		return 0;
+	for (i = 0; i < line.len; i++) {
+		char ch = line.buf[i];
+
+		if (isspace(ch))
+			continue;
+		if ((ch != '-' && ch != '*' && ch != '_') || (c && ch != c))
+			return 0;
+		c = ch;
+		n++;
+	}
+	return n >= 3;
+}
+
+static int setext_level(struct md_line line)
+{
+	size_t i;
+
+	if (indent_of(&line) > 3)
+		return 0;
+	line = trim(line);
+	if (!line.len || (line.buf[0] != '=' && line.buf[0] != '-'))
+		return 0;
+	for (i = 1; i < line.len; i++)
+		if (line.buf[i] != line.buf[0])
+			return 0;
+	return line.buf[0] == '=' ? 1 : 2;
+}
+
+static int fence_open(struct md_line line, struct md_fence *fence,
+		      struct md_line *info)
+{
+	size_t n;
+
+	fence->indent = indent_of(&line);
+	if (fence->indent > 3)
+		return 0;
+	line = strip_indent(line, 3);
+	if (!line.len || (line.buf[0] != '`' && line.buf[0] != '~'))
+		return 0;
+	n = run_length(line.buf, line.len, 0);
+	if (n < 3)
+		return 0;
+
+	info->buf = line.buf + n;
+	info->len = line.len - n;
+	*info = trim(*info);
+	if (line.buf[0] == '`' && memchr(info->buf, '`', info->len))
+		return 0;
+	fence->ch = line.buf[0];
+	fence->len = n;
+	return 1;
+}
+
+static int fence_close(struct md_line line, const struct md_fence *fence)
+{
+	size_t n;
+
+	if (indent_of(&line) > 3)
+		return 0;
+	line = trim(line);
+	if (!line.len || line.buf[0] != fence->ch)
+		return 0;
+	n = run_length(line.buf, line.len, 0);
+	return n >= fence->len && n == line.len;
+}
+
+static int list_marker(struct md_line line, struct md_marker *marker)
+{
+	size_t indent = indent_of(&line), i = 0, spaces;
+	struct md_line rest;
+
+	if (indent > 3)
+		return 0;
+	line = strip_indent(line, 3);
+	if (line.len && (line.buf[0] == '-' || line.buf[0] == '+' ||
+			 line.buf[0] == '*')) {
+		marker->ordered = 0;
+		marker->ch = line.buf[i++];
+		marker->start = 0;
+	} else {
+		int start = 0;
+
+		while (i < line.len && i < 9 && isdigit(line.buf[i]))
+			start = start * 10 + line.buf[i++] - '0';
+		if (!i || i >= line.len ||
+		    (line.buf[i] != '.' && line.buf[i] != ')'))
+			return 0;
+		marker->ordered = 1;
+		marker->ch = line.buf[i++];
+		marker->start = start;
+	}
+
+	rest.buf = line.buf + i;
+	rest.len = line.len - i;
+	if (rest.len && !isspace(rest.buf[0]))
+		return 0;
+	spaces = indent_of(&rest);
+	if (is_blank(&rest) || spaces > 4)
+		spaces = 1;
+	marker->content = strip_indent(rest, spaces);
+	marker->width = indent + i + spaces;
+	return 1;
+}
+
+static int is_quote(struct md_line line)
+{
+	if (indent_of(&line) > 3)
+		return 0;
+	line = strip_indent(line, 3);
+	return line.len && line.buf[0] == '>';
+}
+
+static struct md_line quote_content(struct md_line line)
+{
+	line = strip_indent(line, 3);
+	line.buf++;
+	line.len--;
+	return strip_indent(line, 1);
+}
+
+static int is_html_block(struct md_line line)
+{
+	size_t i = 1;
+
+	if (indent_of(&line) > 3)
+		return 0;
+	line = strip_indent(line, 3);
+	if (line.len < 2 || line.buf[0] != '<')
+		return 0;
+	if (line.buf[1] == '/' || line.buf[1] == '!' || line.buf[1] == '?')
+		return 1;
+
+	/* "<scheme:..." and "<user@host>" are autolinks, not tags */
+	while (i < line.len && (isalnum(line.buf[i]) || line.buf[i] == '-'))
+		i++;
+	return i > 1 && isalpha(line.buf[1]) &&
+	       (i == line.len || line.buf[i] == '>' || line.buf[i] == '/' ||
+		isspace(line.buf[i]));
+}
+
+static int interrupts_paragraph(struct md_line line)
+{
+	struct md_line text;
+	struct md_fence fence;
+	struct md_marker marker;
+
+	if (atx_heading(line, &text) || is_hr(line) ||
+	    fence_open(line, &fence, &text) || is_quote(line))
+		return 1;
+	return list_marker(line, &marker) && !is_blank(&marker.content) &&
+	       (!marker.ordered || marker.start == 1);
+}
+
+static size_t parse_dest(const char *s, size_t len, struct md_line *dest)
+{
+	size_t i = 0;
+	int depth = 0;
+
+	if (len && s[0] == '<') {
+		for (i = 1; i < len && s[i] != '>' && s[i] != '<' &&
+			    s[i] != '\n'; i++)
+			if (s[i] == '\\' && i + 1 < len)
+				i++;
+		if (i >= len || s[i] != '>')
+			return 0;
+		dest->buf = s + 1;
+		dest->len = i - 1;
+		return i + 1;
+	}
+
+	for (; i < len; i++) {
+		if (s[i] == '\\' && i + 1 < len) {
+			i++;
+			continue;
+		}
+		if (isspace(s[i]) || iscntrl(s[i]))
+			break;
+		if (s[i] == '(') {
+			depth++;
+		} else if (s[i] == ')') {
+			if (!depth)
+				break;
+			depth--;
+		}
+	}
+	if (!i || depth)
+		return 0;
+	dest->buf = s;
+	dest->len = i;
+	return i;
+}
+
+static size_t parse_title(const char *s, size_t len, struct md_line *title)
+{
+	size_t i;
+	char close;
+
+	if (!len)
+		return 0;
+	close = s[0] == '(' ? ')' : s[0];
+	if (close != '"' && close != '\'' && close != ')')
+		return 0;
+	for (i = 1; i < len && s[i] != close; i++)
+		if (s[i] == '\\' && i + 1 < len)
+			i++;
+	if (i >= len)
+		return 0;
+	title->buf = s + 1;
+	title->len = i - 1;
+	return i + 1;
+}
+
+/* Parse "[label]: url 'title'", which must fit on a single line. */
+static int parse_ref_def(struct md_line line, struct md_line *label,
+			 struct md_line *url, struct md_line *title)
+{
+	size_t i, j, n;
+
+	if (indent_of(&line) > 3)
+		return 0;
+	line = trim(line);
+	if (line.len < 4 || line.buf[0] != '[')
+		return 0;
+	for (i = 1; i < line.len && line.buf[i] != ']'; i++) {
+		if (line.buf[i] == '[')
+			return 0;
+		if (line.buf[i] == '\\')
+			i++;
+	}
+	if (i == 1 || i + 1 >= line.len || line.buf[i + 1] != ':')
+		return 0;
+	label->buf = line.buf + 1;
+	label->len = i - 1;
+
+	i = skip_ws(line.buf, line.len, i + 2);
+	n = parse_dest(line.buf + i, line.len - i, url);
+	if (!n)
+		return 0;
+	i += n;
+
+	title->buf = NULL;
+	title->len = 0;
+	j = skip_ws(line.buf, line.len, i);
+	if (j > i && j < line.len) {
+		n = parse_title(line.buf + j, line.len - j, title);
+		if (!n)
+			return 0;
+		i = j + n;
+	}
+	return skip_ws(line.buf, line.len, i) == line.len;
+}
+
+static void normalize_label(struct strbuf *sb, const char *s, size_t len)
+{
+	int space = 0;
+
+	strbuf_reset(sb);
+	for (; len--; s++) {
+		if (isspace(*s)) {
+			space = sb->len > 0;
+			continue;
+		}
+		if (space)
+			strbuf_addch(sb, ' ');
+		space = 0;
+		strbuf_addch(sb, tolower(*s));
+	}
+}
+
+static void collect_refs(struct md_render *r, struct md_line *lines,
+			 size_t nr)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct md_line label, url, title;
+	struct md_fence fence;
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		struct md_ref *ref;
+
+		if (fence_open(lines[i], &fence, &label)) {
+			while (++i < nr && !fence_close(lines[i], &fence))
+				;
+			continue;
+		}
+		if (!parse_ref_def(lines[i], &label, &url, &title))
+			continue;
+		normalize_label(&key, label.buf, label.len);
+		if (!key.len || string_list_lookup(&r->refs, key.buf))
+			continue;
+
+		CALLOC_ARRAY(ref, 1);
+		ref->url = xmemdupz(url.buf, url.len);
+		if (title.len)
+			ref->title = xmemdupz(title.buf, title.len);
+		string_list_insert(&r->refs, key.buf)->util = ref;
+	}
+	strbuf_release(&key);
+}
+
+static void free_refs(struct md_render *r)
+{
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, &r->refs) {
+		struct md_ref *ref = item->util;
+
+		free(ref->url);
+		free(ref->title);
+		free(ref);
+	}
+	string_list_clear(&r->refs, 0);
+}
+
+static void emit_link(struct md_render *r, int image,
+		      const char *text, size_t text_len,
+		      const char *url, size_t url_len,
+		      const char *title, size_t title_len)
+{
+	struct strbuf *out = r->out;
+
+	strbuf_addstr(out, image ? "<img src='" : "<a href='");
+	add_unescaped(out, url, url_len);
+	strbuf_addch(out, '\'');
+	if (image) {
+		strbuf_addstr(out, " alt='");
+		add_unescaped(out, text, text_len);
+		strbuf_addch(out, '\'');
+	}
+	if (title_len) {
+		strbuf_addstr(out, " title='");
+		add_unescaped(out, title, title_len);
+		strbuf_addch(out, '\'');
+	}
+	if (image) {
+		strbuf_addstr(out, " />");
+		return;
+	}
+	strbuf_addch(out, '>');
+	render_inline(r, text, text_len);
+	strbuf_addstr(out, "</a>");
+}
+
+/* Link a URL which is also the text of the link. */
+static void emit_url(struct md_render *r, const char *prefix,
+		     const char *url, size_t len)
+{
+	strbuf_addstr(r->out, "<a href='");
+	strbuf_addstr(r->out, prefix);
+	add_escaped(r->out, url, len);
+	strbuf_addstr(r->out, "'>");
+	add_escaped(r->out, url, len);
+	strbuf_addstr(r->out, "</a>");
+}
+
+static size_t inline_escape(struct md_render *r, const char *s, size_t len,
+			    size_t i)
+{
+	if (i + 1 >= len)
+		return 0;
+	if (s[i + 1] == '\n') {
+		strbuf_addstr(r->out, "<br />\n");
+		return 2;
+	}
+	if (!ispunct(s[i + 1]))
+		return 0;
+	add_escaped(r->out, s + i + 1, 1);
+	return 2;
+}
+
+static size_t inline_code(struct md_render *r, const char *s, size_t len,
+			  size_t i)
+{
+	size_t n = run_length(s, len, i), j, m, start, end, k;
+
+	for (j = i + n; j < len; j += m) {
+		m = s[j] == '`' ? run_length(s, len, j) : 1;
+		if (s[j] != '`' || m != n)
+			continue;
+
+		start = i + n;
+		end = j;
+		if (end - start >= 2 && s[start] == ' ' && s[end - 1] == ' ' &&
+		    run_length(s, end, start) < end - start) {
+			start++;
+			end--;
+		}
+		strbuf_addstr(r->out, "<code>");
+		for (k = start; k < end; k++) {
+			if (s[k] == '\n')
+				strbuf_addch(r->out, ' ');
+			else
+				add_escaped(r->out, s + k, 1);
+		}
+		strbuf_addstr(r->out, "</code>");
+		return j + n - i;
+	}
+
+	/* an unmatched run is literal text as a whole */
+	strbuf_add(r->out, s + i, n);
+	return n;
+}
+
+static size_t inline_emphasis(struct md_render *r, const char *s,
+			      size_t len, size_t i)
+{
+	size_t n = run_length(s, len, i), use, j, m;
+	const char *tag;
+	char c = s[i];
+
+	if (c == '~') {
+		if (n != 2)
+			return 0;
+		use = 2;
+		tag = "del";
+	} else {
+		use = n >= 2 ? 2 : 1;
+		tag = use == 2 ? "strong" : "em";
+	}
+	if (i + n >= len || isspace(s[i + n]))
+		return 0;
+	if (c == '_' && i && isalnum(s[i - 1]))
+		return 0;
+
+	for (j = i + use + 1; j < len; j += m) {
+		m = 1;
+		if (s[j] == '\\') {
+			m = 2;
+			continue;
+		}
+		if (s[j] != c)
+			continue;
+		m = run_length(s, len, j);
+		if (isspace(s[j - 1]) || m < use || (use == 1 && m == 2) ||
+		    (c == '~' && m != 2) ||
+		    (c == '_' && j + m < len && isalnum(s[j + m])))
+			continue;
+
+		strbuf_addf(r->out, "<%s>", tag);
+		render_inline(r, s + i + use, j + m - use - (i + use));
+		strbuf_addf(r->out, "</%s>", tag);
+		return j + m - i;
+	}
+	return 0;
+}
+
+static size_t inline_link(struct md_render *r, const char *s, size_t len,
+			  size_t i)
+{
+	int image = s[i] == '!';
+	size_t open = i + image, close, j, k, end;
+	struct md_line dest, title = { NULL, 0 };
+	struct strbuf key = STRBUF_INIT;
+	const char *label;
+	size_t label_len;
+	struct string_list_item *item;
+	int depth = 0;
+
+	if (open >= len || s[open] != '[')
+		return 0;
+	for (close = open + 1; close < len; close++) {
+		if (s[close] == '\\') {
+			close++;
+		} else if (s[close] == '[') {
+			depth++;
+		} else if (s[close] == ']') {
+			if (!depth)
+				break;
+			depth--;
+		}
+	}
+	if (close >= len)
+		return 0;
+	j = close + 1;
+
+	/* inline link: [text](url "title") */
+	if (j < len && s[j] == '(') {
+		k = skip_ws(s, len, j + 1);
+		dest.buf = s + k;
+		dest.len = 0;
+		if (k < len && s[k] != ')')
+			k += parse_dest(s + k, len - k, &dest);
+		end = skip_ws(s, len, k);
+		if (end > k && end < len && s[end] != ')') {
+			size_t n = parse_title(s + end, len - end, &title);
+
+			end = n ? skip_ws(s, len, end + n) : len;
+		}
+		if (end < len && s[end] == ')') {
+			emit_link(r, image, s + open + 1, close - open - 1,
+				  dest.buf, dest.len, title.buf, title.len);
+			return end + 1 - i;
+		}
+	}
+
+	/* references: [text][label], [text][] and [text] */
+	label = s + open + 1;
+	label_len = close - open - 1;
+	end = j;
+	if (j < len && s[j] == '[') {
+		for (k = j + 1; k < len && s[k] != ']' && s[k] != '['; k++)
+			;
+		if (k < len && s[k] == ']') {
+			if (k > j + 1) {
+				label = s + j + 1;
+				label_len = k - j - 1;
+			}
+			end = k + 1;
+		}
+	}
+	normalize_label(&key, label, label_len);
+	item = string_list_lookup(&r->refs, key.buf);
+	strbuf_release(&key);
+	if (!item)
+		return 0;
+
+	{
+		struct md_ref *ref = item->util;
+
+		emit_link(r, image, s + open + 1, close - open - 1,
+			  ref->url, strlen(ref->url),
+			  ref->title, ref->title ? strlen(ref->title) : 0);
+	}
+	return end - i;
+}
+
+static size_t inline_angle(struct md_render *r, const char *s, size_t len,
+			   size_t i)
+{
+	const char *p = s + i + 1, *gt;
+	size_t j, n;
+
+	/* autolinks: <scheme:...> and <user@host> */
+	for (j = i + 1; j < len && s[j] != '>' && s[j] != '<' &&
+		    !isspace(s[j]); j++)
+		;
+	n = j - i - 1;
+	if (j < len && s[j] == '>' && n) {
+		const char *colon = memchr(p, ':', n);
+		size_t k = 0;
+
+		if (colon) {
+			while (p + k < colon && (isalnum(p[k]) || p[k] == '+' ||
+						 p[k] == '.' || p[k] == '-'))
+				k++;
+			if (p + k == colon && k >= 2 && isalpha(p[0])) {
+				emit_url(r, "", p, n);
+				return n + 2;
+			}
+		} else if (memchr(p, '@', n) && p[0] != '@' && p[n - 1] != '@') {
+			emit_url(r, "mailto:", p, n);
+			return n + 2;
+		}
+	}
+
+	/* raw HTML tags are passed on as they are */
+	if (i + 1 < len && (isalpha(s[i + 1]) || s[i + 1] == '/' ||
+			    s[i + 1] == '!' || s[i + 1] == '?')) {
+		gt = memchr(s + i, '>', len - i);
+		if (gt) {
+			strbuf_add(r->out, s + i, gt + 1 - (s + i));
+			return gt + 1 - (s + i);
+		}
+	}
+	return 0;
+}
+
+static size_t inline_entity(struct md_render *r, const char *s, size_t len,
+			    size_t i)
+{
+	size_t j = i + 1;
+
+	if (j < len && s[j] == '#')
+		j++;
+	while (j < len && j - i <= 32 && isalnum(s[j]))
+		j++;
+	if (j >= len || s[j] != ';' || !isalnum(s[j - 1]))
+		return 0;
+	strbuf_add(r->out, s + i, j + 1 - i);
+	return j + 1 - i;
+}
+
+static size_t inline_url(struct md_render *r, const char *s, size_t len,
+			 size_t i)
+{
+	size_t j, scheme;
+
+	if (i && isalnum(s[i - 1]))
+		return 0;
+	if (len - i > 8 && !strncmp(s + i, "https://", 8))
+		scheme = 8;
+	else if (len - i > 7 && !strncmp(s + i, "http://", 7))
+		scheme = 7;
+	else
+		return 0;
+
+	for (j = i + scheme; j < len && !isspace(s[j]) && s[j] != '<'; j++)
+		;
+	while (j > i + scheme && s[j - 1] && strchr(".,:;!?\"')*_~", s[j - 1]))
+		j--;
+	if (j == i + scheme)
+		return 0;
+	emit_url(r, "", s + i, j - i);
+	return j - i;
+}
+
+static void render_inline(struct md_render *r, const char *s, size_t len)
+{
+	size_t i = 0, text = 0, n, span;
+
+	if (r->depth >= MARKDOWN_MAX_DEPTH) {
+		add_escaped(r->out, s, len);
+		return;
+	}
+	r->depth++;
+	while (i < len) {
+		switch (s[i]) {
+		case '\\':
+		case '`':
+		case '*':
+		case '_':
+		case '~':
+		case '!':
+		case '[':
+		case '<':
+		case '&':
+		case 'h':
+			break;
+		default:
+			i++;
+			continue;
+		}
+
+		add_escaped(r->out, s + text, i - text);
+		span = len - i > MARKDOWN_MAX_SPAN ? i + MARKDOWN_MAX_SPAN : len;
+		switch (s[i]) {
+		case '\\':
+			n = inline_escape(r, s, span, i);
+			break;
+		case '`':
+			n = inline_code(r, s, span, i);
+			break;
+		case '!':
+		case '[':
+			n = inline_link(r, s, span, i);
+			break;
+		case '<':
+			n = inline_angle(r, s, span, i);
+			break;
+		case '&':
+			n = inline_entity(r, s, span, i);
+			break;
+		case 'h':
+			n = inline_url(r, s, span, i);
+			break;
+		default:
+			n = inline_emphasis(r, s, span, i);
+			break;
+		}
+		text = i;
+		if (n)
+			text = i += n;
+		else
+			i++;
+	}
+	add_escaped(r->out, s + text, len - text);
+	r->depth--;
+}
+
+static void render_heading(struct md_render *r, int level,
+			   const char *s, size_t len)
+{
+	size_t i;
+
+	strbuf_addf(r->out, "<h%d id='", level);
+	for (i = 0; i < len; i++) {
+		unsigned char c = s[i];
+
+		if (isalnum(c) || c == '_' || c >= 0x80)
+			strbuf_addch(r->out, tolower(c));
+		else if (c == ' ' || c == '-')
+			strbuf_addch(r->out, '-');
+	}
+	strbuf_addstr(r->out, "'>");
+	render_inline(r, s, len);
+	strbuf_addf(r->out, "</h%d>\n", level);
+}
+
+static size_t render_paragraph(struct md_render *r, struct md_line *lines,
+			       size_t nr, size_t i, int tight)
+{
+	struct strbuf text = STRBUF_INIT;
+	size_t start = i, end, k;
+	int level = 0;
+
+	for (i++; i < nr; i++) {
+		if (is_blank(&lines[i]))
+			break;
+		if ((level = setext_level(lines[i])))
+			break;
+		if (interrupts_paragraph(lines[i]))
+			break;
+	}
+	end = i;
+	if (level)
+		i++;
+
+	for (k = start; k < end; k++) {
+		struct md_line line = strip_indent(lines[k], SIZE_MAX);
+		size_t len = line.len;
+
+		while (len && isspace(line.buf[len - 1]))
+			len--;
+		strbuf_add(&text, line.buf, len);
+		if (k + 1 == end)
+			break;
+		/* two trailing spaces are a hard line break, like a backslash */
+		if (line.len - len >= 2 && line.buf[len] == ' ')
+			strbuf_addch(&text, '\\');
+		strbuf_addch(&text, '\n');
+	}
+
+	if (level) {
+		render_heading(r, level, text.buf, text.len);
+	} else if (tight) {
+		render_inline(r, text.buf, text.len);
+		strbuf_addch(r->out, '\n');
+	} else {
+		strbuf_addstr(r->out, "<p>");
+		render_inline(r, text.buf, text.len);
+		strbuf_addstr(r->out, "</p>\n");
+	}
+	strbuf_release(&text);
+	return i;
+}
+
+static size_t render_indented_code(struct md_render *r,
+				   struct md_line *lines, size_t nr, size_t i)
+{
+	size_t end = i, k;
+
+	for (k = i; k < nr; k++) {
+		if (is_blank(&lines[k]))
+			continue;
+		if (indent_of(&lines[k]) < 4)
+			break;
+		end = k + 1;
+	}
+
+	strbuf_addstr(r->out, "<pre><code>");
+	for (k = i; k < end; k++) {
+		struct md_line line = strip_indent(lines[k], 4);
+
+		add_escaped(r->out, line.buf, line.len);
+		strbuf_addch(r->out, '\n');
+	}
+	strbuf_addstr(r->out, "</code></pre>\n");
+	return end;
+}
+
+static size_t render_fenced_code(struct md_render *r, struct md_line *lines,
+				 size_t nr, size_t i,
+				 const struct md_fence *fence,
+				 struct md_line info)
+{
+	strbuf_addstr(r->out, "<pre><code");
+	if (info.len) {
+		size_t n = 0;
+
+		while (n < info.len && !isspace(info.buf[n]))
+			n++;
+		strbuf_addstr(r->out, " class='language-");
+		add_unescaped(r->out, info.buf, n);
+		strbuf_addch(r->out, '\'');
+	}
+	strbuf_addch(r->out, '>');
+
+	for (i++; i < nr && !fence_close(lines[i], fence); i++) {
+		struct md_line line = strip_indent(lines[i], fence->indent);
+
+		add_escaped(r->out, line.buf, line.len);
+		strbuf_addch(r->out, '\n');
+	}
+	strbuf_addstr(r->out, "</code></pre>\n");
+	return i < nr ? i + 1 : i;
+}
+
+static size_t render_html(struct md_render *r, struct md_line *lines,
+			  size_t nr, size_t i)
+{
+	struct md_line first = trim(lines[i]);
+	int comment = first.len >= 4 && !strncmp(first.buf, "<!--", 4);
+
+	for (; i < nr; i++) {
+		if (!comment && is_blank(&lines[i]))
+			break;
+		strbuf_add(r->out, lines[i].buf, lines[i].len);
+		strbuf_addch(r->out, '\n');
+		if (comment && memmem(lines[i].buf, lines[i].len, "-->", 3)) {
+			i++;
+			break;
+		}
+	}
+	return i;
+}
+
+static size_t render_quote(struct md_render *r, struct md_line *lines,
+			   size_t nr, size_t i)
+{
+	struct md_lines inner = { NULL, 0, 0 };
+	int lazy = 0;
+
+	for (; i < nr; i++) {
+		if (is_quote(lines[i])) {
+			struct md_line line = quote_content(lines[i]);
+
+			add_line(&inner, line);
+			lazy = !is_blank(&line);
+		} else if (lazy && !is_blank(&lines[i]) &&
+			   !interrupts_paragraph(lines[i])) {
+			add_line(&inner, lines[i]);
+		} else {
+			break;
+		}
+	}
+
+	strbuf_addstr(r->out, "<blockquote>\n");
+	render_blocks(r, inner.items, inner.nr, 0);
+	strbuf_addstr(r->out, "</blockquote>\n");
+	free(inner.items);
+	return i;
+}
+
+static size_t render_list(struct md_render *r, struct md_line *lines,
+			  size_t nr, size_t i, const struct md_marker *first)
+{
+	struct md_marker marker = *first, next;
+	struct md_lines *items = NULL;
+	size_t nr_items = 0, alloc = 0, k;
+	int loose = 0, blank = 0;
+
+	while (i < nr) {
+		struct md_lines *item;
+
+		ALLOC_GROW(items, nr_items + 1, alloc);
+		item = &items[nr_items++];
+		memset(item, 0, sizeof(*item));
+		add_line(item, marker.content);
+		blank = 0;
+
+		for (i++; i < nr; i++) {
+			struct md_line *line = &lines[i];
+
+			if (is_blank(line)) {
+				add_line(item, *line);
+				blank = 1;
+			} else if (indent_of(line) >= marker.width) {
+				if (blank)
+					loose = 1;
+				add_line(item, strip_indent(*line, marker.width));
+				blank = 0;
+			} else if (!blank && !list_marker(*line, &next) &&
+				   !interrupts_paragraph(*line)) {
+				/* lazy continuation of a paragraph */
+				add_line(item, *line);
+			} else {
+				break;
+			}
+		}
+		while (item->nr && is_blank(&item->items[item->nr - 1]))
+			item->nr--;
+
+		if (i < nr && list_marker(lines[i], &next) &&
+		    next.ordered == marker.ordered && next.ch == marker.ch &&
+		    !is_hr(lines[i])) {
+			if (blank)
+				loose = 1;
+			marker = next;
+			continue;
+		}
+		break;
+	}
+
+	if (!first->ordered)
+		strbuf_addstr(r->out, "<ul>\n");
+	else if (first->start != 1)
+		strbuf_addf(r->out, "<ol start='%d'>\n", first->start);
+	else
+		strbuf_addstr(r->out, "<ol>\n");
+	for (k = 0; k < nr_items; k++) {
+		strbuf_addstr(r->out, "<li>");
+		render_blocks(r, items[k].items, items[k].nr, !loose);
+		strbuf_addstr(r->out, "</li>\n");
+		free(items[k].items);
+	}
+	strbuf_addstr(r->out, first->ordered ? "</ol>\n" : "</ul>\n");
+	free(items);
+	return i;
+}
+
+static void split_row(struct md_line line, struct md_lines *cells)
+{
+	size_t i, start;
+
+	cells->nr = 0;
+	line = trim(line);
+	if (line.len && line.buf[0] == '|') {
+		line.buf++;
+		line.len--;
+	}
+	if (line.len && line.buf[line.len - 1] == '|' &&
+	    (line.len < 2 || line.buf[line.len - 2] != '\\'))
+		line.len--;
+
+	for (i = start = 0; i <= line.len; i++) {
+		struct md_line cell;
+
+		if (i < line.len && line.buf[i] == '\\') {
+			i++;
+			continue;
+		}
+		if (i < line.len && line.buf[i] != '|')
+			continue;
+		cell.buf = line.buf + start;
+		cell.len = i - start;
+		add_line(cells, trim(cell));
+		start = i + 1;
+	}
+}
+
+static const char *cell_align(const struct md_line *cell)
+{
+	int left = cell->buf[0] == ':';
+	int right = cell->buf[cell->len - 1] == ':';
+
+	if (left && right)
+		return "center";
+	if (right)
+		return "right";
+	if (left)
+		return "left";
+	return NULL;
+}
+
+static int is_delimiter_row(struct md_line line, struct md_lines *cells)
+{
+	size_t i, k;
+
+	if (!memchr(line.buf, '-', line.len) || indent_of(&line) > 3)
+		return 0;
+	split_row(line, cells);
+	for (k = 0; k < cells->nr; k++) {
+		struct md_line *cell = &cells->items[k];
+		int dashes = 0;
+
+		if (!cell->len)
+			return 0;
+		for (i = 0; i < cell->len; i++) {
+			if (cell->buf[i] == '-')
+				dashes = 1;
+			else if (cell->buf[i] != ':' ||
+				 (i && i + 1 != cell->len))
+				return 0;
+		}
+		if (!dashes)
+			return 0;
+	}
+	return 1;
+}
+
+static void render_row(struct md_render *r, const char *tag,
+		       const struct md_lines *cells,
+		       const struct md_lines *delim)
+{
+	size_t k;
+
+	strbuf_addstr(r->out, "<tr>\n");
+	for (k = 0; k < delim->nr; k++) {
+		const char *align = cell_align(&delim->items[k]);
+
+		strbuf_addf(r->out, "<%s", tag);
+		if (align)
+			strbuf_addf(r->out, " style='text-align: %s'", align);
+		strbuf_addch(r->out, '>');
+		if (k < cells->nr)
+			render_inline(r, cells->items[k].buf,
+				      cells->items[k].len);
+		strbuf_addf(r->out, "</%s>\n", tag);
+	}
+	strbuf_addstr(r->out, "</tr>\n");
+}
+
+/* Render a table starting at line `i`, or return `i` if there is none. */
+static size_t render_table(struct md_render *r, struct md_line *lines,
+			   size_t nr, size_t i)
+{
+	struct md_lines head = { NULL, 0, 0 }, delim = { NULL, 0, 0 };
+	struct md_lines cells = { NULL, 0, 0 };
+
+	if (i + 1 >= nr || !memchr(lines[i].buf, '|', lines[i].len) ||
+	    !is_delimiter_row(lines[i + 1], &delim))
+		goto out;
+	split_row(lines[i], &head);
+	if (head.nr != delim.nr)
+		goto out;
+
+	strbuf_addstr(r->out, "<table>\n<thead>\n");
+	render_row(r, "th", &head, &delim);
+	strbuf_addstr(r->out, "</thead>\n<tbody>\n");
+	for (i += 2; i < nr; i++) {
+		if (is_blank(&lines[i]) || interrupts_paragraph(lines[i]))
+			break;
+		split_row(lines[i], &cells);
+		render_row(r, "td", &cells, &delim);
+	}
+	strbuf_addstr(r->out, "</tbody>\n</table>\n");
+
+out:
+	free(head.items);
+	free(delim.items);
+	free(cells.items);
+	return i;
+}
+
+static void render_blocks(struct md_render *r, struct md_line *lines,
+			  size_t nr, int tight)
+{
+	size_t i = 0, next;
+
+	if (r->depth >= MARKDOWN_MAX_DEPTH) {
+		for (; i < nr; i++) {
+			add_escaped(r->out, lines[i].buf, lines[i].len);
+			strbuf_addch(r->out, '\n');
+		}
+		return;
+	}
+
+	r->depth++;
+	while (i < nr) {
+		struct md_line *line = &lines[i], text, url, title;
+		struct md_fence fence;
+		struct md_marker marker;
+		int level;
+
+		if (is_blank(line)) {
+			i++;
+		} else if (indent_of(line) >= 4) {
+			i = render_indented_code(r, lines, nr, i);
+		} else if (fence_open(*line, &fence, &text)) {
+			i = render_fenced_code(r, lines, nr, i, &fence, text);
+		} else if ((level = atx_heading(*line, &text))) {
+			render_heading(r, level, text.buf, text.len);
+			i++;
+		} else if (is_hr(*line)) {
+			strbuf_addstr(r->out, "<hr />\n");
+			i++;
+		} else if (is_quote(*line)) {
+			i = render_quote(r, lines, nr, i);
+		} else if (list_marker(*line, &marker)) {
+			i = render_list(r, lines, nr, i, &marker);
+		} else if (is_html_block(*line)) {
+			i = render_html(r, lines, nr, i);
+		} else if (parse_ref_def(*line, &text, &url, &title)) {
+			i++;
+		} else if ((next = render_table(r, lines, nr, i)) != i) {
+			i = next;
+		} else {
+			i = render_paragraph(r, lines, nr, i, tight);
+		}
+	}
+	r->depth--;
+}
+
+static void render_markdown(const char *buf, size_t len, struct strbuf *out)
+{
+	struct md_render r = { out, STRING_LIST_INIT_DUP, 0 };
+	struct md_lines lines = { NULL, 0, 0 };
+	const char *end = buf + len;
+
+	while (buf < end) {
+		const char *eol = memchr(buf, '\n', end - buf);
+		struct md_line line = { buf, (eol ? eol : end) - buf };
+
+		if (line.len && line.buf[line.len - 1] == '\r')
+			line.len--;
+		add_line(&lines, line);
+		buf = eol ? eol + 1 : end;
+	}
+
+	collect_refs(&r, lines.items, lines.nr);
+	strbuf_addstr(out, "<div class='markdown-body'>\n");
+	render_blocks(&r, lines.items, lines.nr, 0);
+	strbuf_addstr(out, "</div>\n");
+
+	free_refs(&r);
+	free(lines.items);
+}
+
+static int is_markdown_file(const char *filename)
+{
+	static const char *exts[] = { "md", "markdown", "mdown", "mkd" };
+	const char *ext = filename ? strrchr(filename, '.') : NULL;
+	size_t i;
+
+	if (!ext || strchr(ext, '/'))
+		return 0;
+	for (i = 0; i < ARRAY_SIZE(exts); i++)
+		if (!strcasecmp(ext + 1, exts[i]))
+			return 1;
+	return 0;
+}
+
+static int is_html_file(const char *filename)
+{
+	const char *ext = filename ? strrchr(filename, '.') : NULL;
+
+	return ext && (!strcasecmp(ext, ".html") || !strcasecmp(ext, ".htm"));
+}
+
+void cgit_render_about(const char *buf, size_t len, const char *filename,
+		       const struct object_id *oid)
+{
+	struct strbuf out = STRBUF_INIT;
+	struct repo_cache_map map;
+	struct object_id blob;
+	char *name = NULL;
+
+	if (is_html_file(filename)) {
+		html_raw(buf, len);
+		return;
+	}
+	if (!is_markdown_file(filename)) {
+		html("<pre>");
+		html_ntxt(buf, len);
+		html("</pre>");
+		return;
+	}
+
+	if (repo_cache_enabled()) {
+		if (!oid) {
+			hash_object_file(the_hash_algo, buf, len, OBJ_BLOB,
+					 &blob);
+			oid = &blob;
+		}
+		name = xstrfmt("markdown/%s", oid_to_hex(oid));
+		if (!repo_cache_open(&map, name, MARKDOWN_VERSION)) {
+			html_raw(map.buf, map.len);
+			repo_cache_close(&map);
+			free(name);
+			return;
+		}
+	}
+
+	render_markdown(buf, len, &out);
+	html_raw(out.buf, out.len);
+	if (name)
+		repo_cache_store_bounded(name, MARKDOWN_VERSION, out.buf,
+					 out.len);
+	strbuf_release(&out);
+	free(name);
+}
@@ -0,0 +1,16 @@
+#ifndef MARKDOWN_H
+#define MARKDOWN_H
+
+/*
+ * Rendering of about pages done inside cgit, used by the
+ * "builtin:markdown" about filter. Markdown files are rendered to HTML
+ * inside <div class='markdown-body'>, HTML files are included as they
+ * are and anything else is shown as preformatted text, the same choices
+ * filters/about-formatting.sh makes. `oid` is the blob the buffer was
+ * read from, or NULL if it has to be hashed to key the cache.
+ */
+extern void cgit_render_about(const char *buf, size_t len,
+			      const char *filename,
+			      const struct object_id *oid);
+
+#endif /* MARKDOWN_H */
@@ -0,0 +1,291 @@
+/* parallel-gzip.c: gzip compression on several threads
+ *
+ * Copyright (C) 2026 Project Tick
+ *
+ * Licensed under GNU General Public License v2
+ *   (see COPYING for full license text)
+ *
+ *
+ * The input is cut in blocks which a pool of worker threads deflates
+ * independently, each block primed with the last 32KiB of the one
+ * before it so that the ratio stays close to single-threaded gzip.
+ * Blocks end with a sync flush, which leaves them on a byte boundary,
+ * and are written out in order as a single gzip member, the way pigz
+ * does it. The checksum of the whole stream is combined from the
+ * checksums of the blocks.
+ */
+
+#include "cgit.h"
+#include "parallel-gzip.h"
+#include <zlib.h>
+
+#define GZIP_BLOCK_SIZE (128 * 1024)
+#define GZIP_DICT_SIZE (32 * 1024)
+
+struct gzip_job {
+	unsigned char *in;
+	size_t in_len;
+	unsigned char dict[GZIP_DICT_SIZE];
+	size_t dict_len;
+	unsigned char *out;
+	size_t out_len, out_alloc;
+	uLong crc;
+	int done;
+	int error;
+};
+
+/* Jobs are used as a ring: `queued` jobs were handed to the workers so
+ * far, `started` of them were picked up and `written` were written out.
+ */
+struct gzip_pool {
+	struct gzip_job *jobs;
+	size_t nr_jobs;
+	size_t queued, started, written;
+	int finished;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+};
+
+static int deflate_job(struct gzip_job *job)
+{
+	z_stream s;
+	int ret;
+
+	memset(&s, 0, sizeof(s));
+	if (deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+			 Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+	if (job->dict_len &&
+	    deflateSetDictionary(&s, job->dict, job->dict_len) != Z_OK) {
+		deflateEnd(&s);
+		return -1;
+	}
+
+	/* The bound does not account for the sync flush marker. */
+	ALLOC_GROW(job->out, deflateBound(&s, job->in_len) + 16,
+		   job->out_alloc);
+	s.next_in = job->in;
+	s.avail_in = job->in_len;
+	s.next_out = job->out;
+	s.avail_out = job->out_alloc;
+	while ((ret = deflate(&s, Z_SYNC_FLUSH)) == Z_OK && !s.avail_out) {
+		size_t len = job->out_alloc;
+
+		ALLOC_GROW(job->out, len + 1, job->out_alloc);
+		s.next_out = job->out + len;
+		s.avail_out = job->out_alloc - len;
+	}
+	job->out_len = s.total_out;
+	job->crc = crc32(0L, job->in, job->in_len);
+	deflateEnd(&s);
+	return ret == Z_OK || ret == Z_BUF_ERROR ? 0 : -1;
+}
+
+static void *gzip_worker(void *data)
+{
+	struct gzip_pool *pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		struct gzip_job *job;
+
+		while (pool->started == pool->queued && !pool->finished)
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+		if (pool->started == pool->queued)
+			break;
+		job = &pool->jobs[pool->started++ % pool->nr_jobs];
+		pthread_mutex_unlock(&pool->mutex);
+
+		job->error = deflate_job(job);
+
+		pthread_mutex_lock(&pool->mutex);
+		job->done = 1;
+		pthread_cond_broadcast(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* Write out finished jobs in order, waiting until at least `keep` jobs
+ * or less remain in flight.
+ */
+static int write_jobs(struct gzip_pool *pool, int out, size_t keep,
+		      uLong *crc, size_t *total)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->written < pool->queued) {
+		struct gzip_job *job = &pool->jobs[pool->written % pool->nr_jobs];
+
+		if (!job->done) {
+			if (pool->queued - pool->written <= keep)
+				break;
+			pthread_cond_wait(&pool->done_cond, &pool->mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (job->error ||
+		    write_in_full(out, job->out, job->out_len) < 0)
+			ret = -1;
+		*crc = crc32_combine(*crc, job->crc, job->in_len);
+		*total += job->in_len;
+
+		pthread_mutex_lock(&pool->mutex);
+		job->done = 0;
+		pool->written++;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return ret;
+}
+
+static int parallel_gzip(int in, int out, int threads)
+{
+	static const unsigned char header[10] = {
+		0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3
+	};
+	/* An empty final block ends the deflate stream. */
+	static const unsigned char last_block[2] = { 3, 0 };
+	unsigned char trailer[8];
+	struct gzip_pool pool = { 0 };
+	pthread_t *workers;
+	struct gzip_job *prev = NULL;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	size_t total = 0, i;
+	int t, ret = 0;
+
+	pool.nr_jobs = 2 * threads;
+	CALLOC_ARRAY(pool.jobs, pool.nr_jobs);
+	for (i = 0; i < pool.nr_jobs; i++)
+		pool.jobs[i].in = xmalloc(GZIP_BLOCK_SIZE);
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_cond_init(&pool.work_cond, NULL);
+	pthread_cond_init(&pool.done_cond, NULL);
+	ALLOC_ARRAY(workers, threads);
+	for (t = 0; t < threads; t++)
+		if (pthread_create(&workers[t], NULL, gzip_worker, &pool))
+			die("Unable to create compression thread");
+
+	if (write_in_full(out, header, sizeof(header)) < 0)
+		ret = -1;
+	for (;;) {
+		struct gzip_job *job;
+		ssize_t len;
+
+		/* Wait for the slot of the next job to be written out. */
+		if (write_jobs(&pool, out, pool.nr_jobs - 1, &crc, &total))
+			ret = -1;
+		job = &pool.jobs[pool.queued % pool.nr_jobs];
+		len = read_in_full(in, job->in, GZIP_BLOCK_SIZE);
+		if (len <= 0) {
+			if (len < 0)
+				ret = -1;
+			break;
+		}
+		job->in_len = len;
+		job->dict_len = 0;
+		if (prev) {
+			job->dict_len = prev->in_len < GZIP_DICT_SIZE ?
+					prev->in_len : GZIP_DICT_SIZE;
+			memcpy(job->dict, prev->in + prev->in_len - job->dict_len,
+			       job->dict_len);
+		}
+		prev = job;
+
+		pthread_mutex_lock(&pool.mutex);
+		pool.queued++;
+		pthread_cond_signal(&pool.work_cond);
+		pthread_mutex_unlock(&pool.mutex);
+	}
+	if (write_jobs(&pool, out, 0, &crc, &total))
+		ret = -1;
+
+	pthread_mutex_lock(&pool.mutex);
+	pool.finished = 1;
+	pthread_cond_broadcast(&pool.work_cond);
+	pthread_mutex_unlock(&pool.mutex);
+	for (t = 0; t < threads; t++)
+		pthread_join(workers[t], NULL);
+
+	put_le32(trailer, crc);
+	put_le32(trailer + 4, total);
+	if (write_in_full(out, last_block, sizeof(last_block)) < 0 ||
+	    write_in_full(out, trailer, sizeof(trailer)) < 0)
+		ret = -1;
+
+	for (i = 0; i < pool.nr_jobs; i++) {
+		free(pool.jobs[i].in);
+		free(pool.jobs[i].out);
+	}
+	free(pool.jobs);
+	free(workers);
+	pthread_cond_destroy(&pool.done_cond);
+	pthread_cond_destroy(&pool.work_cond);
+	pthread_mutex_destroy(&pool.mutex);
+	return ret;
+}
+
+static void *run_gzip_filter(void *data)
+{
+	struct cgit_gzip_filter *filter = data;
+
+	filter->status = parallel_gzip(filter->in, filter->old_stdout,
+				       filter->threads);
+	return NULL;
+}
+
+static int open_gzip_filter(struct cgit_filter *base, va_list ap)
+{
+	struct cgit_gzip_filter *filter = (struct cgit_gzip_filter *)base;
+	int pipe_fh[2];
+
+	filter->old_stdout = chk_positive(dup(STDOUT_FILENO),
+		"Unable to duplicate STDOUT");
+	chk_zero(pipe(pipe_fh), "Unable to create pipe to compressor");
+	filter->in = pipe_fh[0];
+	if (pthread_create(&filter->thread, NULL, run_gzip_filter, filter))
+		die("Unable to create compression thread");
+	chk_non_negative(dup2(pipe_fh[1], STDOUT_FILENO),
+		"Unable to use pipe as STDOUT");
+	close(pipe_fh[1]);
+	return 0;
+}
+
+static int close_gzip_filter(struct cgit_filter *base)
+{
+	struct cgit_gzip_filter *filter = (struct cgit_gzip_filter *)base;
+
+	/* Restoring stdout closes the last write end of the pipe. */
+	chk_non_negative(dup2(filter->old_stdout, STDOUT_FILENO),
+		"Unable to restore STDOUT");
+	pthread_join(filter->thread, NULL);
+	close(filter->in);
+	close(filter->old_stdout);
+	return filter->status ? 1 : 0;
+}
+
+static void fprintf_gzip_filter(struct cgit_filter *base, FILE *f,
+				const char *prefix)
+{
+	struct cgit_gzip_filter *filter = (struct cgit_gzip_filter *)base;
+	fprintf(f, "%sgzip:%d\n", prefix, filter->threads);
+}
+
+void cgit_gzip_filter_init(struct cgit_gzip_filter *filter, int threads)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->base.open = open_gzip_filter;
+	filter->base.close = close_gzip_filter;
+	filter->base.fprintfp = fprintf_gzip_filter;
+	filter->threads = threads > 0 ? threads : 1;
+}
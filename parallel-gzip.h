@@ -0,0 +1,25 @@
+#ifndef PARALLEL_GZIP_H
+#define PARALLEL_GZIP_H
+
+#include "thread-utils.h"
+
+/*
+ * A filter compressing everything written to stdout between
+ * cgit_open_filter() and cgit_close_filter() as a single gzip stream,
+ * deflating blocks of it on `threads` worker threads. The output can be
+ * decompressed by any gzip implementation, but is not byte for byte the
+ * same as what gzip itself would produce.
+ */
+struct cgit_gzip_filter {
+	struct cgit_filter base;
+	int threads;
+	int old_stdout;
+	int in;
+	int status;
+	pthread_t thread;
+};
+
+extern void cgit_gzip_filter_init(struct cgit_gzip_filter *filter,
+				  int threads);
+
+#endif /* PARALLEL_GZIP_H */
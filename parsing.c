@@ -33,17 +33,19 @@ void cgit_parse_url(const char *url)
 		return;
 	}
 
+	/* The longest leading part of the url naming a repo wins. */
 	cmd = NULL;
-	c = strchr(url, '/');
-	while (c) {
+	for (c = strchr(url, '\0'); c > url; c--) {
+		if (c[0] != '/')
+			continue;
 		c[0] = '\0';
 		repo = cgit_get_repoinfo(url);
+		c[0] = '/';
 		if (repo) {
 			ctx.repo = repo;
 			cmd = c;
+			break;
 		}
-		c[0] = '/';
-		c = strchr(c + 1, '/');
 	}
 
 	if (ctx.repo) {
@@ -193,6 +195,32 @@ struct commitinfo *cgit_parse_commit(struct commit *commit)
 	return ret;
 }
 
+/* Return the author name of `commit`, reading only the commit header. */
+char *cgit_parse_commit_author(struct commit *commit)
+{
+	const char *buf = repo_get_commit_buffer(the_repository, commit, NULL);
+	const char *p, *t;
+	char *name = NULL, *encoding = NULL;
+	struct ident_split ident;
+
+	for (p = buf; !end_of_header(p); p = next_header_line(p)) {
+		if (skip_prefix(p, "author ", &t)) {
+			if (!name && !split_ident_line(&ident, t, strchrnul(t, '\n') - t))
+				name = substr(ident.name_begin, ident.name_end);
+		} else if (skip_prefix(p, "encoding ", &t)) {
+			free(encoding);
+			encoding = substr(t, strchrnul(t, '\n'));
+		}
+	}
+	repo_unuse_commit_buffer(the_repository, commit, buf);
+
+	if (!name)
+		name = xstrdup("");
+	reencode(&name, encoding ? encoding : "UTF-8", PAGE_ENCODING);
+	free(encoding);
+	return name;
+}
+
 struct taginfo *cgit_parse_tag(struct tag *tag)
 {
 	void *data;
@@ -0,0 +1,582 @@
+/* ref-snapshot.c: per-repository snapshot of refs
+ *
+ * Copyright (C) 2026 Project Tick
+ *
+ * Licensed under GNU General Public License v2
+ *   (see COPYING for full license text)
+ *
+ *
+ * The snapshot is built by a single ref iteration and stored through
+ * repo-cache as one line per ref, sorted by refname:
+ *
+ *   refname oid peeled type peeled-type date tz details author email subject
+ *
+ * with fields separated by tabs. When the refs change, the snapshot is
+ * rebuilt reusing the lines of all refs which still point at the same
+ * object, so only new and updated refs cost an object lookup.
+ *
+ * Without index-root the snapshot only lives for the current request and
+ * only covers the prefixes asked for so far; refs below another prefix
+ * are merged in when a caller first needs them.
+ */
+
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "cgit.h"
+#include "ref-snapshot.h"
+#include "repo-cache.h"
+#include "commit-graph.h"
+#include "prio-queue.h"
+
+#define SNAPSHOT_INDEX "refs"
+#define SNAPSHOT_FIELDS 11
+
+static struct repo_cache_map snapshot;
+static int snapshot_loaded;
+static struct string_list snapshot_prefixes = STRING_LIST_INIT_DUP;
+
+struct snapshot_build {
+	struct repo_cache_map old;
+	struct strbuf buf;
+	struct strbuf scratch;
+	int details;
+};
+
+/* Only these refs are displayed anywhere, all other refs are merely
+ * listed in info/refs and don't need more than their oids.
+ */
+static int is_displayed_ref(const char *refname)
+{
+	return starts_with(refname, "refs/heads/") ||
+	       starts_with(refname, "refs/remotes/") ||
+	       starts_with(refname, "refs/tags/");
+}
+
+static char *first_line(const char *msg)
+{
+	const char *eol;
+
+	if (!msg)
+		return NULL;
+	eol = strchrnul(msg, '\n');
+	return xmemdupz(msg, eol - msg);
+}
+
+static void set_commit_details(struct cgit_ref_entry *ref,
+			       struct commit *commit)
+{
+	struct commitinfo *info = cgit_parse_commit(commit);
+
+	ref->date = info->committer_date;
+	ref->tz = info->committer_tz;
+	ref->author = xstrdup_or_null(info->author);
+	ref->author_email = xstrdup_or_null(info->author_email);
+	ref->subject = xstrdup_or_null(info->subject);
+	ref->has_details = 1;
+	cgit_free_commitinfo(info);
+}
+
+static void set_tag_details(struct cgit_ref_entry *ref, struct tag *tag)
+{
+	struct taginfo *info = cgit_parse_tag(tag);
+
+	if (!info)
+		return;
+	ref->date = info->tagger_date;
+	ref->tz = info->tagger_tz;
+	ref->author = xstrdup_or_null(info->tagger);
+	ref->author_email = xstrdup_or_null(info->tagger_email);
+	ref->subject = first_line(info->msg);
+	ref->has_details = 1;
+	cgit_free_taginfo(info);
+}
+
+static enum object_type peeled_type(const struct object_id *oid)
+{
+	if (lookup_commit_in_graph(the_repository, oid))
+		return OBJ_COMMIT;
+	return oid_object_info(the_repository, oid, NULL);
+}
+
+/* Returns -1 for refs whose object is missing, which are left out. */
+static int load_entry(struct cgit_ref_entry *ref, int details)
+{
+	struct commit *commit;
+	struct object *obj;
+
+	if (peel_iterated_oid(the_repository, &ref->oid, &ref->peeled))
+		oidcpy(&ref->peeled, &ref->oid);
+	if (!is_displayed_ref(ref->refname))
+		return has_object(the_repository, &ref->oid, 0) ? 0 : -1;
+
+	/* Sorting only needs the date, which the commit-graph has. */
+	commit = lookup_commit_in_graph(the_repository, &ref->oid);
+	if (commit && !details) {
+		ref->type = ref->peeled_type = OBJ_COMMIT;
+		ref->date = commit->date;
+		return 0;
+	}
+
+	obj = parse_object_with_flags(the_repository, &ref->oid,
+				      PARSE_OBJECT_SKIP_HASH_CHECK);
+	if (!obj)
+		return -1;
+	/* Without details only the date parsed from the object header is
+	 * kept, cgit_ref_entry_load_details() fills in the rest.
+	 */
+	ref->type = ref->peeled_type = obj->type;
+	switch (obj->type) {
+	case OBJ_COMMIT:
+		if (details)
+			set_commit_details(ref, (struct commit *)obj);
+		else
+			ref->date = ((struct commit *)obj)->date;
+		break;
+	case OBJ_TAG:
+		if (details)
+			set_tag_details(ref, (struct tag *)obj);
+		else
+			ref->date = ((struct tag *)obj)->date;
+		ref->peeled_type = peeled_type(&ref->peeled);
+		break;
+	}
+	return 0;
+}
+
+static void add_field(struct strbuf *buf, const char *str)
+{
+	strbuf_addch(buf, '\t');
+	for (; str && *str; str++)
+		strbuf_addch(buf, *str == '\t' || *str == '\n' ? ' ' : *str);
+}
+
+static void add_entry(struct strbuf *buf, const struct cgit_ref_entry *ref)
+{
+	strbuf_addstr(buf, ref->refname);
+	strbuf_addf(buf, "\t%s", oid_to_hex(&ref->oid));
+	strbuf_addf(buf, "\t%s", oid_to_hex(&ref->peeled));
+	strbuf_addf(buf, "\t%d\t%d\t%"PRItime"\t%d\t%d",
+		    ref->type, ref->peeled_type, ref->date, ref->tz,
+		    ref->has_details);
+	add_field(buf, ref->author);
+	add_field(buf, ref->author_email);
+	add_field(buf, ref->subject);
+	strbuf_addch(buf, '\n');
+}
+
+static const char *line_end(const char *line)
+{
+	const char *end = snapshot.buf + snapshot.len;
+	const char *eol = memchr(line, '\n', end - line);
+
+	return eol ? eol : end;
+}
+
+/* Parse a snapshot line into `ref`, whose strings point into `scratch`. */
+static int parse_entry(struct cgit_ref_entry *ref, struct strbuf *scratch,
+		       const char *line, const char *eol)
+{
+	char *fields[SNAPSHOT_FIELDS];
+	char *p;
+	int i;
+
+	strbuf_reset(scratch);
+	strbuf_add(scratch, line, eol - line);
+	for (i = 0, p = scratch->buf; i < SNAPSHOT_FIELDS; i++) {
+		fields[i] = p;
+		p = strchr(p, '\t');
+		if (!p && i < SNAPSHOT_FIELDS - 1)
+			return -1;
+		if (p)
+			*p++ = '\0';
+	}
+
+	memset(ref, 0, sizeof(*ref));
+	ref->refname = fields[0];
+	if (get_oid_hex(fields[1], &ref->oid) ||
+	    get_oid_hex(fields[2], &ref->peeled))
+		return -1;
+	ref->type = atoi(fields[3]);
+	ref->peeled_type = atoi(fields[4]);
+	ref->date = parse_timestamp(fields[5], NULL, 10);
+	ref->tz = atoi(fields[6]);
+	ref->has_details = atoi(fields[7]);
+	ref->author = fields[8];
+	ref->author_email = fields[9];
+	ref->subject = fields[10];
+	return 0;
+}
+
+static int add_snapshot_ref(const char *refname, const struct object_id *oid,
+			    int flags, void *cb_data)
+{
+	struct snapshot_build *build = cb_data;
+	struct cgit_ref_entry ref = { 0 };
+	const char *line;
+
+	/* Reuse what we knew about this ref if it did not move. */
+	line = repo_cache_lookup(build->old.buf, build->old.len, refname);
+	if (line) {
+		const char *end = build->old.buf + build->old.len;
+		const char *eol = memchr(line, '\n', end - line);
+		struct cgit_ref_entry old;
+
+		if (eol && !parse_entry(&old, &build->scratch, line, eol) &&
+		    oideq(&old.oid, oid) && (old.has_details ||
+		    !build->details || !is_displayed_ref(refname))) {
+			strbuf_add(&build->buf, line, eol + 1 - line);
+			return 0;
+		}
+	}
+
+	ref.refname = (char *)refname;
+	oidcpy(&ref.oid, oid);
+	if (!load_entry(&ref, build->details))
+		add_entry(&build->buf, &ref);
+	free(ref.author);
+	free(ref.author_email);
+	free(ref.subject);
+	return 0;
+}
+
+static size_t refname_len(const char *line, const char *end)
+{
+	const char *p = line;
+
+	while (p < end && *p != '\t' && *p != '\n')
+		p++;
+	return p - line;
+}
+
+static int cmp_lines(const char *a, const char *a_end, const char *b,
+		     const char *b_end)
+{
+	size_t la = refname_len(a, a_end), lb = refname_len(b, b_end);
+	int r = memcmp(a, b, la < lb ? la : lb);
+
+	return r ? r : (la > lb) - (la < lb);
+}
+
+static const char *next_line(const char *line, const char *end)
+{
+	const char *eol = memchr(line, '\n', end - line);
+
+	return eol ? eol + 1 : end;
+}
+
+/* Merge the sorted lines of `add` into the in-memory snapshot. */
+static void merge_snapshot(struct strbuf *add)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *a = snapshot.buf, *a_end = a + snapshot.len;
+	const char *b = add->buf, *b_end = b + add->len;
+
+	if (!add->len) {
+		strbuf_release(add);
+		return;
+	}
+	if (!snapshot.len) {
+		free((char *)snapshot.buf);
+		snapshot.len = add->len;
+		snapshot.buf = strbuf_detach(add, NULL);
+		return;
+	}
+	strbuf_grow(&buf, snapshot.len + add->len);
+	while (a < a_end || b < b_end) {
+		int r = a == a_end ? 1 : b == b_end ? -1 :
+			cmp_lines(a, a_end, b, b_end);
+		const char *line = r <= 0 ? a : b;
+		const char *eol = next_line(line, r <= 0 ? a_end : b_end);
+
+		strbuf_add(&buf, line, eol - line);
+		if (r <= 0)
+			a = eol;
+		if (r >= 0)
+			b = next_line(b, b_end);
+	}
+	free((char *)snapshot.buf);
+	snapshot.len = buf.len;
+	snapshot.buf = strbuf_detach(&buf, NULL);
+	strbuf_release(add);
+}
+
+/* Build the part of a per-request snapshot below `prefix`. */
+static void load_snapshot_prefix(const char *prefix)
+{
+	struct snapshot_build build = {
+		.buf = STRBUF_INIT,
+		.scratch = STRBUF_INIT,
+	};
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, &snapshot_prefixes)
+		if (starts_with(prefix, item->string))
+			return;
+	string_list_append(&snapshot_prefixes, prefix);
+
+	/* Don't parse what the commit-graph can tell us. */
+	refs_for_each_fullref_in(get_main_ref_store(the_repository), prefix,
+				 NULL, add_snapshot_ref, &build);
+	strbuf_release(&build.scratch);
+	merge_snapshot(&build.buf);
+}
+
+static void load_snapshot(const char *prefix)
+{
+	struct snapshot_build build = {
+		.buf = STRBUF_INIT,
+		.scratch = STRBUF_INIT,
+		.details = 1,
+	};
+	const char *token;
+
+	if (!repo_cache_enabled()) {
+		load_snapshot_prefix(prefix);
+		return;
+	}
+
+	/* A stored snapshot always covers all refs, so that it can serve
+	 * every page until the refs change.
+	 */
+	if (snapshot_loaded)
+		return;
+	snapshot_loaded = 1;
+
+	token = repo_cache_refs_token();
+	if (!repo_cache_open(&snapshot, SNAPSHOT_INDEX, token))
+		return;
+
+	repo_cache_open(&build.old, SNAPSHOT_INDEX, NULL);
+	refs_for_each_ref(get_main_ref_store(the_repository),
+			  add_snapshot_ref, &build);
+	repo_cache_close(&build.old);
+	strbuf_release(&build.scratch);
+
+	repo_cache_store(SNAPSHOT_INDEX, token, build.buf.buf, build.buf.len);
+	snapshot.len = build.buf.len;
+	snapshot.buf = strbuf_detach(&build.buf, NULL);
+}
+
+int cgit_for_each_snapshot_ref(const char *prefix, ref_snapshot_fn fn,
+			       void *cb_data)
+{
+	struct strbuf scratch = STRBUF_INIT;
+	struct cgit_ref_entry ref;
+	const char *line, *eol, *end;
+	int ret = 0;
+
+	load_snapshot(prefix);
+	end = snapshot.buf + snapshot.len;
+	line = repo_cache_seek(snapshot.buf, snapshot.len, prefix);
+	for (; line < end && starts_with(line, prefix); line = eol + 1) {
+		eol = line_end(line);
+		if (parse_entry(&ref, &scratch, line, eol))
+			continue;
+		ret = fn(&ref, cb_data);
+		if (ret || eol == end)
+			break;
+	}
+	strbuf_release(&scratch);
+	return ret;
+}
+
+struct cgit_ref_entry *cgit_ref_entry_dup(const struct cgit_ref_entry *ref)
+{
+	struct cgit_ref_entry *copy = xmalloc(sizeof(*copy));
+
+	*copy = *ref;
+	copy->refname = xstrdup(ref->refname);
+	copy->author = xstrdup_or_null(ref->author);
+	copy->author_email = xstrdup_or_null(ref->author_email);
+	copy->subject = xstrdup_or_null(ref->subject);
+	return copy;
+}
+
+void cgit_ref_entry_free(struct cgit_ref_entry *ref)
+{
+	if (!ref)
+		return;
+	free(ref->refname);
+	free(ref->author);
+	free(ref->author_email);
+	free(ref->subject);
+	free(ref);
+}
+
+void cgit_ref_entry_load_details(struct cgit_ref_entry *ref)
+{
+	struct object *obj;
+
+	if (ref->has_details)
+		return;
+	obj = parse_object(the_repository, &ref->oid);
+	if (!obj)
+		return;
+	FREE_AND_NULL(ref->author);
+	FREE_AND_NULL(ref->author_email);
+	FREE_AND_NULL(ref->subject);
+	if (obj->type == OBJ_COMMIT)
+		set_commit_details(ref, (struct commit *)obj);
+	else if (obj->type == OBJ_TAG)
+		set_tag_details(ref, (struct tag *)obj);
+}
+
+const char *cgit_ref_entry_name(const struct cgit_ref_entry *ref)
+{
+	const char *name = ref->refname;
+
+	if (!skip_prefix(name, "refs/heads/", &name) &&
+	    !skip_prefix(name, "refs/remotes/", &name))
+		skip_prefix(name, "refs/tags/", &name);
+	return name;
+}
+
+/*
+ * A bounded heap keeps the most recent `maxcount` refs, so that only
+ * those are copied out of the snapshot.
+ */
+struct ref_selection {
+	struct prio_queue queue;
+	int maxcount;
+	int total;
+};
+
+static int cmp_ref_age(const void *a, const void *b, void *data)
+{
+	const struct cgit_ref_entry *r1 = a, *r2 = b;
+
+	/* Oldest first, so that the heap always evicts the oldest ref. */
+	if (r1->date == r2->date)
+		return 0;
+	return r1->date < r2->date ? -1 : 1;
+}
+
+static int select_ref(const struct cgit_ref_entry *ref, void *cb_data)
+{
+	struct ref_selection *sel = cb_data;
+
+	sel->total++;
+	if (sel->maxcount && sel->queue.nr >= sel->maxcount) {
+		const struct cgit_ref_entry *oldest = prio_queue_peek(&sel->queue);
+
+		if (ref->date <= oldest->date)
+			return 0;
+		cgit_ref_entry_free(prio_queue_get(&sel->queue));
+	}
+	prio_queue_put(&sel->queue, cgit_ref_entry_dup(ref));
+	return 0;
+}
+
+struct cgit_ref_entry **cgit_recent_snapshot_refs(const char **prefixes,
+						  int maxcount, int *count,
+						  int *total)
+{
+	struct ref_selection sel = { { cmp_ref_age }, maxcount };
+	struct cgit_ref_entry **refs, *ref;
+	int i;
+
+	for (; *prefixes; prefixes++)
+		cgit_for_each_snapshot_ref(*prefixes, select_ref, &sel);
+
+	*count = sel.queue.nr;
+	*total = sel.total;
+	refs = xcalloc(*count, sizeof(*refs));
+	for (i = *count - 1; (ref = prio_queue_get(&sel.queue)); i--)
+		refs[i] = ref;
+	clear_prio_queue(&sel.queue);
+	return refs;
+}
+
+struct ref_list {
+	struct cgit_ref_entry **refs;
+	int nr, alloc;
+};
+
+static int collect_ref(const char *refname, const struct object_id *oid,
+		       int flags, void *cb_data)
+{
+	struct ref_list *list = cb_data;
+	struct cgit_ref_entry *ref = xcalloc(1, sizeof(*ref));
+
+	ref->refname = xstrdup(refname);
+	oidcpy(&ref->oid, oid);
+	oidcpy(&ref->peeled, oid);
+	ALLOC_GROW(list->refs, list->nr + 1, list->alloc);
+	list->refs[list->nr++] = ref;
+	return 0;
+}
+
+/* The date of a branch tip, from the commit-graph or else from the
+ * object header, without verifying the object or reading its message.
+ */
+static timestamp_t branch_date(const struct object_id *oid)
+{
+	struct commit *commit = lookup_commit_in_graph(the_repository, oid);
+	struct object *obj;
+
+	if (commit)
+		return commit->date;
+	obj = parse_object_with_flags(the_repository, oid,
+				      PARSE_OBJECT_SKIP_HASH_CHECK);
+	if (obj && obj->type == OBJ_COMMIT)
+		return ((struct commit *)obj)->date;
+	if (obj && obj->type == OBJ_TAG)
+		return ((struct tag *)obj)->date;
+	return 0;
+}
+
+static int cmp_ref_recency(const void *a, const void *b)
+{
+	const struct cgit_ref_entry *r1 = *(const struct cgit_ref_entry **)a;
+	const struct cgit_ref_entry *r2 = *(const struct cgit_ref_entry **)b;
+
+	if (r1->date != r2->date)
+		return r1->date > r2->date ? -1 : 1;
+	return strcmp(r1->refname, r2->refname);
+}
+
+struct cgit_ref_entry **cgit_recent_branch_refs(const char **prefixes,
+						int maxcount, int *count,
+						int *total)
+{
+	struct ref_list list = { 0 };
+	int i;
+
+	/* A stored snapshot already knows the date of every ref. */
+	if (maxcount && repo_cache_enabled())
+		return cgit_recent_snapshot_refs(prefixes, maxcount, count,
+						 total);
+
+	for (; *prefixes; prefixes++)
+		refs_for_each_fullref_in(get_main_ref_store(the_repository),
+					 *prefixes, NULL, collect_ref, &list);
+
+	*total = list.nr;
+	if (maxcount && list.nr > maxcount) {
+		for (i = 0; i < list.nr; i++)
+			list.refs[i]->date = branch_date(&list.refs[i]->oid);
+		QSORT(list.refs, list.nr, cmp_ref_recency);
+		for (i = maxcount; i < list.nr; i++)
+			cgit_ref_entry_free(list.refs[i]);
+		list.nr = maxcount;
+	}
+	*count = list.nr;
+	return list.refs;
+}
+
+int cgit_cmp_ref_entries(const void *a, const void *b)
+{
+	const struct cgit_ref_entry *r1 = *(const struct cgit_ref_entry **)a;
+	const struct cgit_ref_entry *r2 = *(const struct cgit_ref_entry **)b;
+
+	return strcmp(r1->refname, r2->refname);
+}
+
+void cgit_free_ref_entries(struct cgit_ref_entry **refs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		cgit_ref_entry_free(refs[i]);
+	free(refs);
+}
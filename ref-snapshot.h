@@ -0,0 +1,71 @@
+#ifndef REF_SNAPSHOT_H
+#define REF_SNAPSHOT_H
+
+/*
+ * A snapshot of all refs of the current repository, together with what
+ * the summary, refs, header and clone pages need to know about them.
+ * Strings in entries handed to callbacks are only valid during the
+ * callback; use cgit_ref_entry_dup() to keep an entry around.
+ */
+struct cgit_ref_entry {
+	char *refname;
+	struct object_id oid;
+	struct object_id peeled;
+	enum object_type type;		/* type of the object at oid */
+	enum object_type peeled_type;	/* type of the fully peeled object */
+	timestamp_t date;		/* committer or tagger date */
+	int tz;
+	int has_details;		/* author, email and subject are set */
+	char *author;			/* commit author or tagger */
+	char *author_email;
+	char *subject;
+};
+
+typedef int (*ref_snapshot_fn)(const struct cgit_ref_entry *ref,
+			       void *cb_data);
+
+/* Call `fn` for each ref starting with `prefix`, in refname order.
+ * Iteration stops at the first non-zero return value, which is then
+ * returned.
+ */
+extern int cgit_for_each_snapshot_ref(const char *prefix, ref_snapshot_fn fn,
+				      void *cb_data);
+
+/* Return duplicates of the `maxcount` most recent refs (all refs if
+ * `maxcount` is 0) below any of the NULL-terminated `prefixes`, newest
+ * first. `total` is set to the number of refs which matched at all.
+ */
+extern struct cgit_ref_entry **cgit_recent_snapshot_refs(const char **prefixes,
+							 int maxcount,
+							 int *count,
+							 int *total);
+extern void cgit_free_ref_entries(struct cgit_ref_entry **refs, int count);
+
+/* Like cgit_recent_snapshot_refs(), but for callers which only need the
+ * names of branches: unless index-root keeps a snapshot with their
+ * dates, the refs are read directly, and their dates are only looked
+ * up, in the commit-graph or the object header, when more than
+ * `maxcount` refs have to be chosen from.
+ */
+extern struct cgit_ref_entry **cgit_recent_branch_refs(const char **prefixes,
+						       int maxcount,
+						       int *count,
+						       int *total);
+
+/* qsort() comparator ordering an array of entries by refname. */
+extern int cgit_cmp_ref_entries(const void *a, const void *b);
+
+/* Return the refname without its refs/heads/, refs/remotes/ or
+ * refs/tags/ prefix.
+ */
+extern const char *cgit_ref_entry_name(const struct cgit_ref_entry *ref);
+
+extern struct cgit_ref_entry *cgit_ref_entry_dup(const struct cgit_ref_entry *ref);
+extern void cgit_ref_entry_free(struct cgit_ref_entry *ref);
+
+/* Make sure author, author_email and subject of a duplicated entry are
+ * set, parsing its object if the snapshot did not record them.
+ */
+extern void cgit_ref_entry_load_details(struct cgit_ref_entry *ref);
+
+#endif /* REF_SNAPSHOT_H */
@@ -0,0 +1,533 @@
+/* repo-cache.c: persistent per-repository indexes
+ *
+ * Copyright (C) 2026 Project Tick
+ *
+ * Licensed under GNU General Public License v2
+ *   (see COPYING for full license text)
+ *
+ *
+ * Indexes live below "<index-root>/<hash of repo.path>/" and are only
+ * used when index-root is configured. Each file starts with the token
+ * it was built for on a line of its own; an index whose token does not
+ * match is simply ignored and rebuilt by the caller.
+ */
+
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "cgit.h"
+#include "cache.h"
+#include "repo-cache.h"
+#include "dir.h"
+
+#define STALE_LOCK_SECONDS (10 * 60)
+#define TOUCH_SECONDS (60 * 60)
+#define PRUNE_INTERVAL 64
+
+static void hash_stat(git_hash_ctx *c, const char *path, struct stat *st)
+{
+	char buf[128];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%lu %lu %lu %lu\n",
+		       (unsigned long)st->st_ino,
+		       (unsigned long)st->st_size,
+		       (unsigned long)st->st_mtime,
+		       (unsigned long)ST_MTIME_NSEC(*st));
+	the_hash_algo->update_fn(c, path, strlen(path) + 1);
+	the_hash_algo->update_fn(c, buf, len);
+}
+
+/* Loose refs are always written to a lockfile which is then renamed
+ * into place, so every update touches both the ref file and the mtime
+ * of its directory.
+ */
+static void hash_dir(git_hash_ctx *c, struct strbuf *path)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	size_t baselen;
+
+	if (lstat(path->buf, &st))
+		return;
+	hash_stat(c, path->buf, &st);
+	if (!S_ISDIR(st.st_mode))
+		return;
+	dir = opendir(path->buf);
+	if (!dir)
+		return;
+	strbuf_addch(path, '/');
+	baselen = path->len;
+	while ((de = readdir(dir)) != NULL) {
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(path, baselen);
+		strbuf_addstr(path, de->d_name);
+		hash_dir(c, path);
+	}
+	strbuf_setlen(path, baselen - 1);
+	closedir(dir);
+}
+
+const char *repo_cache_refs_token(void)
+{
+	static char *token;
+	static const char *files[] = { "HEAD", "packed-refs" };
+	static const char *dirs[] = { "refs", "reftable" };
+	struct strbuf path = STRBUF_INIT;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx c;
+	struct stat st;
+	size_t i;
+
+	if (token)
+		return token;
+
+	the_hash_algo->init_fn(&c);
+	for (i = 0; i < ARRAY_SIZE(files); i++) {
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", ctx.repo->path, files[i]);
+		if (!stat(path.buf, &st))
+			hash_stat(&c, files[i], &st);
+	}
+	for (i = 0; i < ARRAY_SIZE(dirs); i++) {
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", ctx.repo->path, dirs[i]);
+		hash_dir(&c, &path);
+	}
+	the_hash_algo->final_fn(hash, &c);
+	strbuf_release(&path);
+	token = xstrdup(hash_to_hex(hash));
+	return token;
+}
+
+int repo_cache_enabled(void)
+{
+	return ctx.cfg.index_root && *ctx.cfg.index_root;
+}
+
+static int get_index_path(struct strbuf *path, const char *name)
+{
+	if (!repo_cache_enabled())
+		return -1;
+	strbuf_addf(path, "%s/", ctx.cfg.index_root);
+	if (ctx.repo)
+		strbuf_addf(path, "%08lx/", hash_str(ctx.repo->path));
+	else
+		strbuf_addstr(path, "root/");
+	strbuf_addstr(path, name);
+	return 0;
+}
+
+int repo_cache_open(struct repo_cache_map *map, const char *name,
+		    const char *token)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct stat st;
+	const char *eol;
+	size_t tokenlen = token ? strlen(token) : 0;
+	int fd = -1;
+
+	memset(map, 0, sizeof(*map));
+	if (get_index_path(&path, name))
+		goto fail;
+	fd = open(path.buf, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) || !st.st_size)
+		goto fail;
+	map->maplen = xsize_t(st.st_size);
+	map->map = xmmap(NULL, map->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	fd = -1;
+
+	eol = memchr(map->map, '\n', map->maplen);
+	if (!eol || (token && (eol - (const char *)map->map != tokenlen ||
+			       memcmp(map->map, token, tokenlen)))) {
+		repo_cache_close(map);
+		goto fail;
+	}
+	map->buf = eol + 1;
+	map->len = map->maplen - (map->buf - (const char *)map->map);
+
+	/* Bounded indexes are pruned by age, so keep the ones in use young.
+	 * Doing it at most once an hour saves a write per page view.
+	 */
+	if (st.st_mtime + TOUCH_SECONDS < time(NULL))
+		utime(path.buf, NULL);
+	strbuf_release(&path);
+	return 0;
+
+fail:
+	if (fd >= 0)
+		close(fd);
+	strbuf_release(&path);
+	return -1;
+}
+
+int repo_cache_open_fd(const char *name, const char *token, off_t *offset,
+		       off_t *size)
+{
+	struct strbuf path = STRBUF_INIT;
+	size_t tokenlen = strlen(token);
+	char *header = xmallocz(tokenlen + 1);
+	struct stat st;
+	int fd = -1;
+
+	if (get_index_path(&path, name))
+		goto out;
+	fd = open(path.buf, O_RDONLY);
+	if (fd < 0)
+		goto out;
+	if (fstat(fd, &st) ||
+	    read_in_full(fd, header, tokenlen + 1) != (ssize_t)(tokenlen + 1) ||
+	    memcmp(header, token, tokenlen) || header[tokenlen] != '\n') {
+		close(fd);
+		fd = -1;
+		goto out;
+	}
+	*offset = tokenlen + 1;
+	*size = st.st_size;
+out:
+	free(header);
+	strbuf_release(&path);
+	return fd;
+}
+
+void repo_cache_close(struct repo_cache_map *map)
+{
+	if (map->map)
+		munmap(map->map, map->maplen);
+	memset(map, 0, sizeof(*map));
+}
+
+static int create_leading_dirs(struct strbuf *path, size_t rootlen)
+{
+	char *p;
+
+	for (p = path->buf + rootlen + 1; (p = strchr(p, '/')); p++) {
+		*p = '\0';
+		if (mkdir(path->buf, 0777) && errno != EEXIST) {
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+	return 0;
+}
+
+static int open_lock(const char *lock)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(lock, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd >= 0 || errno != EEXIST)
+		return fd;
+
+	/* A lockfile left behind by a crashed writer would otherwise
+	 * prevent the index from ever being updated again.
+	 */
+	if (stat(lock, &st) || st.st_mtime + STALE_LOCK_SECONDS > time(NULL))
+		return -1;
+	unlink(lock);
+	return open(lock, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+}
+
+int repo_cache_store(const char *name, const char *token, const char *buf,
+		     size_t len)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf lock = STRBUF_INIT;
+	int fd, result = 0;
+
+	if (get_index_path(&path, name))
+		goto out;
+	if (create_leading_dirs(&path, strlen(ctx.cfg.index_root))) {
+		result = errno;
+		cache_log("[cgit] Error creating directory for %s: %s (%d)\n",
+			  path.buf, strerror(result), result);
+		goto out;
+	}
+	strbuf_addf(&lock, "%s.lock", path.buf);
+	fd = open_lock(lock.buf);
+	if (fd < 0) {
+		/* Somebody else is already busy updating this index. */
+		if (errno != EEXIST) {
+			result = errno;
+			cache_log("[cgit] Error opening %s: %s (%d)\n",
+				  lock.buf, strerror(result), result);
+		}
+		goto out;
+	}
+	if (write_in_full(fd, token, strlen(token)) < 0 ||
+	    write_in_full(fd, "\n", 1) < 0 ||
+	    write_in_full(fd, buf, len) < 0) {
+		result = errno;
+		cache_log("[cgit] Error writing %s: %s (%d)\n",
+			  lock.buf, strerror(result), result);
+		close(fd);
+		unlink(lock.buf);
+		goto out;
+	}
+	close(fd);
+	if (rename(lock.buf, path.buf)) {
+		result = errno;
+		cache_log("[cgit] Error renaming %s to %s: %s (%d)\n",
+			  lock.buf, path.buf, strerror(result), result);
+		unlink(lock.buf);
+	}
+out:
+	strbuf_release(&lock);
+	strbuf_release(&path);
+	return result;
+}
+
+struct index_file {
+	char *path;
+	time_t mtime;
+	unsigned long mtime_nsec;
+};
+
+struct index_files {
+	struct index_file *items;
+	size_t nr, alloc;
+};
+
+static void collect_index_files(struct index_files *files,
+				struct strbuf *path)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	size_t baselen;
+
+	dir = opendir(path->buf);
+	if (!dir)
+		return;
+	strbuf_addch(path, '/');
+	baselen = path->len;
+	while ((de = readdir(dir)) != NULL) {
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(path, baselen);
+		strbuf_addstr(path, de->d_name);
+		if (lstat(path->buf, &st))
+			continue;
+		if (S_ISDIR(st.st_mode)) {
+			collect_index_files(files, path);
+			continue;
+		}
+		if (!S_ISREG(st.st_mode) || ends_with(de->d_name, ".lock"))
+			continue;
+		ALLOC_GROW(files->items, files->nr + 1, files->alloc);
+		files->items[files->nr].path = xstrdup(path->buf);
+		files->items[files->nr].mtime = st.st_mtime;
+		files->items[files->nr].mtime_nsec = ST_MTIME_NSEC(st);
+		files->nr++;
+	}
+	strbuf_setlen(path, baselen - 1);
+	closedir(dir);
+}
+
+static int cmp_index_age(const void *a, const void *b)
+{
+	const struct index_file *fa = a, *fb = b;
+
+	if (fa->mtime != fb->mtime)
+		return fa->mtime < fb->mtime ? -1 : 1;
+	if (fa->mtime_nsec != fb->mtime_nsec)
+		return fa->mtime_nsec < fb->mtime_nsec ? -1 : 1;
+	return strcmp(fa->path, fb->path);
+}
+
+/* Remove the least recently used indexes below `dir` until at most
+ * index-cache-size of them are left.
+ */
+static void prune_indexes(const char *dir)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct index_files files = { 0 };
+	size_t i, max = ctx.cfg.index_cache_size;
+	char *slash;
+
+	if (get_index_path(&path, dir))
+		return;
+	collect_index_files(&files, &path);
+	if (files.nr > max) {
+		QSORT(files.items, files.nr, cmp_index_age);
+		for (i = 0; i < files.nr - max; i++) {
+			char *file = files.items[i].path;
+
+			if (unlink(file) && errno != ENOENT) {
+				cache_log("[cgit] Error removing %s: %s (%d)\n",
+					  file, strerror(errno), errno);
+				continue;
+			}
+			/* Drop directories left empty, e.g. blame/<commit>. */
+			slash = strrchr(file, '/');
+			*slash = '\0';
+			if ((size_t)(slash - file) > path.len)
+				rmdir(file);
+		}
+	}
+	for (i = 0; i < files.nr; i++)
+		free(files.items[i].path);
+	free(files.items);
+	strbuf_release(&path);
+}
+
+int repo_cache_store_bounded(const char *name, const char *token,
+			     const char *buf, size_t len)
+{
+	unsigned long interval = PRUNE_INTERVAL;
+	char *dir;
+	int result;
+
+	result = repo_cache_store(name, token, buf, len);
+	if (result || ctx.cfg.index_cache_size <= 0 || !repo_cache_enabled())
+		return result;
+
+	/* Listing the directory on every store would be slow, so only
+	 * some names trigger pruning. Which ones is derived from the name
+	 * to stay predictable, and small limits are enforced more often
+	 * to not overshoot them by much.
+	 */
+	if (interval > (unsigned long)ctx.cfg.index_cache_size)
+		interval = ctx.cfg.index_cache_size;
+	if (hash_str(name) % interval)
+		return 0;
+	dir = xmemdupz(name, strcspn(name, "/"));
+	prune_indexes(dir);
+	free(dir);
+	return 0;
+}
+
+static size_t count_lines(const char *buf, size_t len)
+{
+	const char *end = buf + len;
+	size_t count = 0;
+
+	while (buf < end && (buf = memchr(buf, '\n', end - buf))) {
+		buf++;
+		count++;
+	}
+	return count;
+}
+
+static int update_index(const char *name, const char *token,
+			const struct repo_cache_map *old,
+			const struct string_list *lines, size_t max_lines,
+			int bounded)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *pos = "", *end = pos;
+	size_t i;
+	int result;
+
+	if (!lines->nr || !repo_cache_enabled())
+		return 0;
+	if (old->buf && count_lines(old->buf, old->len) < max_lines) {
+		pos = old->buf;
+		end = old->buf + old->len;
+	}
+
+	for (i = 0; i < lines->nr; i++) {
+		const char *line = lines->items[i].string;
+		char *key = xmemdupz(line, strcspn(line, "\t\n"));
+		const char *next = repo_cache_seek(pos, end - pos, key);
+
+		strbuf_add(&buf, pos, next - pos);
+		strbuf_addstr(&buf, line);
+		pos = next;
+		free(key);
+	}
+	strbuf_add(&buf, pos, end - pos);
+	if (bounded)
+		result = repo_cache_store_bounded(name, token, buf.buf,
+						  buf.len);
+	else
+		result = repo_cache_store(name, token, buf.buf, buf.len);
+	strbuf_release(&buf);
+	return result;
+}
+
+int repo_cache_update(const char *name, const char *token,
+		      const struct repo_cache_map *old,
+		      const struct string_list *lines, size_t max_lines)
+{
+	return update_index(name, token, old, lines, max_lines, 0);
+}
+
+int repo_cache_update_bounded(const char *name, const char *token,
+			      const struct repo_cache_map *old,
+			      const struct string_list *lines)
+{
+	return update_index(name, token, old, lines, SIZE_MAX, 1);
+}
+
+static size_t field_len(const char *line, const char *end)
+{
+	const char *p = line;
+
+	while (p < end && *p != '\t' && *p != '\n')
+		p++;
+	return p - line;
+}
+
+static int cmp_field(const char *line, const char *end, const char *key,
+		     size_t keylen)
+{
+	size_t len = field_len(line, end);
+	int r = memcmp(line, key, len < keylen ? len : keylen);
+
+	if (r)
+		return r;
+	return len < keylen ? -1 : len > keylen;
+}
+
+static const char *next_line(const char *line, const char *end)
+{
+	const char *eol = memchr(line, '\n', end - line);
+
+	return eol ? eol + 1 : end;
+}
+
+const char *repo_cache_seek(const char *buf, size_t len, const char *key)
+{
+	const char *end = buf + len;
+	size_t keylen = strlen(key);
+	size_t lo = 0, hi = len;
+
+	/* Both lo and hi always point at the start of a line. */
+	while (lo < hi) {
+		const char *line = buf + lo + (hi - lo) / 2;
+
+		while (line > buf + lo && line[-1] != '\n')
+			line--;
+		if (cmp_field(line, end, key, keylen) < 0)
+			lo = next_line(line, end) - buf;
+		else
+			hi = line - buf;
+	}
+	return buf + lo;
+}
+
+const char *repo_cache_lookup(const char *buf, size_t len, const char *key)
+{
+	const char *end = buf + len;
+	const char *line = repo_cache_seek(buf, len, key);
+
+	if (line < end && !cmp_field(line, end, key, strlen(key)))
+		return line;
+	return NULL;
+}
+
+const char *repo_cache_next(const char *buf, size_t len, const char *line)
+{
+	const char *end = buf + len;
+	const char *next = next_line(line, end);
+	size_t keylen = field_len(line, end);
+
+	if (next < end && !cmp_field(next, end, line, keylen))
+		return next;
+	return NULL;
+}
@@ -0,0 +1,99 @@
+/*
+ * repo-cache.h: persistent per-repository indexes
+ *
+ * An index is a file below "index-root" holding a single header line
+ * (the token the index was built for) followed by the payload. Index
+ * payloads are usually made of lines sorted by their first field, so
+ * that lookups can binary search a mapped file instead of parsing it.
+ */
+
+#ifndef REPO_CACHE_H
+#define REPO_CACHE_H
+
+struct repo_cache_map {
+	const char *buf;	/* payload, i.e. everything after the header */
+	size_t len;
+	void *map;
+	size_t maplen;
+};
+
+/* Return non-zero if index-root is configured. */
+extern int repo_cache_enabled(void);
+
+/* Return a token which changes whenever a ref of the current repository
+ * is created, updated or deleted. Computing it only requires stat(2)
+ * calls, no ref or object is read.
+ */
+extern const char *repo_cache_refs_token(void);
+
+/* Map the index called `name` for the current repository. Returns 0 on
+ * success and -1 if persistent indexes are disabled, the index does not
+ * exist or it was built for another token. A NULL `token` accepts the
+ * index whatever it was built for, e.g. to update it incrementally.
+ * Opening an index marks it as used for repo_cache_store_bounded().
+ */
+extern int repo_cache_open(struct repo_cache_map *map, const char *name,
+			   const char *token);
+
+/* Open the index called `name` for sending it out as it is, e.g. with
+ * html_sendfile(). Returns a file descriptor with `offset` and `size`
+ * set to where the payload starts and ends, or -1 like repo_cache_open().
+ */
+extern int repo_cache_open_fd(const char *name, const char *token,
+			      off_t *offset, off_t *size);
+
+/* Release a map obtained from repo_cache_open(). */
+extern void repo_cache_close(struct repo_cache_map *map);
+
+/* Atomically replace the index called `name` with `len` bytes of `buf`.
+ * Returns 0 on success, errors are logged but otherwise ignored since
+ * indexes can always be rebuilt.
+ */
+extern int repo_cache_store(const char *name, const char *token,
+			    const char *buf, size_t len);
+
+/* Like repo_cache_store(), for indexes which are added on every view of
+ * another object, e.g. "highlight/<blob>". All indexes sharing the first
+ * path component of `name` are bounded together: once there are more
+ * than index-cache-size of them, the least recently used are removed.
+ */
+extern int repo_cache_store_bounded(const char *name, const char *token,
+				    const char *buf, size_t len);
+
+/* Store the index `name` with the lines of `old` merged with `lines`, a
+ * sorted string_list of complete lines (each ending in '\n') whose keys
+ * are not in `old` yet. If `old` already holds `max_lines` lines or more
+ * it is dropped instead, so that indexes keyed by immutable objects
+ * don't grow without bounds.
+ */
+extern int repo_cache_update(const char *name, const char *token,
+			     const struct repo_cache_map *old,
+			     const struct string_list *lines,
+			     size_t max_lines);
+
+/* Like repo_cache_update(), for indexes stored with
+ * repo_cache_store_bounded() rather than limited by their own size.
+ */
+extern int repo_cache_update_bounded(const char *name, const char *token,
+				     const struct repo_cache_map *old,
+				     const struct string_list *lines);
+
+/* Return the first line of a sorted payload whose first field sorts
+ * at or after `key`, or `buf + len` if there is none.
+ */
+extern const char *repo_cache_seek(const char *buf, size_t len,
+				   const char *key);
+
+/* Find the first line of a sorted payload whose first field (terminated
+ * by '\t' or '\n') equals `key`. Returns NULL if there is no such line.
+ */
+extern const char *repo_cache_lookup(const char *buf, size_t len,
+				     const char *key);
+
+/* Return the line following `line` if it has the same first field, or
+ * NULL when the end of the matching run is reached.
+ */
+extern const char *repo_cache_next(const char *buf, size_t len,
+				   const char *line);
+
+#endif /* REPO_CACHE_H */
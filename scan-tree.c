@@ -133,7 +133,7 @@ static void add_repo(const char *base, struct strbuf *path, repo_config_fn fn)
 		size_t urllen;
 		strip_suffix(repo->url, ".git", &urllen);
 		strip_suffix_mem(repo->url, &urllen, "/");
-		repo->url[urllen] = '\0';
+		cgit_repo_set_url(repo, xmemdupz(repo->url, urllen));
 	}
 	repo->path = xstrdup(path->buf);
 	while (!repo->owner) {
@@ -10,6 +10,7 @@
 #define USE_THE_REPOSITORY_VARIABLE
 
 #include "cgit.h"
+#include "strmap.h"
 
 struct cgit_repolist cgit_repolist;
 struct cgit_context ctx;
@@ -35,6 +36,13 @@ int chk_non_negative(int result, char *msg)
 	return result;
 }
 
+/*
+ * Position + 1 of the first repo added for each url. Positions only go
+ * stale when the repolist gets sorted, which cgit_get_repoinfo() notices.
+ * Urls must not be changed other than with cgit_repo_set_url().
+ */
+static struct strintmap repo_urls = STRINTMAP_INIT;
+
 char *cgit_default_repo_desc = "[no description]";
 struct cgit_repo *cgit_add_repo(const char *url)
 {
@@ -70,6 +78,7 @@ struct cgit_repo *cgit_add_repo(const char *url)
 	ret->enable_subject_links = ctx.cfg.enable_subject_links;
 	ret->enable_html_serving = ctx.cfg.enable_html_serving;
 	ret->enable_subtree = ctx.cfg.enable_subtree;
+	ret->enable_tree_lastcommit = ctx.cfg.enable_tree_lastcommit;
 	ret->max_stats = ctx.cfg.max_stats;
 	ret->max_subtree_commits = ctx.cfg.max_subtree_commits;
 	ret->branch_sort = ctx.cfg.branch_sort;
@@ -86,14 +95,40 @@ struct cgit_repo *cgit_add_repo(const char *url)
 	string_list_init_dup(&ret->badges);
 	ret->submodules.strdup_strings = 1;
 	ret->hide = ret->ignore = 0;
+	if (!strintmap_contains(&repo_urls, ret->url))
+		strintmap_set(&repo_urls, ret->url, cgit_repolist.count);
 	return ret;
 }
 
+void cgit_repo_set_url(struct cgit_repo *repo, char *url)
+{
+	int pos = repo - cgit_repolist.repos + 1;
+
+	if (strintmap_get(&repo_urls, repo->url) == pos)
+		strintmap_remove(&repo_urls, repo->url);
+	if (repo->name == repo->url)
+		repo->name = url;
+	free(repo->url);
+	repo->url = url;
+	if (!strintmap_contains(&repo_urls, url))
+		strintmap_set(&repo_urls, url, pos);
+}
+
 struct cgit_repo *cgit_get_repoinfo(const char *url)
 {
 	int i;
 	struct cgit_repo *repo;
 
+	i = strintmap_get(&repo_urls, url) - 1;
+	if (i < 0)
+		return NULL;
+	if (i < cgit_repolist.count) {
+		repo = &cgit_repolist.repos[i];
+		if (!repo->ignore && !strcmp(repo->url, url))
+			return repo;
+	}
+
+	/* The repolist was sorted, or the first repo with this url ignored. */
 	for (i = 0; i < cgit_repolist.count; i++) {
 		repo = &cgit_repolist.repos[i];
 		if (repo->ignore)
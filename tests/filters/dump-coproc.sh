@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# Same as dump.sh, but speaking the co-process protocol, so that one
+# process serves all uses of the filter. The output is as long as the
+# input, so it is streamed back while the input is still being read.
+
+read_bytes() {
+	dd bs=1 count="$1" 2>/dev/null
+}
+
+while read -r argc
+do
+	args=
+	i=0
+	while [ "$i" -lt "$argc" ]
+	do
+		read -r len
+		args="$args$(read_bytes "$len") "
+		i=$((i + 1))
+	done
+	read -r len
+	printf "0 %d\n" $(($(printf "%s" "$args" | wc -c) + len))
+	printf "%s" "$args"
+	read_bytes "$len" | tr '[:lower:]' '[:upper:]'
+done
@@ -152,6 +152,15 @@ repo.commit-filter=exec:$FILTER_DIRECTORY/dump.sh
 repo.email-filter=exec:$FILTER_DIRECTORY/dump.sh
 repo.source-filter=exec:$FILTER_DIRECTORY/dump.sh
 repo.readme=master:a+b
+
+repo.url=filter-coproc
+repo.path=$PWD/repos/filter/.git
+repo.desc=filtered repo
+repo.about-filter=coproc:$FILTER_DIRECTORY/dump-coproc.sh
+repo.commit-filter=coproc:$FILTER_DIRECTORY/dump-coproc.sh
+repo.email-filter=coproc:$FILTER_DIRECTORY/dump-coproc.sh
+repo.source-filter=coproc:$FILTER_DIRECTORY/dump-coproc.sh
+repo.readme=master:a+b
 EOF
 
 	if [ $CGIT_HAS_LUA -eq 1 ]; then
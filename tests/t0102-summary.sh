@@ -22,4 +22,56 @@ test_expect_success 'clone-url expanded correctly' '
 	grep "git://example.org/bar.git" tmp
 '
 
+meta_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-meta$1" QUERY_STRING="url=meta" cgit
+}
+
+test_expect_success 'set up repository with metadata files' '
+	test_create_repo repos/meta &&
+	(
+		cd repos/meta &&
+		mkdir .github docs &&
+		echo "SPDX-License-Identifier: MIT" >LICENSE.txt &&
+		echo "GNU GPL" >COPYING &&
+		echo "* @owner" >.github/CODEOWNERS &&
+		echo "* @docs" >docs/CODEOWNERS &&
+		echo "Someone" >MAINTAINERS.md &&
+		git add . &&
+		git commit -q -m "add metadata"
+	) &&
+	cat >cgitrc-meta <<-EOF &&
+	virtual-root=/
+	cache-size=0
+	repo.url=meta
+	repo.path=$PWD/repos/meta/.git
+	EOF
+	{
+		echo "index-root=$PWD/index-meta" &&
+		cat cgitrc-meta
+	} >cgitrc-meta-index
+'
+
+test_expect_success 'resolve the metadata files' '
+	meta_query >expect &&
+	meta_query -index >actual &&
+	test_cmp expect actual &&
+	grep "<td class=.left.>License</td><td class=.left.>MIT (<a [^>]*>LICENSE.txt</a>)</td>" actual &&
+	grep "<td class=.left.>Codeowners</td><td class=.left.><a [^>]*>.github/CODEOWNERS</a></td>" actual &&
+	grep "<td class=.left.>Maintainers</td><td class=.left.><a [^>]*>MAINTAINERS.md</a></td>" actual
+'
+
+test_expect_success 'keep the metadata of the root tree' '
+	tree=$(git -C repos/meta rev-parse master^{tree}) &&
+	grep "^$tree.LICENSE.txt.MIT..github/CODEOWNERS.MAINTAINERS.md$" \
+		index-meta/*/summary-metadata
+'
+
+test_expect_success 'reuse the kept metadata' '
+	sed "2,\$s/MIT/GPL-2.0-only/" index-meta/*/summary-metadata >index.new &&
+	mv index.new index-meta/*/summary-metadata &&
+	meta_query -index >actual &&
+	grep "<td class=.left.>GPL-2.0-only (<a [^>]*>LICENSE.txt</a>)</td>" actual
+'
+
 test_done
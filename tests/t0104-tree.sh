@@ -29,4 +29,226 @@ test_expect_success 'verify a+b?h=1+2 link' '
 	grep "/foo+bar/tree/a+b?h=1%2b2" tmp
 '
 
+page_url()
+{
+	CGIT_CONFIG="$PWD/cgitrc-page" QUERY_STRING="url=$1" cgit
+}
+
+test_expect_success 'set up repository with a paged tree' '
+	test_create_repo repos/page &&
+	(
+		cd repos/page &&
+		mkdir foo &&
+		for f in a foo.c foo/x foo0 z
+		do
+			echo "$f" >"$f" || return 1
+		done &&
+		git add . &&
+		git commit -q -m "add entries"
+	) &&
+	cat >cgitrc-page <<-EOF
+	virtual-root=/
+	cache-size=0
+	max-tree-entries=2
+	repo.url=page
+	repo.path=$PWD/repos/page/.git
+	EOF
+'
+
+test_expect_success 'first page has the first entries in tree order' '
+	page_url "page/tree" >tmp &&
+	grep ">a</a>" tmp &&
+	grep ">foo.c</a>" tmp &&
+	! grep ">foo</a>" tmp &&
+	grep "after=foo.c.>\[next\]</a>" tmp
+'
+
+test_expect_success 'next page sorts the directory before foo0' '
+	page_url "page/tree&after=foo.c" >tmp &&
+	! grep ">foo.c</a>" tmp &&
+	grep ">foo</a>" tmp &&
+	grep ">foo0</a>" tmp &&
+	grep "\[first\]</a>" tmp &&
+	grep "after=foo/.>\[next\]</a>" tmp
+'
+
+test_expect_success 'last page follows the directory' '
+	page_url "page/tree&after=foo/" >tmp &&
+	! grep ">foo0</a>" tmp &&
+	grep ">z</a>" tmp &&
+	! grep "\[next\]</a>" tmp
+'
+
+test_expect_success 'page after a removed entry starts in tree order' '
+	page_url "page/tree&after=foo.d" >tmp &&
+	grep ">foo</a>" tmp &&
+	grep ">foo0</a>" tmp &&
+	! grep ">foo.c</a>" tmp
+'
+
+test_expect_success 'filter entries on the server' '
+	page_url "page/tree&q=FOO" >tmp &&
+	grep ">foo.c</a>" tmp &&
+	grep ">foo</a>" tmp &&
+	! grep ">a</a>" tmp &&
+	grep "q=FOO&amp;after=foo/.>\[next\]</a>" tmp
+'
+
+test_expect_success 'page through filtered entries' '
+	page_url "page/tree&q=FOO&after=foo/" >tmp &&
+	grep ">foo0</a>" tmp &&
+	! grep ">z</a>" tmp &&
+	! grep "\[next\]</a>" tmp
+'
+
+write_idx_config()
+{
+	{
+		echo "virtual-root=/" &&
+		echo "cache-size=0" &&
+		for option
+		do
+			echo "$option" || return 1
+		done &&
+		echo "repo.url=idx" &&
+		echo "repo.path=$PWD/repos/idx/.git"
+	} >cgitrc-idx &&
+	{
+		echo "index-root=$PWD/index-idx" &&
+		cat cgitrc-idx
+	} >cgitrc-idx-index &&
+	rm -rf index-idx
+}
+
+# Compare the page at url $1 served with index-root, into "actual",
+# with the one served without it.
+compare_idx()
+{
+	CGIT_CONFIG="$PWD/cgitrc-idx" QUERY_STRING="url=$1" cgit >expect &&
+	CGIT_CONFIG="$PWD/cgitrc-idx-index" QUERY_STRING="url=$1" cgit >actual &&
+	test_cmp expect actual
+}
+
+idx_url()
+{
+	CGIT_CONFIG="$PWD/cgitrc-idx-index" QUERY_STRING="url=$1" cgit
+}
+
+# Replace $1 with $2 in the payload of the index file $3, so that the
+# next page shows whether it was read from there.
+tamper_index()
+{
+	sed "2,\$s|$1|$2|" "$3" >index.new &&
+	mv index.new "$3"
+}
+
+test_expect_success 'set up repository for the tree indexes' '
+	test_create_repo repos/idx &&
+	(
+		cd repos/idx &&
+		mkdir -p lib deep/one/two &&
+		echo a >a &&
+		echo x >lib/x &&
+		echo f >deep/one/two/f &&
+		echo g >deep/one/two/g &&
+		git add . &&
+		git commit -q -m "commit one" &&
+		echo aa >a &&
+		git commit -q -a -m "commit two" &&
+		mkdir -p vendor/lib &&
+		echo v >vendor/lib/v &&
+		git add vendor &&
+		git commit -q -m "add vendor/lib" \
+			-m "git-subtree-dir: vendor/lib" \
+			-m "git-subtree-split: $(git rev-parse HEAD~1)" &&
+		echo xx >lib/x &&
+		git commit -q -a -m "commit four"
+	) &&
+	head=$(git -C repos/idx rev-parse master) &&
+	split=$(git -C repos/idx rev-parse master~3)
+'
+
+test_expect_success 'mark subtree directories' '
+	write_idx_config enable-subtree=1 &&
+	compare_idx "idx/tree/vendor" &&
+	grep "<tr class=.ls-subtree. data-name=.lib." actual &&
+	grep "<span class=.subtree-badge. title=.split $split.>subtree</span>" actual &&
+	grep "^$head.vendor/lib.$split$" index-idx/*/subtrees
+'
+
+test_expect_success 'reuse the subtree index' '
+	other=$(git -C repos/idx rev-parse master~1) &&
+	tamper_index $split $other index-idx/*/subtrees &&
+	idx_url "idx/tree/vendor" >tmp &&
+	grep "title=.split $other.>subtree</span>" tmp
+'
+
+test_expect_success 'extend the subtree index from an indexed ancestor' '
+	rm -rf index-idx &&
+	idx_url "idx/tree/vendor&id=master~1" >tmp &&
+	grep "title=.split $split.>subtree</span>" tmp &&
+	compare_idx "idx/tree/vendor" &&
+	grep "^$head.vendor/lib.$split$" index-idx/*/subtrees
+'
+
+test_expect_success 'collapse single-directory chains and show sizes' '
+	write_idx_config &&
+	compare_idx "idx/tree" &&
+	grep ">deep</a> / <a [^>]*>one</a> / <a [^>]*>two</a></td>" actual &&
+	grep ">vendor</a> / <a [^>]*>lib</a></td>" actual &&
+	grep "data-name=.lib.*>lib</a></td>" actual &&
+	grep "data-name=.a.*<td class=.ls-size.>3</td>" actual &&
+	root=$(git -C repos/idx rev-parse master^{tree}) &&
+	deep=$(git -C repos/idx rev-parse master:deep) &&
+	grep "^$deep.one/two$" index-idx/*/chains/$root
+'
+
+test_expect_success 'reuse the chains of a listed tree' '
+	tamper_index one/two one index-idx/*/chains/$root &&
+	idx_url "idx/tree" >tmp &&
+	grep ">deep</a> / <a [^>]*>one</a></td>" tmp
+'
+
+test_expect_success 'keep the chains of each listed tree apart' '
+	idx_url "idx/tree&id=master~3" >tmp &&
+	grep ">deep</a> / <a [^>]*>one</a> / <a [^>]*>two</a></td>" tmp &&
+	old=$(git -C repos/idx rev-parse master~3^{tree}) &&
+	test -f index-idx/*/chains/$old
+'
+
+test_expect_success 'show the last commit of each entry' '
+	write_idx_config enable-tree-lastcommit=1 &&
+	compare_idx "idx/tree" &&
+	grep "data-name=.a.*>commit two</a></td><td>" actual &&
+	grep "data-name=.deep.*>commit one</a></td><td>" actual &&
+	grep "data-name=.lib.*>commit four</a></td><td>" actual &&
+	grep "data-name=.vendor.*>add vendor/lib</a></td><td>" actual &&
+	root=$(git -C repos/idx rev-parse master^{tree}) &&
+	two=$(git -C repos/idx rev-parse master~2) &&
+	grep "^a.$two$" index-idx/*/lastcommit/$root
+'
+
+test_expect_success 'reuse the last commits of a listed tree' '
+	one=$(git -C repos/idx rev-parse master~3) &&
+	tamper_index $two $one index-idx/*/lastcommit/$root &&
+	idx_url "idx/tree" >tmp &&
+	grep "data-name=.a.*>commit one</a></td><td>" tmp
+'
+
+test_expect_success 'stop the walk at a tree listed before' '
+	rm -rf index-idx &&
+	compare_idx "idx/tree&id=master~1" &&
+	prev=$(git -C repos/idx rev-parse master~1^{tree}) &&
+	tamper_index $two $one index-idx/*/lastcommit/$prev &&
+	idx_url "idx/tree" >tmp &&
+	grep "data-name=.a.*>commit one</a></td><td>" tmp &&
+	grep "data-name=.lib.*>commit four</a></td><td>" tmp
+'
+
+test_expect_success 'show the last commits in a subdirectory' '
+	rm -rf index-idx &&
+	compare_idx "idx/tree/deep/one/two" &&
+	grep "data-name=.f.*>commit one</a></td><td>" actual
+'
+
 test_done
@@ -202,4 +202,95 @@ test_expect_success UNZIP 'verify unzipped file-5' '
 	test_line_count = 1 master/file-5
 '
 
+test_expect_success 'set up snapshot-store' '
+	git --git-dir="$PWD/repos/foo/.git" tag v1.0 &&
+	commit=$(git --git-dir="$PWD/repos/foo/.git" rev-parse v1.0) &&
+	rm -rf store &&
+	cat >cgitrc-store <<-EOF
+	virtual-root=/
+	cache-size=0
+	snapshots=tar.gz zip
+	snapshot-store=$PWD/store
+	repo.url=foo
+	repo.path=$PWD/repos/foo/.git
+	EOF
+'
+
+test_expect_success 'pre-generate snapshots of the latest tag' '
+	CGIT_CONFIG="$PWD/cgitrc-store" cgit --repo=foo \
+		--pregenerate-snapshots=1 >out &&
+	test_line_count = 2 out &&
+	grep "store/foo/$commit/foo-1.0.tar.gz$" out &&
+	grep "store/foo/$commit/foo-1.0.zip$" out
+'
+
+test_expect_success 'verify pre-generated archive' '
+	gunzip --test "store/foo/$commit/foo-1.0.tar.gz" &&
+	gzip -dc "store/foo/$commit/foo-1.0.tar.gz" | tar -tf - >output &&
+	grep "^foo-1.0/file-5$" output
+'
+
+test_expect_success 'no lockfiles are left behind' '
+	ls "store/foo/$commit" >output &&
+	! grep "\.lock$" output
+'
+
+test_expect_success 'existing archives are not generated again' '
+	echo stored >"store/foo/$commit/foo-1.0.tar.gz" &&
+	rm "store/foo/$commit/foo-1.0.zip" &&
+	CGIT_CONFIG="$PWD/cgitrc-store" cgit --repo=foo \
+		--pregenerate-snapshots=1 >out &&
+	test_line_count = 1 out &&
+	grep "foo-1.0.zip$" out
+'
+
+test_expect_success 'get foo/snapshot/foo-1.0.tar.gz from snapshot-store' '
+	CGIT_CONFIG="$PWD/cgitrc-store" \
+		QUERY_STRING="url=foo/snapshot/foo-1.0.tar.gz" cgit >tmp &&
+	grep "Content-Length: 7" tmp &&
+	strip_headers <tmp >actual &&
+	echo stored >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'snapshots missing from snapshot-store are generated' '
+	CGIT_CONFIG="$PWD/cgitrc-store" \
+		QUERY_STRING="url=foo/snapshot/master.tar.gz" cgit >tmp &&
+	strip_headers <tmp >master.tar.gz &&
+	gunzip --test master.tar.gz
+'
+
+test_expect_success 'set up a repository larger than several gzip blocks' '
+	test_create_repo repos/big &&
+	test_seq 200000 >repos/big/numbers &&
+	test_seq 100000 | sed "s/$/ of many lines/" >repos/big/lines &&
+	git -C repos/big add numbers lines &&
+	git -C repos/big commit -q -m "add large files" &&
+	cat >cgitrc-threads <<-EOF
+	virtual-root=/
+	cache-size=0
+	snapshots=tar.gz
+	snapshot-threads.tar.gz=4
+	repo.url=big
+	repo.path=$PWD/repos/big/.git
+	EOF
+'
+
+test_expect_success 'get big/snapshot/master.tar.gz compressed on 4 threads' '
+	CGIT_CONFIG="$PWD/cgitrc-threads" \
+		QUERY_STRING="url=big/snapshot/master.tar.gz" cgit >tmp &&
+	strip_headers <tmp >big.tar.gz &&
+	test $(wc -c <big.tar.gz) -gt 131072
+'
+
+test_expect_success 'verify gzip format of the parallel archive' '
+	gzip -t big.tar.gz
+'
+
+test_expect_success 'compare the parallel archive with git archive' '
+	git -C repos/big archive --format=tar --prefix=master/ master >expect &&
+	gzip -dc big.tar.gz >actual &&
+	test_cmp expect actual
+'
+
 test_done
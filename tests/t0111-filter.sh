@@ -3,7 +3,7 @@
 test_description='Check filtered content'
 . ./setup.sh
 
-prefixes="exec"
+prefixes="exec coproc"
 if [ $CGIT_HAS_LUA -eq 1 ]; then
 	prefixes="$prefixes lua"
 fi
@@ -43,4 +43,36 @@ do
 	'
 done
 
+test_expect_success 'set up a file larger than a pipe buffer' '
+	git clone -q repos/filter repos/filter-large &&
+	test_seq 20000 | sed "s/$/ line/" >repos/filter-large/large &&
+	git -C repos/filter-large add large &&
+	git -C repos/filter-large commit -q -m "add large" &&
+	cat >cgitrc-large <<-EOF
+	virtual-root=/
+	cache-size=0
+	repo.url=filter-large
+	repo.path=$PWD/repos/filter-large/.git
+	repo.source-filter=coproc:$FILTER_DIRECTORY/dump-coproc.sh
+	EOF
+'
+
+test_expect_success 'coproc filter streaming its output gets all input' '
+	CGIT_CONFIG="$PWD/cgitrc-large" QUERY_STRING="url=filter-large/tree/large" \
+		cgit >tmp &&
+	grep "<code>large 1 LINE$" tmp &&
+	grep "^20000 LINE$" tmp
+'
+
+for prefix in coproc builtin
+do
+	test_expect_success "refuse a $prefix auth filter" '
+		echo "auth-filter=$prefix:$FILTER_DIRECTORY/dump-coproc.sh" \
+			>cgitrc-auth &&
+		test_must_fail env CGIT_CONFIG="$PWD/cgitrc-auth" \
+			QUERY_STRING="url=/" cgit >tmp 2>err &&
+		grep "Invalid auth filter type: $prefix" err
+	'
+done
+
 test_done
@@ -0,0 +1,115 @@
+#!/bin/sh
+
+test_description='Check HTTP clone pages'
+. ./setup.sh
+
+smart_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-smart" QUERY_STRING="$1" cgit
+}
+
+test_expect_success 'write config with smart HTTP' '
+	{
+		echo "enable-smart-http=1" &&
+		cat cgitrc
+	} >cgitrc-smart
+'
+
+test_expect_success 'list refs of foo' '
+	git --git-dir="$PWD/repos/foo/.git" for-each-ref \
+		--format="%(objectname)	%(refname)" >expect
+'
+
+test_expect_success 'generate foo/info/refs' '
+	cgit_query "url=foo/info/refs" >tmp
+'
+
+test_expect_success 'compare with refs of foo' '
+	grep "Content-Type: text/plain" tmp &&
+	strip_headers <tmp >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'generate foo/info/refs for upload-pack without smart HTTP' '
+	cgit_query "url=foo/info/refs&service=git-upload-pack" >tmp
+'
+
+test_expect_success 'dumb refs are served instead' '
+	grep "Content-Type: text/plain" tmp &&
+	strip_headers <tmp >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'upload-pack is not found without smart HTTP' '
+	cgit_url "foo/git-upload-pack" >tmp &&
+	head -n 1 tmp | grep "Status: 404"
+'
+
+test_expect_success 'generate foo/info/refs for upload-pack with smart HTTP' '
+	smart_query "url=foo/info/refs&service=git-upload-pack" >tmp
+'
+
+test_expect_success 'check smart HTTP advertisement' '
+	grep "Content-Type: application/x-git-upload-pack-advertisement" tmp &&
+	grep "Cache-Control: no-cache" tmp &&
+	strip_headers <tmp >actual &&
+	printf "001e# service=git-upload-pack\n0000" >expect &&
+	head -c 34 actual >actual.head &&
+	test_cmp expect actual.head &&
+	grep "refs/heads/master" actual
+'
+
+test_expect_success 'other services are served the dumb refs' '
+	smart_query "url=foo/info/refs&service=git-receive-pack" >tmp &&
+	grep "Content-Type: text/plain" tmp
+'
+
+test_expect_success 'generate protocol v2 advertisement' '
+	HTTP_GIT_PROTOCOL=version=2 \
+		smart_query "url=foo/info/refs&service=git-upload-pack" >tmp
+'
+
+test_expect_success 'check protocol v2 advertisement' '
+	strip_headers <tmp >actual &&
+	printf "000eversion 2\n" >expect &&
+	head -c 14 actual >actual.head &&
+	test_cmp expect actual.head &&
+	grep "ls-refs" actual
+'
+
+test_expect_success 'run ls-refs over protocol v2' '
+	printf "0014command=ls-refs\n00010000" >request &&
+	HTTP_GIT_PROTOCOL=version=2 REQUEST_METHOD=POST \
+	CONTENT_TYPE=application/x-git-upload-pack-request \
+		smart_query "url=foo/git-upload-pack" <request >tmp
+'
+
+test_expect_success 'check ls-refs result' '
+	grep "Content-Type: application/x-git-upload-pack-result" tmp &&
+	master=$(git --git-dir="$PWD/repos/foo/.git" rev-parse master) &&
+	grep "$master refs/heads/master" tmp
+'
+
+test_expect_success 'run compressed ls-refs over protocol v2' '
+	gzip -c request >request.gz &&
+	HTTP_GIT_PROTOCOL=version=2 REQUEST_METHOD=POST \
+	CONTENT_TYPE=application/x-git-upload-pack-request \
+	HTTP_CONTENT_ENCODING=gzip \
+		smart_query "url=foo/git-upload-pack" <request.gz >tmp &&
+	grep "$master refs/heads/master" tmp
+'
+
+test_expect_success 'refuse requests inflating past the limit' '
+	GIT_HTTP_MAX_REQUEST_BUFFER=16 HTTP_GIT_PROTOCOL=version=2 \
+	REQUEST_METHOD=POST CONTENT_TYPE=application/x-git-upload-pack-request \
+	HTTP_CONTENT_ENCODING=gzip \
+		smart_query "url=foo/git-upload-pack" <request.gz >tmp &&
+	head -n 1 tmp | grep "Status: 413"
+'
+
+test_expect_success 'upload-pack requires POST' '
+	smart_query "url=foo/git-upload-pack" >tmp &&
+	head -n 1 tmp | grep "Status: 405"
+'
+
+test_done
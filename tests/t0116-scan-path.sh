@@ -0,0 +1,95 @@
+#!/bin/sh
+
+test_description='Check repositories found by scan-path'
+. ./setup.sh
+
+scan_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-scan" QUERY_STRING="$1" cgit
+}
+
+test_expect_success 'set up scanned repositories' '
+	rm -rf scan &&
+	mkdir scan &&
+	git clone -q --bare repos/foo scan/baz.git &&
+	git clone -q --bare repos/bar scan/qux.git &&
+	cat >cgitrc-scan <<-EOF
+	virtual-root=/
+	cache-size=0
+	remove-suffix=1
+	scan-path=$PWD/scan
+	EOF
+'
+
+test_expect_success 'generate baz/log with the suffix removed' '
+	scan_query "url=baz/log" >tmp
+'
+
+test_expect_success 'find commit of baz' '
+	grep "commit 5" tmp &&
+	! grep "commit 50" tmp
+'
+
+test_expect_success 'generate qux/log' '
+	scan_query "url=qux/log" >tmp &&
+	grep "commit 50" tmp
+'
+
+test_expect_success 'urls with the suffix are not repositories' '
+	scan_query "url=baz.git/log" >tmp &&
+	! grep "commit 5" tmp
+'
+
+cached_scan_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-cached-scan" QUERY_STRING="$1" cgit
+}
+
+test_expect_success 'set up a cached scan-path' '
+	rm -rf cache-scan &&
+	mkdir cache-scan &&
+	cat >cgitrc-cached-scan <<-EOF
+	virtual-root=/
+	cache-root=$PWD/cache-scan
+	cache-size=1000
+	remove-suffix=1
+	scan-path=$PWD/scan
+	EOF
+'
+
+test_expect_success 'generate baz/log from the cached scan-path' '
+	cached_scan_query "url=baz/log" >tmp &&
+	grep "commit 5" tmp &&
+	! grep "commit 50" tmp
+'
+
+test_expect_success 'index the repos of the cached scan-path' '
+	ls cache-scan/rc-*.idx >idx &&
+	test_line_count = 1 idx &&
+	idx=$(cat idx) &&
+	rc=${idx%.idx} &&
+	sed 1d "$idx" | cut -f1 >actual &&
+	printf "\nbaz\nqux\n" >expect &&
+	test_cmp expect actual &&
+	size=$(wc -c <"$rc" | tr -d " ") &&
+	head -n 1 "$idx" | grep " $size$"
+'
+
+test_expect_success 'find another repo through the index' '
+	cached_scan_query "url=qux/commit" >tmp &&
+	grep "commit 50" tmp
+'
+
+test_expect_success 'list all repos of the cached scan-path' '
+	cached_scan_query "" >tmp &&
+	grep "/baz/" tmp &&
+	grep "/qux/" tmp
+'
+
+test_expect_success 'ignore an index of another version of the repolist' '
+	echo >>"$rc" &&
+	cached_scan_query "url=qux/tree" >tmp &&
+	grep "file-50" tmp
+'
+
+test_done
@@ -0,0 +1,130 @@
+#!/bin/sh
+
+test_description='Check the builtin markdown about filter'
+. ./setup.sh
+
+md_url()
+{
+	CGIT_CONFIG="$PWD/cgitrc-md" QUERY_STRING="url=$1" cgit
+}
+
+test_expect_success 'set up repository with markdown files' '
+	mkrepo repos/md 1 >/dev/null &&
+	cat >repos/md/README.md <<-\EOF &&
+	# Title
+
+	Setext heading
+	--------------
+
+	Some *emphasis*, **strong**, ~~gone~~ and `a < b` code.
+
+	- one
+	- two
+	  1. nested
+	  2. list
+
+	```c
+	int x = 1 < 2;
+	```
+
+	    indented code
+
+	[a link](https://example.com/ "title") and <https://example.org>.
+
+	<div class="raw">
+	kept *as is*
+	</div>
+
+	> quoted
+	EOF
+	printf "%040d deep\n" 0 | tr 0 ">" >repos/md/deep.md &&
+	printf "*x%01100d*\n\n*short*\n" 0 >repos/md/span.md &&
+	echo "Plain <text> & *stars*" >repos/md/notes.txt &&
+	echo "<p class=\"x\">kept</p>" >repos/md/page.html &&
+	git -C repos/md add . &&
+	git -C repos/md commit -q -m "add documentation" &&
+	cat >cgitrc-md <<-EOF
+	virtual-root=/
+	cache-size=0
+	index-root=$PWD/index-md
+	repo.url=md
+	repo.path=$PWD/repos/md/.git
+	repo.about-filter=builtin:markdown
+	repo.readme=master:README.md
+	EOF
+'
+
+test_expect_success 'generate md/about/' '
+	md_url "md/about/" >tmp
+'
+
+test_expect_success 'render headings' '
+	grep "<div class=.markdown-body.>" tmp &&
+	grep "<h1 id=.title.>Title</h1>" tmp &&
+	grep "<h2 id=.setext-heading.>Setext heading</h2>" tmp
+'
+
+test_expect_success 'render emphasis and code spans' '
+	grep "<p>Some <em>emphasis</em>, <strong>strong</strong>, <del>gone</del> and <code>a &lt; b</code> code.</p>" tmp
+'
+
+test_expect_success 'render nested lists' '
+	grep "^<ul>$" tmp &&
+	grep "^<li>two$" tmp &&
+	grep "^<ol>$" tmp &&
+	grep "^<li>nested$" tmp
+'
+
+test_expect_success 'render code blocks' '
+	grep "<pre><code class=.language-c.>int x = 1 &lt; 2;" tmp &&
+	grep "<pre><code>indented code" tmp
+'
+
+test_expect_success 'render links' '
+	grep "<p><a href=.https://example.com/. title=.title.>a link</a> and <a href=.https://example.org.>https://example.org</a>.</p>" tmp
+'
+
+test_expect_success 'pass raw HTML through' '
+	grep "^<div class=\"raw\">$" tmp &&
+	grep "^kept \*as is\*$" tmp
+'
+
+test_expect_success 'render block quotes' '
+	grep "^<blockquote>$" tmp &&
+	grep "<p>quoted</p>" tmp
+'
+
+test_expect_success 'limit the nesting of blocks' '
+	md_url "md/about/deep.md" >tmp &&
+	test $(grep -c "<blockquote>" tmp) = 32 &&
+	grep "&gt;&gt;&gt;&gt;&gt;&gt;&gt;&gt; deep" tmp
+'
+
+test_expect_success 'limit the span of inline markup' '
+	md_url "md/about/span.md" >tmp &&
+	grep "<p>\*x" tmp &&
+	! grep "<em>x" tmp &&
+	grep "<p><em>short</em></p>" tmp
+'
+
+test_expect_success 'show other files as text' '
+	md_url "md/about/notes.txt" >tmp &&
+	grep "<pre>Plain &lt;text&gt; &amp; \*stars\*" tmp
+'
+
+test_expect_success 'include HTML files as they are' '
+	md_url "md/about/page.html" >tmp &&
+	grep "<p class=\"x\">kept</p>" tmp
+'
+
+test_expect_success 'keep the rendered readme by its blob id' '
+	blob=$(git -C repos/md rev-parse master:README.md) &&
+	test -f index-md/*/markdown/$blob
+'
+
+test_expect_success 'serve the kept rendering' '
+	md_url "md/about/" >tmp &&
+	grep "<h1 id=.title.>Title</h1>" tmp
+'
+
+test_done
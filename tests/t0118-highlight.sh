@@ -0,0 +1,82 @@
+#!/bin/sh
+
+test_description='Check the builtin highlight source filter'
+. ./setup.sh
+
+hl_url()
+{
+	CGIT_CONFIG="$PWD/cgitrc-hl" QUERY_STRING="url=$1" cgit
+}
+
+test_expect_success 'set up repository with source files' '
+	mkrepo repos/hl 1 >/dev/null &&
+	cat >repos/hl/hello.c <<-\EOF &&
+	#include <stdio.h>
+	/* comment */
+	int main(void)
+	{
+		const char *s = "a<b";
+		return 0; // done
+	}
+	EOF
+	cat >repos/hl/build.sh <<-\EOF &&
+	for x in a; do
+		echo "$x" # c
+	done
+	EOF
+	echo "plain <text> int" >repos/hl/notes.txt &&
+	git -C repos/hl add . &&
+	git -C repos/hl commit -q -m "add sources" &&
+	cat >cgitrc-hl <<-EOF
+	virtual-root=/
+	cache-size=0
+	index-root=$PWD/index-hl
+	index-cache-size=1
+	repo.url=hl
+	repo.path=$PWD/repos/hl/.git
+	repo.source-filter=builtin:highlight
+	EOF
+'
+
+test_expect_success 'generate hl/tree/hello.c' '
+	hl_url "hl/tree/hello.c" >tmp
+'
+
+test_expect_success 'highlight C' '
+	grep "<code><span class=.hl-cp.>#include &lt;stdio.h&gt;</span>$" tmp &&
+	grep "^<span class=.hl-c.>/\* comment \*/</span>$" tmp &&
+	grep "^<span class=.hl-k.>int</span> main(<span class=.hl-k.>void</span>)$" tmp &&
+	grep "<span class=.hl-s.>\"a&lt;b\"</span>;$" tmp &&
+	grep "<span class=.hl-m.>0</span>; <span class=.hl-c.>// done</span>$" tmp
+'
+
+test_expect_success 'keep the highlighted file by its blob id' '
+	blob=$(git -C repos/hl rev-parse master:hello.c) &&
+	test -f index-hl/*/highlight/$blob.c
+'
+
+test_expect_success 'serve the kept highlighting' '
+	hl_url "hl/tree/hello.c" >tmp &&
+	grep "^<span class=.hl-c.>/\* comment \*/</span>$" tmp
+'
+
+test_expect_success 'highlight shell' '
+	touch -t 200001010000 index-hl/*/highlight/* &&
+	hl_url "hl/tree/build.sh" >tmp &&
+	grep "<code><span class=.hl-k.>for</span> x <span class=.hl-k.>in</span> a; <span class=.hl-k.>do</span>$" tmp &&
+	grep "echo <span class=.hl-s.>\"\$x\"</span> <span class=.hl-c.># c</span>$" tmp
+'
+
+test_expect_success 'drop the least recently used highlighting' '
+	blob=$(git -C repos/hl rev-parse master:build.sh) &&
+	ls index-hl/*/highlight >actual &&
+	echo "$blob.shell" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'show other files as text' '
+	hl_url "hl/tree/notes.txt" >tmp &&
+	grep "<code>plain &lt;text&gt; int$" tmp
+'
+
+test_done
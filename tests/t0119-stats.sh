@@ -0,0 +1,98 @@
+#!/bin/sh
+
+test_description='Check content on stats page'
+. ./setup.sh
+
+walk_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-stats-walk" QUERY_STRING="$1" cgit
+}
+
+index_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-stats" QUERY_STRING="$1" cgit
+}
+
+add_commit()
+{
+	echo "$1" >>repos/stats/file &&
+	git -C repos/stats add file &&
+	GIT_AUTHOR_NAME="$1" GIT_AUTHOR_DATE="$now +0000" \
+	GIT_COMMITTER_DATE="$now +0000" \
+		git -C repos/stats commit -q -m "$1"
+}
+
+# An author row of the week stats with all commits in the current week.
+row()
+{
+	printf "<tr><td class='left'>%s</td>" "$1"
+	printf "<td>0</td>%.0s" $(test_seq 11)
+	printf "<td>%d</td><td class='sum'>%d</td></tr>" "$2" "$2"
+}
+
+test_expect_success 'set up repository with recent commits' '
+	now=$(date +%s) &&
+	test_create_repo repos/stats &&
+	add_commit Alice &&
+	add_commit Alice &&
+	add_commit Bob &&
+	cat >cgitrc-stats-walk <<-EOF &&
+	virtual-root=/
+	cache-size=0
+	max-stats=year
+	repo.url=stats
+	repo.path=$PWD/repos/stats/.git
+	EOF
+	{
+		echo "index-root=$PWD/index-stats" &&
+		cat cgitrc-stats-walk
+	} >cgitrc-stats
+'
+
+test_expect_success 'count commits by walking the history' '
+	walk_query "url=stats/stats" >tmp &&
+	grep -F "$(row Alice 2)" tmp &&
+	grep -F "$(row Bob 1)" tmp &&
+	grep "<td class=.sum.>3</td></tr></table>" tmp
+'
+
+test_expect_success 'count commits from the index' '
+	index_query "url=stats/stats" >tmp &&
+	grep -F "$(row Alice 2)" tmp &&
+	grep -F "$(row Bob 1)" tmp &&
+	head=$(git -C repos/stats rev-parse HEAD) &&
+	head -n 1 index-stats/*/stats/master | grep " $head$"
+'
+
+test_expect_success 'extend the index with new commits' '
+	add_commit Bob &&
+	add_commit Bob &&
+	index_query "url=stats/stats" >tmp &&
+	grep -F "$(row Bob 3)" tmp &&
+	grep -F "$(row Alice 2)" tmp &&
+	head=$(git -C repos/stats rev-parse HEAD) &&
+	head -n 1 index-stats/*/stats/master | grep " $head$"
+'
+
+test_expect_success 'rebuild the index when the head is rewound' '
+	git -C repos/stats reset -q --hard HEAD~2 &&
+	index_query "url=stats/stats" >tmp &&
+	grep -F "$(row Bob 1)" tmp &&
+	grep -F "$(row Alice 2)" tmp
+'
+
+test_expect_success 'combine the authors past the limit' '
+	index_query "url=stats/stats&ofs=1" >tmp &&
+	grep -F "$(row Alice 2)" tmp &&
+	! grep -F ">Bob<" tmp &&
+	grep "<td class=.left.>Others (1)</td>" tmp
+'
+
+test_expect_success 'count commits per year' '
+	walk_query "url=stats/stats&period=y" >expect &&
+	index_query "url=stats/stats&period=y" >actual &&
+	test_cmp expect actual &&
+	grep -F "$(row Alice 2)" actual
+'
+
+test_done
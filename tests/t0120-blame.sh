@@ -0,0 +1,128 @@
+#!/bin/sh
+
+test_description='Check content on blame page'
+. ./setup.sh
+
+walk_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-blame" QUERY_STRING="$1" cgit
+}
+
+index_query()
+{
+	CGIT_CONFIG="$PWD/cgitrc-blame-index" QUERY_STRING="$1" cgit
+}
+
+# Compare the blame of file.txt in commit $1, with the query string
+# suffix $2, as derived from the index and as computed from scratch.
+compare_blame()
+{
+	walk_query "url=bl/blame/file.txt&id=$1$2" >expect &&
+	index_query "url=bl/blame/file.txt&id=$1$2" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'set up repository with a changing file' '
+	test_create_repo repos/bl &&
+	test_seq 10 | sed "s/^/line /" >repos/bl/file.txt &&
+	git -C repos/bl add file.txt &&
+	git -C repos/bl commit -q -m "add file" &&
+	c1=$(git -C repos/bl rev-parse HEAD) &&
+	sed -e "3d" -e "5a\\
+inserted" -e "s/^line 8$/changed 8/" \
+		<repos/bl/file.txt >file.new &&
+	mv file.new repos/bl/file.txt &&
+	git -C repos/bl commit -q -a -m "change middle" &&
+	c2=$(git -C repos/bl rev-parse HEAD) &&
+	sed -e "1d" <repos/bl/file.txt >file.new &&
+	echo "appended" >>file.new &&
+	mv file.new repos/bl/file.txt &&
+	git -C repos/bl commit -q -a -m "change ends" &&
+	c3=$(git -C repos/bl rev-parse HEAD) &&
+	cat >cgitrc-blame <<-EOF &&
+	virtual-root=/
+	cache-size=0
+	enable-blame=1
+	repo.url=bl
+	repo.path=$PWD/repos/bl/.git
+	EOF
+	{
+		echo "index-root=$PWD/index-blame" &&
+		cat cgitrc-blame
+	} >cgitrc-blame-index
+'
+
+test_expect_success 'blame the first commit' '
+	compare_blame $c1 &&
+	grep "line 10" actual &&
+	ls index-blame/*/blame/$c1 >files &&
+	test_line_count = 1 files
+'
+
+test_expect_success 'derive the blame of a child commit' '
+	compare_blame $c2 &&
+	grep "changed 8" actual &&
+	grep "inserted" actual &&
+	! grep "line 3" actual &&
+	ls index-blame/*/blame/$c2 >files &&
+	test_line_count = 1 files
+'
+
+test_expect_success 'derive the blame of a grandchild commit' '
+	compare_blame $c3 &&
+	grep "appended" actual &&
+	! grep "line 1$" actual
+'
+
+test_expect_success 'blame suspects of all commits' '
+	c1_abbrev=$(git -C repos/bl rev-parse --short $c1) &&
+	c2_abbrev=$(git -C repos/bl rev-parse --short $c2) &&
+	c3_abbrev=$(git -C repos/bl rev-parse --short $c3) &&
+	grep ">$c1_abbrev</a>" actual &&
+	grep ">$c2_abbrev</a>" actual &&
+	grep ">$c3_abbrev</a>" actual
+'
+
+test_expect_success 'serve the stored blame' '
+	index_query "url=bl/blame/file.txt&id=$c3" >again &&
+	test_cmp actual again
+'
+
+test_expect_success 'blame a range of lines' '
+	compare_blame $c3 "&lines=2-4" &&
+	grep "(lines 2-4 of 10, " actual
+'
+
+test_expect_success 'blame lines up to the end' '
+	compare_blame $c3 "&lines=8-" &&
+	grep "(lines 8-10 of 10, " actual &&
+	grep "appended" actual
+'
+
+test_expect_success 'blame all lines for an invalid range' '
+	compare_blame $c3 "&lines=5-2" &&
+	! grep "(lines " actual &&
+	index_query "url=bl/blame/file.txt&id=$c3" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'render one block per run of lines of a suspect' '
+	index_query "url=bl/blame/file.txt&id=$c3" >tmp &&
+	grep -o "<div class=.alt.><pre>" tmp >blocks &&
+	test_line_count = 18 blocks &&
+	grep ">$c1_abbrev</a>" tmp >runs &&
+	test_line_count = 3 runs &&
+	grep ">$c2_abbrev</a>" tmp >runs &&
+	test_line_count = 2 runs &&
+	grep ">$c3_abbrev</a>" tmp >runs &&
+	test_line_count = 1 runs
+'
+
+test_expect_success 'number all lines of the blame' '
+	grep -o "<a id=.n[0-9]*. href=.#n[0-9]*.>[0-9]*</a>" tmp >numbers &&
+	test_line_count = 10 numbers &&
+	head -n 1 numbers | grep ">1</a>" &&
+	tail -n 1 numbers | grep ">10</a>"
+'
+
+test_done
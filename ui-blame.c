@@ -5,6 +5,17 @@
  *
  * Licensed under GNU General Public License v2
  *   (see COPYING for full license text)
+ *
+ *
+ * Blame results are stored below index-root as "blame/<commit>/<path
+ * hash>", one "<suspect> <line> <count> <suspect path>" line per block
+ * of lines. When the blamed commit has a single parent whose blame of
+ * the same path is already stored and no textconv driver applies to
+ * the path, the result is derived from it and the diff between both
+ * blobs instead of walking the history again:
+ * lines the diff leaves alone keep their parent's suspect and every
+ * other line belongs to the commit itself. At most index-cache-size
+ * results are kept, the least recently used are dropped first.
  */
 
 #define USE_THE_REPOSITORY_VARIABLE
@@ -13,114 +24,589 @@
 #include "ui-blame.h"
 #include "html.h"
 #include "ui-shared.h"
+#include "repo-cache.h"
+#include "strmap.h"
 #include "strvec.h"
 #include "blame.h"
+#include "object-file.h"
+#include "tree-walk.h"
+#include "userdiff.h"
+
+/* Bump whenever the format of stored blame results changes. */
+#define BLAME_INDEX_VERSION "blame 1"
+
+/* A run of lines of the final file blamed on the same suspect. */
+struct blame_block {
+	struct commit *commit;
+	char *path;
+	unsigned long lno;	/* first line, counting from 0 */
+	unsigned long num_lines;
+};
+
+struct blame_result {
+	struct blame_block *blocks;
+	size_t nr, alloc;
+};
+
+static void add_block(struct blame_result *res, struct commit *commit,
+		      const char *path, unsigned long lno,
+		      unsigned long num_lines)
+{
+	struct blame_block *b = res->nr ? &res->blocks[res->nr - 1] : NULL;
+
+	if (b && b->commit == commit && b->lno + b->num_lines == lno &&
+	    !strcmp(b->path, path)) {
+		b->num_lines += num_lines;
+		return;
+	}
+	ALLOC_GROW(res->blocks, res->nr + 1, res->alloc);
+	b = &res->blocks[res->nr++];
+	b->commit = commit;
+	b->path = xstrdup(path);
+	b->lno = lno;
+	b->num_lines = num_lines;
+}
+
+static void clear_blame_result(struct blame_result *res)
+{
+	size_t i;
+
+	for (i = 0; i < res->nr; i++)
+		free(res->blocks[i].path);
+	FREE_AND_NULL(res->blocks);
+	res->nr = res->alloc = 0;
+}
+
+/* Number of lines in `buf`, counting an unterminated last line. */
+static unsigned long count_lines(const char *buf, unsigned long size)
+{
+	unsigned long n = 0;
+	const char *p = buf, *end = buf + size;
+
+	while (p < end && (p = memchr(p, '\n', end - p))) {
+		n++;
+		p++;
+	}
+	if (size && buf[size - 1] != '\n')
+		n++;
+	return n;
+}
+
+static const char *nth_line(const char *buf, unsigned long size,
+			    unsigned long n)
+{
+	const char *p = buf, *end = buf + size;
+
+	while (n-- && p < end) {
+		p = memchr(p, '\n', end - p);
+		p = p ? p + 1 : end;
+	}
+	return p;
+}
+
+/* Blame lines [start, end) of `path` in `commit`, or the whole file if
+ * `end` is 0.
+ */
+static void run_blame(struct blame_result *res, struct commit *commit,
+		      const char *path, unsigned long start, unsigned long end)
+{
+	struct strvec rev_argv = STRVEC_INIT;
+	struct rev_info revs;
+	struct blame_scoreboard sb;
+	struct blame_origin *o;
+	struct blame_entry *ent;
+
+	strvec_push(&rev_argv, "blame");
+	strvec_push(&rev_argv, oid_to_hex(&commit->object.oid));
+	repo_init_revisions(the_repository, &revs, NULL);
+	revs.diffopt.flags.allow_textconv = 1;
+	setup_revisions(rev_argv.nr, rev_argv.v, &revs, NULL);
+	init_scoreboard(&sb);
+	sb.revs = &revs;
+	sb.repo = the_repository;
+	sb.path = path;
+	setup_scoreboard(&sb, &o);
+	if (!end || end > sb.num_lines)
+		end = sb.num_lines;
+	if (start < end)
+		o->suspects = blame_entry_prepend(NULL, start, end, o);
+	prio_queue_put(&sb.commits, o->commit);
+	blame_origin_decref(o);
+	sb.ent = NULL;
+	sb.path = path;
+	assign_blame(&sb, 0);
+	blame_sort_final(&sb);
+	blame_coalesce(&sb);
+
+	for (ent = sb.ent; ent; ) {
+		struct blame_entry *e = ent->next;
+
+		add_block(res, ent->suspect->commit, ent->suspect->path,
+			  ent->lno, ent->num_lines);
+		free(ent);
+		ent = e;
+	}
+	free((void *)sb.final_buf);
+	strvec_clear(&rev_argv);
+}
+
+static char *blame_index_name(const struct object_id *commit,
+			      const char *path)
+{
+	struct object_id path_oid;
 
+	hash_object_file(the_hash_algo, path, strlen(path), OBJ_BLOB,
+			 &path_oid);
+	return xstrfmt("blame/%s/%s", oid_to_hex(commit),
+		       oid_to_hex(&path_oid));
+}
 
-static char *emit_suspect_detail(struct blame_origin *suspect)
+static int parse_blame_block(struct blame_result *res, const char *line,
+			     const char *end)
+{
+	struct object_id oid;
+	const char *p;
+	char *q, *path;
+	unsigned long lno, num_lines;
+	struct commit *commit;
+
+	if (parse_oid_hex(line, &oid, &p) || *p++ != ' ')
+		return -1;
+	lno = strtoul(p, &q, 10);
+	if (*q++ != ' ')
+		return -1;
+	num_lines = strtoul(q, &q, 10);
+	if (*q++ != ' ' || q >= end || !num_lines)
+		return -1;
+	if (lno != (res->nr ? res->blocks[res->nr - 1].lno +
+		    res->blocks[res->nr - 1].num_lines : 0))
+		return -1;
+	commit = lookup_commit(the_repository, &oid);
+	if (!commit)
+		return -1;
+	path = xmemdupz(q, end - q);
+	add_block(res, commit, path, lno, num_lines);
+	free(path);
+	return 0;
+}
+
+static int read_blame_index(struct blame_result *res,
+			    const struct object_id *commit, const char *path)
+{
+	struct repo_cache_map map;
+	char *name = blame_index_name(commit, path);
+	const char *p, *end, *eol;
+	int ret = 0;
+
+	if (repo_cache_open(&map, name, BLAME_INDEX_VERSION)) {
+		free(name);
+		return -1;
+	}
+	p = map.buf;
+	end = map.buf + map.len;
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol || parse_blame_block(res, p, eol)) {
+			ret = -1;
+			break;
+		}
+		p = eol + 1;
+	}
+	repo_cache_close(&map);
+	free(name);
+	if (ret)
+		clear_blame_result(res);
+	return ret;
+}
+
+static void store_blame_index(const struct blame_result *res,
+			      const struct object_id *commit, const char *path)
+{
+	struct strbuf buf = STRBUF_INIT;
+	char *name;
+	size_t i;
+
+	for (i = 0; i < res->nr; i++) {
+		const struct blame_block *b = &res->blocks[i];
+
+		if (strchr(b->path, '\n')) {
+			strbuf_release(&buf);
+			return;
+		}
+		strbuf_addf(&buf, "%s %lu %lu %s\n",
+			    oid_to_hex(&b->commit->object.oid), b->lno,
+			    b->num_lines, b->path);
+	}
+	name = blame_index_name(commit, path);
+	repo_cache_store_bounded(name, BLAME_INDEX_VERSION, buf.buf, buf.len);
+	free(name);
+	strbuf_release(&buf);
+}
+
+struct blame_hunk {
+	long start_a, count_a, start_b, count_b;
+};
+
+struct blame_hunks {
+	struct blame_hunk *items;
+	size_t nr, alloc;
+};
+
+static int collect_hunk(long start_a, long count_a, long start_b,
+			long count_b, void *data)
+{
+	struct blame_hunks *hunks = data;
+	struct blame_hunk *h;
+
+	ALLOC_GROW(hunks->items, hunks->nr + 1, hunks->alloc);
+	h = &hunks->items[hunks->nr++];
+	h->start_a = start_a;
+	h->count_a = count_a;
+	h->start_b = start_b;
+	h->count_b = count_b;
+	return 0;
+}
+
+/* Derive the blame of `path` in `commit` from the stored blame of its
+ * only parent. Returns -1 if there is no such blame to start from.
+ */
+static int derive_blame(struct blame_result *res, struct commit *commit,
+			const char *path, char *buf, unsigned long size)
+{
+	struct blame_result prev = { 0 };
+	struct blame_hunks hunks = { 0 };
+	struct commit *parent;
+	struct object_id oid;
+	unsigned short mode;
+	enum object_type type;
+	char *pbuf = NULL;
+	unsigned long psize, na, nb, a = 0, b = 0;
+	size_t i, k = 0;
+	mmfile_t file1, file2;
+	xpparam_t diff_params;
+	xdemitconf_t emit_params;
+	xdemitcb_t emit_cb;
+	int ret = -1;
+
+	if (!commit->parents || commit->parents->next)
+		return -1;
+	parent = commit->parents->item;
+	if (repo_parse_commit(the_repository, parent) ||
+	    get_tree_entry(the_repository, get_commit_tree_oid(parent), path,
+			   &oid, &mode) || !S_ISREG(mode))
+		return -1;
+	if (read_blame_index(&prev, &parent->object.oid, path))
+		return -1;
+	pbuf = repo_read_object_file(the_repository, &oid, &type, &psize);
+	if (!pbuf)
+		goto out;
+	na = count_lines(pbuf, psize);
+	nb = count_lines(buf, size);
+	if (na != (prev.nr ? prev.blocks[prev.nr - 1].lno +
+		   prev.blocks[prev.nr - 1].num_lines : 0))
+		goto out;
+
+	file1.ptr = pbuf;
+	file1.size = psize;
+	file2.ptr = buf;
+	file2.size = size;
+	memset(&diff_params, 0, sizeof(diff_params));
+	memset(&emit_params, 0, sizeof(emit_params));
+	memset(&emit_cb, 0, sizeof(emit_cb));
+	emit_params.hunk_func = collect_hunk;
+	emit_cb.priv = &hunks;
+	if (xdl_diff(&file1, &file2, &diff_params, &emit_params, &emit_cb))
+		goto out;
+	collect_hunk(na, 0, nb, 0, &hunks);
+
+	for (i = 0; i < hunks.nr; i++) {
+		const struct blame_hunk *h = &hunks.items[i];
+
+		/* Unchanged lines keep the suspect of the parent's line. */
+		while (b < (unsigned long)h->start_b && a < na) {
+			const struct blame_block *pb;
+			unsigned long n;
+
+			while (prev.blocks[k].lno + prev.blocks[k].num_lines <= a)
+				k++;
+			pb = &prev.blocks[k];
+			n = pb->lno + pb->num_lines - a;
+			if (n > h->start_b - b)
+				n = h->start_b - b;
+			add_block(res, pb->commit, pb->path, b, n);
+			a += n;
+			b += n;
+		}
+		if (h->count_b)
+			add_block(res, commit, path, b, h->count_b);
+		a += h->count_a;
+		b += h->count_b;
+	}
+	if (b != nb) {
+		clear_blame_result(res);
+		goto out;
+	}
+	ret = 0;
+out:
+	free(pbuf);
+	free(hunks.items);
+	clear_blame_result(&prev);
+	return ret;
+}
+
+/* run_blame() blames the output of a textconv driver rather than the
+ * blob, which derive_blame() could not diff the same way.
+ */
+static int has_textconv(const char *path)
+{
+	struct userdiff_driver *driver;
+
+	driver = userdiff_find_by_path(the_repository->index, path);
+	return driver && userdiff_get_textconv(the_repository, driver);
+}
+
+/* Get the blame of lines [start, end) of `path` in `commit`, or of the
+ * whole file when `end` is 0. Whole-file results are taken from or
+ * added to the blame index, partial ones are computed and thrown away
+ * unless the whole file is already known. Returns 1 if `res` holds the
+ * whole file.
+ */
+static int get_blame(struct blame_result *res, struct commit *commit,
+		     const char *path, char *buf, unsigned long size,
+		     unsigned long start, unsigned long end)
+{
+	if (repo_cache_enabled()) {
+		if (!read_blame_index(res, &commit->object.oid, path))
+			return 1;
+		if (!has_textconv(path) &&
+		    !derive_blame(res, commit, path, buf, size)) {
+			store_blame_index(res, &commit->object.oid, path);
+			return 1;
+		}
+	}
+	run_blame(res, commit, path, start, end);
+	if (end)
+		return 0;
+	if (repo_cache_enabled())
+		store_blame_index(res, &commit->object.oid, path);
+	return 1;
+}
+
+/* Parse the "lines" query, "<first>-<last>" counting from 1, into the
+ * range [start, end) of the `nr` lines of the file.
+ */
+static int parse_line_range(const char *arg, unsigned long nr,
+			    unsigned long *start, unsigned long *end)
+{
+	char *p;
+	unsigned long first, last;
+
+	if (!arg || !*arg)
+		return -1;
+	first = strtoul(arg, &p, 10);
+	last = first;
+	if (*p == '-') {
+		p++;
+		last = *p ? strtoul(p, &p, 10) : nr;
+	}
+	if (*p || !first || first > last || first > nr)
+		return -1;
+	*start = first - 1;
+	*end = last < nr ? last : nr;
+	return 0;
+}
+
+/* Keep the part of a whole-file blame covering lines [start, end). */
+static void slice_blame(struct blame_result *res, unsigned long start,
+			unsigned long end)
+{
+	size_t i, nr = 0;
+
+	for (i = 0; i < res->nr; i++) {
+		struct blame_block b = res->blocks[i];
+		unsigned long last = b.lno + b.num_lines;
+
+		if (last <= start || b.lno >= end) {
+			free(b.path);
+			continue;
+		}
+		if (b.lno < start)
+			b.lno = start;
+		if (last > end)
+			last = end;
+		b.num_lines = last - b.lno;
+		res->blocks[nr++] = b;
+	}
+	res->nr = nr;
+}
+
+static void format_suspect_detail(struct strbuf *detail,
+				  struct commit *commit)
 {
 	struct commitinfo *info;
-	struct strbuf detail = STRBUF_INIT;
 
-	info = cgit_parse_commit(suspect->commit);
+	info = cgit_parse_commit(commit);
 
-	strbuf_addf(&detail, "author  %s", info->author);
+	strbuf_addf(detail, "author  %s", info->author);
 	if (!ctx.cfg.noplainemail)
-		strbuf_addf(&detail, " %s", info->author_email);
-	strbuf_addf(&detail, "  %s\n",
+		strbuf_addf(detail, " %s", info->author_email);
+	strbuf_addf(detail, "  %s\n",
 		    show_date(info->author_date, info->author_tz,
 				    cgit_date_mode(DATE_ISO8601)));
 
-	strbuf_addf(&detail, "committer  %s", info->committer);
+	strbuf_addf(detail, "committer  %s", info->committer);
 	if (!ctx.cfg.noplainemail)
-		strbuf_addf(&detail, " %s", info->committer_email);
-	strbuf_addf(&detail, "  %s\n\n",
+		strbuf_addf(detail, " %s", info->committer_email);
+	strbuf_addf(detail, "  %s\n\n",
 		    show_date(info->committer_date, info->committer_tz,
 				    cgit_date_mode(DATE_ISO8601)));
 
-	strbuf_addstr(&detail, info->subject);
+	strbuf_addstr(detail, info->subject);
 
 	cgit_free_commitinfo(info);
-	return strbuf_detach(&detail, NULL);
 }
 
-static void emit_blame_entry_hash(struct blame_entry *ent)
+/* The hash column of a suspect, i.e. the commit link with its details
+ * as tooltip and the link to the blame of the previous revision. It is
+ * rendered once per suspect commit and path, however many blocks of
+ * lines are blamed on it.
+ */
+struct suspect_html {
+	size_t len;
+	char html[FLEX_ARRAY];
+};
+
+static const struct suspect_html *suspect_html(struct strmap *suspects,
+					       const struct blame_block *b)
 {
-	struct blame_origin *suspect = ent->suspect;
-	struct object_id *oid = &suspect->commit->object.oid;
-	unsigned long line = 0;
+	struct object_id *oid = &b->commit->object.oid;
+	struct strbuf key = STRBUF_INIT;
+	struct strbuf detail = STRBUF_INIT;
+	struct strbuf out = STRBUF_INIT;
+	struct suspect_html *entry;
+
+	strbuf_addf(&key, "%s %s", oid_to_hex(oid), b->path);
+	entry = strmap_get(suspects, key.buf);
+	if (entry) {
+		strbuf_release(&key);
+		return entry;
+	}
 
-	char *detail = emit_suspect_detail(suspect);
+	format_suspect_detail(&detail, b->commit);
+	html_begin_capture(&out);
 	html("<span class='oid'>");
-	cgit_commit_link(repo_find_unique_abbrev(the_repository, oid, DEFAULT_ABBREV), detail,
-			 NULL, ctx.qry.head, oid_to_hex(oid), suspect->path);
+	cgit_commit_link(repo_find_unique_abbrev(the_repository, oid, DEFAULT_ABBREV), detail.buf,
+			 NULL, ctx.qry.head, oid_to_hex(oid), b->path);
 	html("</span>");
-	free(detail);
-
-	if (!repo_parse_commit(the_repository, suspect->commit) && suspect->commit->parents) {
-		struct commit *parent = suspect->commit->parents->item;
+	if (!repo_parse_commit(the_repository, b->commit) && b->commit->parents) {
+		struct commit *parent = b->commit->parents->item;
 
 		html(" ");
 		cgit_blame_link("^", "Blame the previous revision", NULL,
 				ctx.qry.head, oid_to_hex(&parent->object.oid),
-				suspect->path);
+				b->path);
 	}
-
-	while (line++ < ent->num_lines)
-		html("\n");
+	html_end_capture();
+
+	FLEX_ALLOC_MEM(entry, html, out.buf, out.len);
+	entry->len = out.len;
+	strmap_put(suspects, key.buf, entry);
+	strbuf_release(&out);
+	strbuf_release(&detail);
+	strbuf_release(&key);
+	return entry;
 }
 
-static void emit_blame_entry_linenumber(struct blame_entry *ent)
-{
-	const char *numberfmt = "<a id='n%1$d' href='#n%1$d'>%1$d</a>\n";
-
-	unsigned long lineno = ent->lno;
-	while (lineno < ent->lno + ent->num_lines)
-		htmlf(numberfmt, ++lineno);
-}
+struct blame_columns {
+	struct strbuf hashes;
+	struct strbuf numbers;
+	struct strbuf bars;
+};
 
-static void emit_blame_entry_line_background(struct blame_scoreboard *sb,
-					     struct blame_entry *ent)
+/* Add a block to the hash, line number and background columns,
+ * advancing `pos` past its lines. Bars are padded to the width of the
+ * longest line of the block.
+ */
+static void add_block_columns(struct blame_columns *cols,
+			      struct strmap *suspects,
+			      const struct blame_block *b,
+			      const char **pos, const char *end)
 {
+	const struct suspect_html *suspect = suspect_html(suspects, b);
 	unsigned long line;
 	size_t len, maxlen = 2;
-	const char* pos, *endpos;
+	const char *p = *pos;
+
+	strbuf_addstr(&cols->hashes, "<div class='alt'><pre>");
+	strbuf_add(&cols->hashes, suspect->html, suspect->len);
+	strbuf_addchars(&cols->hashes, '\n', b->num_lines);
+	strbuf_addstr(&cols->hashes, "</pre></div>");
 
-	for (line = ent->lno; line < ent->lno + ent->num_lines; line++) {
-		html("\n");
-		pos = blame_nth_line(sb, line);
-		endpos = blame_nth_line(sb, line + 1);
+	if (ctx.cfg.enable_tree_linenumbers) {
+		strbuf_addstr(&cols->numbers, "<div class='alt'><pre>");
+		for (line = b->lno + 1; line <= b->lno + b->num_lines; line++)
+			strbuf_addf(&cols->numbers,
+				    "<a id='n%1$lu' href='#n%1$lu'>%1$lu</a>\n",
+				    line);
+		strbuf_addstr(&cols->numbers, "</pre></div>");
+	}
+
+	strbuf_addstr(&cols->bars, "<div class='alt'><pre>");
+	for (line = 0; line < b->num_lines; line++) {
+		strbuf_addch(&cols->bars, '\n');
 		len = 0;
-		while (pos < endpos) {
+		while (p < end) {
+			char c = *p++;
+
 			len++;
-			if (*pos++ == '\t')
+			if (c == '\t')
 				len = (len + 7) & ~7;
+			else if (c == '\n')
+				break;
 		}
 		if (len > maxlen)
 			maxlen = len;
 	}
-
-	for (len = 0; len < maxlen - 1; len++)
-		html(" ");
+	strbuf_addchars(&cols->bars, ' ', maxlen - 1);
+	strbuf_addstr(&cols->bars, "</pre></div>");
+	*pos = p;
 }
 
 struct walk_tree_context {
 	char *curr_rev;
+	struct commit *commit;
 	int match_baselen;
 	int state;
 };
 
+static void print_blob_header(const struct object_id *oid, const char *path,
+			      const char *rev)
+{
+	cgit_set_title_from_path(path);
+
+	cgit_print_layout_start();
+	htmlf("blob: %s (", oid_to_hex(oid));
+	cgit_plain_link("plain", NULL, NULL, ctx.qry.head, rev, path);
+	html(") (");
+	cgit_tree_link("tree", NULL, NULL, ctx.qry.head, rev, path);
+	html(")");
+}
+
 static void print_object(const struct object_id *oid, const char *path,
-			 const char *basename, const char *rev)
+			 const char *basename, const char *rev,
+			 struct commit *commit)
 {
 	enum object_type type;
 	char *buf;
-	unsigned long size;
-	struct strvec rev_argv = STRVEC_INIT;
-	struct rev_info revs;
-	struct blame_scoreboard sb;
-	struct blame_origin *o;
-	struct blame_entry *ent = NULL;
+	const char *pos, *text, *text_end;
+	unsigned long size, nr_lines, nr_shown, start, end;
+	struct blame_result res = { 0 };
+	struct blame_columns cols = {
+		STRBUF_INIT, STRBUF_INIT, STRBUF_INIT
+	};
+	struct strmap suspects = STRMAP_INIT;
+	int ranged, whole;
+	size_t i;
 
 	type = oid_object_info(the_repository, oid, &size);
 	if (type == OBJ_BAD) {
@@ -129,6 +615,16 @@ static void print_object(const struct object_id *oid, const char *path,
 		return;
 	}
 
+	/* Refuse oversized and binary blobs before doing any blame work. */
+	if (ctx.cfg.max_blob_size && size / 1024 > ctx.cfg.max_blob_size) {
+		print_blob_header(oid, path, rev);
+		htmlf("\n<div class='error'>blob size (%ldKB)"
+		      " exceeds display size limit (%dKB).</div>",
+		      size / 1024, ctx.cfg.max_blob_size);
+		cgit_print_layout_end();
+		return;
+	}
+
 	buf = repo_read_object_file(the_repository, oid, &type, &size);
 	if (!buf) {
 		cgit_print_error_page(500, "Internal server error",
@@ -136,64 +632,51 @@ static void print_object(const struct object_id *oid, const char *path,
 		return;
 	}
 
-	strvec_push(&rev_argv, "blame");
-	strvec_push(&rev_argv, rev);
-	repo_init_revisions(the_repository, &revs, NULL);
-	revs.diffopt.flags.allow_textconv = 1;
-	setup_revisions(rev_argv.nr, rev_argv.v, &revs, NULL);
-	init_scoreboard(&sb);
-	sb.revs = &revs;
-	sb.repo = the_repository;
-	sb.path = path;
-	setup_scoreboard(&sb, &o);
-	o->suspects = blame_entry_prepend(NULL, 0, sb.num_lines, o);
-	prio_queue_put(&sb.commits, o->commit);
-	blame_origin_decref(o);
-	sb.ent = NULL;
-	sb.path = path;
-	assign_blame(&sb, 0);
-	blame_sort_final(&sb);
-	blame_coalesce(&sb);
-
-	cgit_set_title_from_path(path);
-
-	cgit_print_layout_start();
-	htmlf("blob: %s (", oid_to_hex(oid));
-	cgit_plain_link("plain", NULL, NULL, ctx.qry.head, rev, path);
-	html(") (");
-	cgit_tree_link("tree", NULL, NULL, ctx.qry.head, rev, path);
-	html(")\n");
-
+	print_blob_header(oid, path, rev);
 	if (buffer_is_binary(buf, size)) {
-		html("<div class='error'>blob is binary.</div>");
+		html("\n<div class='error'>blob is binary.</div>");
 		goto cleanup;
 	}
-	if (ctx.cfg.max_blob_size && size / 1024 > ctx.cfg.max_blob_size) {
-		htmlf("<div class='error'>blob size (%ldKB)"
-		      " exceeds display size limit (%dKB).</div>",
-		      size / 1024, ctx.cfg.max_blob_size);
-		goto cleanup;
+
+	nr_lines = count_lines(buf, size);
+	ranged = !parse_line_range(ctx.qry.lines, nr_lines, &start, &end);
+	if (!ranged) {
+		start = 0;
+		end = nr_lines;
+	}
+	whole = get_blame(&res, commit, path, buf, size, start,
+			  ranged ? end : 0);
+	if (whole && ranged)
+		slice_blame(&res, start, end);
+
+	if (ranged) {
+		htmlf(" (lines %lu-%lu of %lu, ", start + 1, end, nr_lines);
+		cgit_blame_link("full blame", NULL, NULL, ctx.qry.head, rev,
+				path);
+		html(")");
 	}
+	html("\n");
 
 	html("<table class='blame blob'>\n<tr>\n");
 
-	/* Commit hashes */
+	/* Render all columns in a single pass over the blocks. */
+	nr_shown = end - start;
+	strbuf_grow(&cols.hashes, res.nr * 256 + nr_shown);
+	if (ctx.cfg.enable_tree_linenumbers)
+		strbuf_grow(&cols.numbers, nr_shown * 48);
+	strbuf_grow(&cols.bars, res.nr * 64 + nr_shown);
+	text = pos = nth_line(buf, size, start);
+	for (i = 0; i < res.nr; i++)
+		add_block_columns(&cols, &suspects, &res.blocks[i], &pos,
+				  buf + size);
+
 	html("<td class='hashes'>");
-	for (ent = sb.ent; ent; ent = ent->next) {
-		html("<div class='alt'><pre>");
-		emit_blame_entry_hash(ent);
-		html("</pre></div>");
-	}
+	html_raw(cols.hashes.buf, cols.hashes.len);
 	html("</td>\n");
 
-	/* Line numbers */
 	if (ctx.cfg.enable_tree_linenumbers) {
 		html("<td class='linenumbers'>");
-		for (ent = sb.ent; ent; ent = ent->next) {
-			html("<div class='alt'><pre>");
-			emit_blame_entry_linenumber(ent);
-			html("</pre></div>");
-		}
+		html_raw(cols.numbers.buf, cols.numbers.len);
 		html("</td>\n");
 	}
 
@@ -201,28 +684,22 @@ static void print_object(const struct object_id *oid, const char *path,
 
 	/* Colored bars behind lines */
 	html("<div>");
-	for (ent = sb.ent; ent; ) {
-		struct blame_entry *e = ent->next;
-		html("<div class='alt'><pre>");
-		emit_blame_entry_line_background(&sb, ent);
-		html("</pre></div>");
-		free(ent);
-		ent = e;
-	}
+	html_raw(cols.bars.buf, cols.bars.len);
 	html("</div>");
-
-	free((void *)sb.final_buf);
+	text_end = ranged ? pos : buf + size;
 
 	/* Lines */
 	html("<pre><code>");
 	if (ctx.repo->source_filter) {
 		char *filter_arg = xstrdup(basename);
+		if (!ranged)
+			cgit_set_filter_blob(ctx.repo->source_filter, oid);
 		cgit_open_filter(ctx.repo->source_filter, filter_arg);
-		html_raw(buf, size);
+		html_raw(text, text_end - text);
 		cgit_close_filter(ctx.repo->source_filter);
 		free(filter_arg);
 	} else {
-		html_txt(buf);
+		html_ntxt(text, text_end - text);
 	}
 	html("</code></pre>");
 
@@ -230,9 +707,13 @@ static void print_object(const struct object_id *oid, const char *path,
 
 	html("</tr>\n</table>\n");
 
-	cgit_print_layout_end();
-
 cleanup:
+	cgit_print_layout_end();
+	strbuf_release(&cols.hashes);
+	strbuf_release(&cols.numbers);
+	strbuf_release(&cols.bars);
+	strmap_clear(&suspects, 1);
+	clear_blame_result(&res);
 	free(buf);
 }
 
@@ -247,7 +728,8 @@ static int walk_tree(const struct object_id *oid, struct strbuf *base,
 			strbuf_addbuf(&buffer, base);
 			strbuf_addstr(&buffer, pathname);
 			print_object(oid, buffer.buf, pathname,
-				     walk_tree_ctx->curr_rev);
+				     walk_tree_ctx->curr_rev,
+				     walk_tree_ctx->commit);
 			strbuf_release(&buffer);
 			walk_tree_ctx->state = 1;
 		} else if (S_ISDIR(mode)) {
@@ -303,6 +785,7 @@ void cgit_print_blame(void)
 	}
 
 	walk_tree_ctx.curr_rev = xstrdup(rev);
+	walk_tree_ctx.commit = commit;
 	walk_tree_ctx.match_baselen = (path_items.match) ?
 				       basedir_len(path_items.match) : -1;
 
@@ -122,7 +122,8 @@ done:
 	return -1;
 }
 
-int cgit_print_file(char *path, const char *head, int file_only)
+int cgit_print_file(char *path, const char *head, int file_only,
+		    struct object_id *blob)
 {
 	struct object_id oid;
 	enum object_type type;
@@ -163,6 +164,8 @@ int cgit_print_file(char *path, const char *head, int file_only)
 	buf[size] = '\0';
 	html_raw(buf, size);
 	free(buf);
+	if (blob)
+		oidcpy(blob, &oid);
 	return 0;
 }
 
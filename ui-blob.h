@@ -4,7 +4,8 @@
 extern int cgit_ref_path_exists(const char *path, const char *ref, int file_only);
 extern int cgit_ref_read_file(const char *path, const char *head, int file_only,
 			      char **buf, unsigned long *size);
-extern int cgit_print_file(char *path, const char *head, int file_only);
+extern int cgit_print_file(char *path, const char *head, int file_only,
+			   struct object_id *blob);
 extern void cgit_print_blob(const char *hex, char *path, const char *head, int file_only);
 
 #endif /* UI_BLOB_H */
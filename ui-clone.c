@@ -14,24 +14,65 @@
 #include "ui-clone.h"
 #include "html.h"
 #include "ui-shared.h"
+#include "ref-snapshot.h"
+#include "repo-cache.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "parse.h"
+#include "pkt-line.h"
+#include "protocol.h"
+#include "serve.h"
+#include "upload-pack.h"
+#include <zlib.h>
 
-static int print_ref_info(const char *refname, const struct object_id *oid,
-                          int flags, void *cb_data)
+/* Bump whenever the format of info/refs changes. */
+#define INFO_REFS_VERSION "info-refs 1"
+
+static int print_ref_info(const struct cgit_ref_entry *ref, void *cb_data)
 {
-	struct object *obj;
+	htmlf("%s\t%s\n", oid_to_hex(&ref->oid), ref->refname);
+	if (!oideq(&ref->oid, &ref->peeled))
+		htmlf("%s\t%s^{}\n", oid_to_hex(&ref->peeled), ref->refname);
+	return 0;
+}
 
-	if (!(obj = parse_object(the_repository, oid)))
-		return 0;
+/*
+ * Dumb clients poll info/refs a lot, so with index-root the list is kept
+ * for as long as no ref changes and is then sent out as it is.
+ */
+static void print_info_refs(void)
+{
+	struct strbuf buf = STRBUF_INIT;
+	char *token;
+	off_t offset, size;
+	int fd;
+
+	if (!repo_cache_enabled()) {
+		cgit_print_http_headers();
+		cgit_for_each_snapshot_ref("refs/", print_ref_info, NULL);
+		return;
+	}
 
-	htmlf("%s\t%s\n", oid_to_hex(oid), refname);
-	if (obj->type == OBJ_TAG) {
-		if (!(obj = deref_tag(the_repository, obj, refname, 0)))
-			return 0;
-		htmlf("%s\t%s^{}\n", oid_to_hex(&obj->oid), refname);
+	token = xstrfmt("%s %s", INFO_REFS_VERSION, repo_cache_refs_token());
+	fd = repo_cache_open_fd("info-refs", token, &offset, &size);
+	if (fd >= 0) {
+		ctx.page.size = size - offset;
+		cgit_print_http_headers();
+		html_sendfile(fd, offset, size);
+		close(fd);
+		free(token);
+		return;
 	}
-	return 0;
+
+	html_begin_capture(&buf);
+	cgit_for_each_snapshot_ref("refs/", print_ref_info, NULL);
+	html_end_capture();
+	ctx.page.size = buf.len;
+	cgit_print_http_headers();
+	html_raw(buf.buf, buf.len);
+	repo_cache_store("info-refs", token, buf.buf, buf.len);
+	strbuf_release(&buf);
+	free(token);
 }
 
 static void print_pack_info(void)
@@ -80,6 +121,157 @@ static void send_file(const char *path)
 	html_include(path);
 }
 
+int cgit_clone_is_smart(void)
+{
+	if (!ctx.cfg.enable_smart_http)
+		return 0;
+	if (ctx.qry.page && !strcmp(ctx.qry.page, "git-upload-pack"))
+		return 1;
+	return ctx.qry.service && !strcmp(ctx.qry.service, "git-upload-pack");
+}
+
+/*
+ * Smart HTTP, as served by git-http-backend: the client passes the
+ * protocol version it wants in a "Git-Protocol" header, which upload-pack
+ * expects in $GIT_PROTOCOL, and the response must never be cached.
+ */
+static void print_smart_http_headers(const char *mimetype)
+{
+	const char *protocol = getenv("HTTP_GIT_PROTOCOL");
+
+	if (protocol)
+		setenv("GIT_PROTOCOL", protocol, 1);
+	ctx.page.mimetype = mimetype;
+	ctx.page.charset = NULL;
+	ctx.page.expires = ctx.page.modified;
+	html("Cache-Control: no-cache, max-age=0, must-revalidate\n");
+	html("Pragma: no-cache\n");
+	cgit_print_http_headers();
+}
+
+static void advertise_upload_pack(void)
+{
+	print_smart_http_headers("application/x-git-upload-pack-advertisement");
+	switch (determine_protocol_version_server()) {
+	case protocol_v2:
+		protocol_v2_advertise_capabilities();
+		break;
+	case protocol_v1:
+		packet_write_fmt(1, "# service=git-upload-pack\n");
+		packet_flush(1);
+		packet_write_fmt(1, "version 1\n");
+		upload_pack(1, 1, 0);
+		break;
+	case protocol_v0:
+		packet_write_fmt(1, "# service=git-upload-pack\n");
+		packet_flush(1);
+		upload_pack(1, 1, 0);
+		break;
+	case protocol_unknown_version:
+		BUG("unknown protocol version");
+	}
+}
+
+/* Clients compress large requests; upload-pack wants them plain on
+ * stdin, so inflate the body to a temporary file read from there. Like
+ * git-http-backend, refuse bodies which inflate to more than
+ * $GIT_HTTP_MAX_REQUEST_BUFFER bytes, 10MiB by default. Returns -1 for
+ * a bad body and -2 for one which is too large.
+ */
+static int inflate_request(void)
+{
+	unsigned char in[8192], out[8192];
+	unsigned long max = git_env_ulong("GIT_HTTP_MAX_REQUEST_BUFFER",
+					  10 * 1024 * 1024);
+	unsigned long total = 0;
+	FILE *tmp = tmpfile();
+	z_stream s;
+	ssize_t len;
+	size_t n;
+	int ret = Z_OK, err = -1;
+
+	if (!tmp)
+		return -1;
+	memset(&s, 0, sizeof(s));
+	if (inflateInit2(&s, 15 + 16) != Z_OK) {
+		fclose(tmp);
+		return -1;
+	}
+	while (ret != Z_STREAM_END && (len = xread(0, in, sizeof(in))) > 0) {
+		s.next_in = in;
+		s.avail_in = len;
+		do {
+			s.next_out = out;
+			s.avail_out = sizeof(out);
+			ret = inflate(&s, Z_NO_FLUSH);
+			if (ret != Z_OK && ret != Z_STREAM_END)
+				goto fail;
+			n = sizeof(out) - s.avail_out;
+			total += n;
+			if (total > max) {
+				err = -2;
+				goto fail;
+			}
+			if (fwrite(out, 1, n, tmp) != n)
+				goto fail;
+		} while (s.avail_in && ret != Z_STREAM_END);
+	}
+	if (ret != Z_STREAM_END || fflush(tmp) ||
+	    lseek(fileno(tmp), 0, SEEK_SET) < 0 ||
+	    dup2(fileno(tmp), 0) < 0)
+		goto fail;
+	inflateEnd(&s);
+	fclose(tmp);
+	return 0;
+fail:
+	inflateEnd(&s);
+	fclose(tmp);
+	return err;
+}
+
+void cgit_clone_upload_pack(void)
+{
+	const char *type = getenv("CONTENT_TYPE");
+	const char *encoding = getenv("HTTP_CONTENT_ENCODING");
+
+	if (!ctx.cfg.enable_smart_http) {
+		cgit_print_error_page(404, "Not found", "Not found");
+		return;
+	}
+	if (!ctx.env.request_method ||
+	    strcmp(ctx.env.request_method, "POST")) {
+		cgit_print_error_page(405, "Method Not Allowed",
+				      "Method Not Allowed");
+		return;
+	}
+	if (!type || strcmp(type, "application/x-git-upload-pack-request")) {
+		cgit_print_error_page(415, "Unsupported Media Type",
+				      "Unsupported Media Type");
+		return;
+	}
+	if (encoding && (!strcmp(encoding, "gzip") ||
+			 !strcmp(encoding, "x-gzip"))) {
+		switch (inflate_request()) {
+		case 0:
+			break;
+		case -2:
+			cgit_print_error_page(413, "Request Entity Too Large",
+					      "Request body too large");
+			return;
+		default:
+			cgit_print_error_page(400, "Bad request",
+					      "Bad request body");
+			return;
+		}
+	}
+
+	print_smart_http_headers("application/x-git-upload-pack-result");
+	if (determine_protocol_version_server() == protocol_v2)
+		protocol_v2_serve_loop(1);
+	else
+		upload_pack(0, 1, 0);
+}
+
 void cgit_clone_info(void)
 {
 	if (!ctx.qry.path || strcmp(ctx.qry.path, "refs")) {
@@ -87,11 +279,17 @@ void cgit_clone_info(void)
 		return;
 	}
 
+	/* Without smart HTTP, clients asking for a service fall back to the
+	 * dumb protocol when they get the plain list of refs.
+	 */
+	if (cgit_clone_is_smart()) {
+		advertise_upload_pack();
+		return;
+	}
+
 	ctx.page.mimetype = "text/plain";
 	ctx.page.filename = "info/refs";
-	cgit_print_http_headers();
-	refs_for_each_ref(get_main_ref_store(the_repository),
-			  print_ref_info, NULL);
+	print_info_refs();
 }
 
 void cgit_clone_objects(void)
@@ -4,5 +4,9 @@
 void cgit_clone_info(void);
 void cgit_clone_objects(void);
 void cgit_clone_head(void);
+void cgit_clone_upload_pack(void);
+
+/* Whether the request is for smart HTTP, which must not be cached. */
+int cgit_clone_is_smart(void);
 
 #endif /* UI_CLONE_H */
@@ -44,8 +44,6 @@ void cgit_print_commit(char *hex, const char *prefix)
 
 	format_display_notes(&oid, &notes, PAGE_ENCODING, 1);
 
-	load_ref_decorations(NULL, DECORATE_FULL_REFS);
-
 	ctx.page.title = fmtalloc("%s - %s", info->subject, ctx.page.title);
 	cgit_print_layout_start();
 	cgit_print_diff_ctrls();
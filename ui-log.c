@@ -13,6 +13,7 @@
 #include "ui-log.h"
 #include "html.h"
 #include "ui-shared.h"
+#include "repo-cache.h"
 #include "strvec.h"
 
 static int files, add_lines, rem_lines, lines_counted;
@@ -57,54 +58,132 @@ static void inspect_files(struct diff_filepair *pair)
 				count_lines);
 }
 
-void show_commit_decorations(struct commit *commit)
+/*
+ * Reverse ref index used to decorate commits. Each line reads
+ * "<peeled oid>\t<kind><annotated>\t<refname>", sorted so that all
+ * refs pointing at a commit are adjacent and can be found with a
+ * binary search. Only the commits actually shown on a page are ever
+ * looked up, and peeling happens once when the index is built (using
+ * the peeled values from packed-refs where available).
+ */
+#define DECO_HEAD	'H'
+#define DECO_LOCAL	'b'
+#define DECO_REMOTE	'r'
+#define DECO_STASH	's'
+#define DECO_TAG	't'
+
+static struct repo_cache_map decorations;
+static int decorations_loaded;
+
+static int add_decoration(const char *refname, const struct object_id *oid,
+			  int flags, void *cb_data)
+{
+	struct string_list *lines = cb_data;
+	struct object_id peeled;
+	int kind, annotated = 0;
+
+	if (!strcmp(refname, "HEAD"))
+		kind = DECO_HEAD;
+	else if (starts_with(refname, "refs/heads/"))
+		kind = DECO_LOCAL;
+	else if (starts_with(refname, "refs/remotes/"))
+		kind = DECO_REMOTE;
+	else if (starts_with(refname, "refs/tags/"))
+		kind = DECO_TAG;
+	else if (!strcmp(refname, "refs/stash"))
+		kind = DECO_STASH;
+	else
+		/* Not displayed anyway, so don't bother indexing it. */
+		return 0;
+
+	if (!peel_iterated_oid(the_repository, oid, &peeled))
+		annotated = !oideq(oid, &peeled);
+	else
+		oidcpy(&peeled, oid);
+	string_list_append_nodup(lines, xstrfmt("%s\t%c%d\t%s\n",
+						oid_to_hex(&peeled), kind,
+						annotated, refname));
+	return 0;
+}
+
+static void load_decorations(void)
 {
-	const struct name_decoration *deco;
-	static char buf[1024];
+	struct string_list lines = STRING_LIST_INIT_NODUP;
+	struct string_list_item *item;
+	struct strbuf buf = STRBUF_INIT;
+	const char *token = NULL;
 
-	buf[sizeof(buf) - 1] = 0;
-	deco = get_name_decoration(&commit->object);
-	if (!deco)
+	if (decorations_loaded)
 		return;
+	decorations_loaded = 1;
+
+	if (repo_cache_enabled()) {
+		token = repo_cache_refs_token();
+		if (!repo_cache_open(&decorations, "decorations", token))
+			return;
+	}
+
+	refs_head_ref(get_main_ref_store(the_repository), add_decoration,
+		      &lines);
+	refs_for_each_ref(get_main_ref_store(the_repository), add_decoration,
+			  &lines);
+	string_list_sort(&lines);
+	for_each_string_list_item(item, &lines)
+		strbuf_addstr(&buf, item->string);
+	string_list_clear(&lines, 0);
+
+	if (token)
+		repo_cache_store("decorations", token, buf.buf, buf.len);
+	decorations.len = buf.len;
+	decorations.buf = strbuf_detach(&buf, NULL);
+}
+
+void show_commit_decorations(struct commit *commit)
+{
+	struct strbuf refname = STRBUF_INIT;
+	char hex[GIT_MAX_HEXSZ + 1];
+	const char *line, *end, *name;
+
+	load_decorations();
+	oid_to_hex_r(hex, &commit->object.oid);
+	line = repo_cache_lookup(decorations.buf, decorations.len, hex);
+	if (!line)
+		return;
+	end = decorations.buf + decorations.len;
 	html("<span class='decoration'>");
-	while (deco) {
-		struct object_id oid_tag, peeled;
-		int is_annotated = 0;
-
-		strlcpy(buf, prettify_refname(deco->name), sizeof(buf));
-		switch(deco->type) {
-		case DECORATION_NONE:
-			/* If the git-core doesn't recognize it,
-			 * don't display anything. */
-			break;
-		case DECORATION_REF_LOCAL:
-			cgit_log_link(buf, NULL, "branch-deco", buf, NULL,
+	for (; line; line = repo_cache_next(decorations.buf, decorations.len,
+					    line)) {
+		const char *kind = line + the_hash_algo->hexsz + 1;
+		const char *eol = memchr(kind, '\n', end - kind);
+
+		strbuf_reset(&refname);
+		strbuf_add(&refname, kind + 3, (eol ? eol : end) - kind - 3);
+		name = prettify_refname(refname.buf);
+		switch (*kind) {
+		case DECO_LOCAL:
+			cgit_log_link(name, NULL, "branch-deco", name, NULL,
 				ctx.qry.vpath, 0, NULL, NULL,
 				ctx.qry.showmsg, 0);
 			break;
-		case DECORATION_REF_TAG:
-			if (!refs_read_ref(get_main_ref_store(the_repository), deco->name, &oid_tag) &&
-			    !peel_iterated_oid(the_repository, &oid_tag, &peeled))
-				is_annotated = !oideq(&oid_tag, &peeled);
-			cgit_tag_link(buf, NULL, is_annotated ? "tag-annotated-deco" : "tag-deco", buf);
+		case DECO_TAG:
+			cgit_tag_link(name, NULL, kind[1] == '1' ?
+				      "tag-annotated-deco" : "tag-deco", name);
 			break;
-		case DECORATION_REF_REMOTE:
+		case DECO_REMOTE:
 			if (!ctx.repo->enable_remote_branches)
 				break;
-			cgit_log_link(buf, NULL, "remote-deco", NULL,
-				oid_to_hex(&commit->object.oid),
-				ctx.qry.vpath, 0, NULL, NULL,
+			cgit_log_link(name, NULL, "remote-deco", NULL,
+				hex, ctx.qry.vpath, 0, NULL, NULL,
 				ctx.qry.showmsg, 0);
 			break;
 		default:
-			cgit_commit_link(buf, NULL, "deco", ctx.qry.head,
-					oid_to_hex(&commit->object.oid),
-					ctx.qry.vpath);
+			cgit_commit_link(name, NULL, "deco", ctx.qry.head,
+					hex, ctx.qry.vpath);
 			break;
 		}
-		deco = deco->next;
 	}
 	html("</span>");
+	strbuf_release(&refname);
 }
 
 static void handle_rename(struct diff_filepair *pair)
@@ -442,8 +521,6 @@ void cgit_print_log(const char *tip, int ofs, int cnt, char *grep, char *pattern
 	rev.ignore_missing = 1;
 	rev.simplify_history = 1;
 	setup_revisions(rev_argv.nr, rev_argv.v, &rev, NULL);
-	load_ref_decorations(NULL, DECORATE_FULL_REFS);
-	rev.show_decorations = 1;
 	rev.grep_filter.ignore_case = 1;
 
 	rev.diffopt.detect_rename = 1;
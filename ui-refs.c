@@ -13,73 +13,47 @@
 #include "ui-refs.h"
 #include "html.h"
 #include "ui-shared.h"
+#include "ref-snapshot.h"
+#include "repo-cache.h"
 
-static inline int cmp_age(int age1, int age2)
+static int cmp_branch_name(const void *a, const void *b)
 {
-	/* age1 and age2 are assumed to be non-negative */
-	return age2 - age1;
-}
-
-static int cmp_ref_name(const void *a, const void *b)
-{
-	struct refinfo *r1 = *(struct refinfo **)a;
-	struct refinfo *r2 = *(struct refinfo **)b;
-
-	return strcmp(r1->refname, r2->refname);
-}
-
-static int cmp_branch_age(const void *a, const void *b)
-{
-	struct refinfo *r1 = *(struct refinfo **)a;
-	struct refinfo *r2 = *(struct refinfo **)b;
-
-	return cmp_age(r1->commit->committer_date, r2->commit->committer_date);
-}
+	const struct cgit_ref_entry *r1 = *(const struct cgit_ref_entry **)a;
+	const struct cgit_ref_entry *r2 = *(const struct cgit_ref_entry **)b;
 
-static int get_ref_age(struct refinfo *ref)
-{
-	if (!ref->object)
-		return 0;
-	switch (ref->object->type) {
-	case OBJ_TAG:
-		return ref->tag ? ref->tag->tagger_date : 0;
-	case OBJ_COMMIT:
-		return ref->commit ? ref->commit->committer_date : 0;
-	}
-	return 0;
+	return strcmp(cgit_ref_entry_name(r1), cgit_ref_entry_name(r2));
 }
 
-static int cmp_tag_age(const void *a, const void *b)
+static void print_object_link(const struct object_id *oid)
 {
-	struct refinfo *r1 = *(struct refinfo **)a;
-	struct refinfo *r2 = *(struct refinfo **)b;
+	struct object *obj = parse_object(the_repository, oid);
 
-	return cmp_age(get_ref_age(r1), get_ref_age(r2));
+	if (obj)
+		cgit_object_link(obj);
 }
 
-static int print_branch(struct refinfo *ref)
+static int print_branch(struct cgit_ref_entry *ref)
 {
-	struct commitinfo *info = ref->commit;
-	char *name = (char *)ref->refname;
+	const char *name = cgit_ref_entry_name(ref);
 
-	if (!info)
+	if (ref->type == OBJ_COMMIT && !ref->has_details)
 		return 1;
 	html("<tr><td>");
 	cgit_log_link(name, NULL, NULL, name, NULL, NULL, 0, NULL, NULL,
 		      ctx.qry.showmsg, 0);
 	html("</td><td>");
 
-	if (ref->object->type == OBJ_COMMIT) {
-		cgit_commit_link(info->subject, NULL, NULL, name, NULL, NULL);
+	if (ref->type == OBJ_COMMIT) {
+		cgit_commit_link(ref->subject, NULL, NULL, name, NULL, NULL);
 		html("</td><td>");
-		cgit_open_filter(ctx.repo->email_filter, info->author_email, "refs");
-		html_txt(info->author);
+		cgit_open_filter(ctx.repo->email_filter, ref->author_email, "refs");
+		html_txt(ref->author);
 		cgit_close_filter(ctx.repo->email_filter);
 		html("</td><td colspan='2'>");
-		cgit_print_age(info->committer_date, info->committer_tz, -1);
+		cgit_print_age(ref->date, ref->tz, -1);
 	} else {
 		html("</td><td></td><td>");
-		cgit_object_link(ref->object);
+		print_object_link(&ref->oid);
 	}
 	html("</td></tr>\n");
 	return 0;
@@ -93,47 +67,30 @@ static void print_tag_header(void)
 	     "<th class='left' colspan='2'>Age</th></tr>\n");
 }
 
-static int print_tag(struct refinfo *ref)
+static int print_tag(struct cgit_ref_entry *ref)
 {
-	struct tag *tag = NULL;
-	struct taginfo *info = NULL;
-	char *name = (char *)ref->refname;
-	struct object *obj = ref->object;
-
-	if (obj->type == OBJ_TAG) {
-		tag = (struct tag *)obj;
-		obj = tag->tagged;
-		info = ref->tag;
-		if (!info)
-			return 1;
-	}
+	const char *name = cgit_ref_entry_name(ref);
+
+	if (!ref->has_details && (ref->type == OBJ_TAG ||
+				  ref->type == OBJ_COMMIT))
+		return 1;
 
 	html("<tr><td>");
 	cgit_tag_link(name, NULL, NULL, name);
 	html("</td><td>");
-	if (ctx.repo->snapshots && (obj->type == OBJ_COMMIT))
+	if (ctx.repo->snapshots && ref->peeled_type == OBJ_COMMIT)
 		cgit_print_snapshot_links(ctx.repo, name, "&nbsp;&nbsp;");
 	else
-		cgit_object_link(obj);
+		print_object_link(&ref->peeled);
 	html("</td><td>");
-	if (info) {
-		if (info->tagger) {
-			cgit_open_filter(ctx.repo->email_filter, info->tagger_email, "refs");
-			html_txt(info->tagger);
-			cgit_close_filter(ctx.repo->email_filter);
-		}
-	} else if (ref->object->type == OBJ_COMMIT) {
-		cgit_open_filter(ctx.repo->email_filter, ref->commit->author_email, "refs");
-		html_txt(ref->commit->author);
+	if (ref->has_details && ref->author && *ref->author) {
+		cgit_open_filter(ctx.repo->email_filter, ref->author_email, "refs");
+		html_txt(ref->author);
 		cgit_close_filter(ctx.repo->email_filter);
 	}
 	html("</td><td colspan='2'>");
-	if (info) {
-		if (info->tagger_date > 0)
-			cgit_print_age(info->tagger_date, info->tagger_tz, -1);
-	} else if (ref->object->type == OBJ_COMMIT) {
-		cgit_print_age(ref->commit->commit->date, 0, -1);
-	}
+	if (ref->has_details && ref->date > 0)
+		cgit_print_age(ref->date, ref->tz, -1);
 	html("</td></tr>\n");
 
 	return 0;
@@ -146,64 +103,89 @@ static void print_refs_link(const char *path)
 	html("</td></tr>");
 }
 
-void cgit_print_branches(int maxcount)
+static void load_details(struct cgit_ref_entry **refs, int count)
 {
-	struct reflist list;
 	int i;
 
+	for (i = 0; i < count; i++)
+		cgit_ref_entry_load_details(refs[i]);
+}
+
+void cgit_print_branches(int maxcount)
+{
+	const char *prefixes[] = { "refs/heads/", NULL, NULL };
+	struct cgit_ref_entry **refs;
+	int i, count, total;
+
 	html("<tr class='nohover'><th class='left'>Branch</th>"
 	     "<th class='left'>Commit message</th>"
 	     "<th class='left'>Author</th>"
 	     "<th class='left' colspan='2'>Age</th></tr>\n");
 
-	list.refs = NULL;
-	list.alloc = list.count = 0;
-	refs_for_each_branch_ref(get_main_ref_store(the_repository),
-				 cgit_refs_cb, &list);
 	if (ctx.repo->enable_remote_branches)
-		refs_for_each_remote_ref(get_main_ref_store(the_repository),
-					 cgit_refs_cb, &list);
-
-	if (maxcount == 0 || maxcount > list.count)
-		maxcount = list.count;
+		prefixes[1] = "refs/remotes/";
+	refs = cgit_recent_snapshot_refs(prefixes, maxcount, &count, &total);
+	load_details(refs, count);
 
-	qsort(list.refs, list.count, sizeof(*list.refs), cmp_branch_age);
 	if (ctx.repo->branch_sort == 0)
-		qsort(list.refs, maxcount, sizeof(*list.refs), cmp_ref_name);
+		qsort(refs, count, sizeof(*refs), cmp_branch_name);
 
-	for (i = 0; i < maxcount; i++)
-		print_branch(list.refs[i]);
+	for (i = 0; i < count; i++)
+		print_branch(refs[i]);
 
-	if (maxcount < list.count)
+	if (count < total)
 		print_refs_link("heads");
 
-	cgit_free_reflist_inner(&list);
+	cgit_free_ref_entries(refs, count);
 }
 
 void cgit_print_tags(int maxcount)
 {
-	struct reflist list;
-	int i;
+	const char *prefixes[] = { "refs/tags/", NULL };
+	struct cgit_ref_entry **refs;
+	int i, count, total;
 
-	list.refs = NULL;
-	list.alloc = list.count = 0;
-	refs_for_each_tag_ref(get_main_ref_store(the_repository),
-			      cgit_refs_cb, &list);
-	if (list.count == 0)
+	refs = cgit_recent_snapshot_refs(prefixes, maxcount, &count, &total);
+	if (total == 0) {
+		cgit_free_ref_entries(refs, count);
 		return;
-	qsort(list.refs, list.count, sizeof(*list.refs), cmp_tag_age);
-	if (!maxcount)
-		maxcount = list.count;
-	else if (maxcount > list.count)
-		maxcount = list.count;
+	}
+	load_details(refs, count);
+
 	print_tag_header();
-	for (i = 0; i < maxcount; i++)
-		print_tag(list.refs[i]);
+	for (i = 0; i < count; i++)
+		print_tag(refs[i]);
 
-	if (maxcount < list.count)
+	if (count < total)
 		print_refs_link("tags");
 
-	cgit_free_reflist_inner(&list);
+	cgit_free_ref_entries(refs, count);
+}
+
+void cgit_print_branch_names(void)
+{
+	const char *prefixes[] = { "refs/heads/", NULL, NULL };
+	struct cgit_ref_entry **refs;
+	int i, count, total;
+
+	if (ctx.repo->enable_remote_branches)
+		prefixes[1] = "refs/remotes/";
+	refs = cgit_recent_branch_refs(prefixes, 0, &count, &total);
+	/* In the same order as the options of the header's select. */
+	qsort(refs, count, sizeof(*refs), cgit_cmp_ref_entries);
+
+	ctx.page.mimetype = "application/json";
+	ctx.page.etag = repo_cache_refs_token();
+	cgit_print_http_headers();
+	html("[");
+	for (i = 0; i < count; i++) {
+		if (i)
+			html(",");
+		html_json_str(cgit_ref_entry_name(refs[i]));
+	}
+	html("]\n");
+
+	cgit_free_ref_entries(refs, count);
 }
 
 void cgit_print_refs(void)
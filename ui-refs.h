@@ -4,5 +4,6 @@
 extern void cgit_print_branches(int maxcount);
 extern void cgit_print_tags(int maxcount);
 extern void cgit_print_refs(void);
+extern void cgit_print_branch_names(void);
 
 #endif /* UI_REFS_H */
@@ -13,6 +13,7 @@
 #include "ui-shared.h"
 #include "cmd.h"
 #include "html.h"
+#include "ref-snapshot.h"
 #include "version.h"
 
 static const char cgit_doctype[] =
@@ -331,6 +332,36 @@ static void reporevlink(const char *page, const char *name, const char *title,
 	html("</a>");
 }
 
+void cgit_tree_page_link(const char *name, const char *title,
+			 const char *class, const char *head, const char *rev,
+			 const char *path, const char *after,
+			 const char *search)
+{
+	char *delim;
+
+	delim = repolink(title, class, "tree", head, path);
+	if (rev && ctx.qry.head && strcmp(rev, ctx.qry.head)) {
+		html(delim);
+		html("id=");
+		html_url_arg(rev);
+		delim = "&amp;";
+	}
+	if (search && *search) {
+		html(delim);
+		html("q=");
+		html_url_arg(search);
+		delim = "&amp;";
+	}
+	if (after) {
+		html(delim);
+		html("after=");
+		html_url_arg(after);
+	}
+	html("'>");
+	html_txt(name);
+	html("</a>");
+}
+
 void cgit_summary_link(const char *name, const char *title, const char *class,
 		       const char *head)
 {
@@ -937,12 +968,46 @@ void cgit_add_clone_urls(void (*fn)(const char *))
 		add_clone_urls(fn, ctx.cfg.clone_prefix, ctx.repo->url);
 }
 
-static int print_branch_option(const char *refname, const struct object_id *oid,
-			       int flags, void *cb_data)
+/*
+ * Repositories may have thousands of branches, so only the most recent
+ * "header-branches" of them are put into the page. When some were left
+ * out, the select points cgit.js at the "branches" page, which lists
+ * all of them, to load the rest when the user actually opens it.
+ */
+static void print_branch_select(void)
 {
-	char *name = (char *)refname;
-	html_option(name, name, ctx.qry.head);
-	return 0;
+	const char *prefixes[] = { "refs/heads/", NULL, NULL };
+	struct cgit_ref_entry **refs;
+	int i, count, total, found = 0;
+
+	if (ctx.repo->enable_remote_branches)
+		prefixes[1] = "refs/remotes/";
+	refs = cgit_recent_branch_refs(prefixes, ctx.cfg.header_branches,
+				       &count, &total);
+	qsort(refs, count, sizeof(*refs), cgit_cmp_ref_entries);
+
+	html("<select name='h' onchange='this.form.submit();'");
+	if (count < total) {
+		char *url = cgit_pageurl(ctx.repo->url, "branches", NULL);
+
+		html(" data-branches='");
+		html_attr(url);
+		html("'");
+		free(url);
+	}
+	html(">\n");
+	for (i = 0; i < count; i++) {
+		const char *name = cgit_ref_entry_name(refs[i]);
+
+		if (ctx.qry.head && !strcmp(name, ctx.qry.head))
+			found = 1;
+		html_option(name, name, ctx.qry.head);
+	}
+	if (!found && count < total && ctx.qry.head)
+		html_option(ctx.qry.head, ctx.qry.head, ctx.qry.head);
+	html("</select> ");
+
+	cgit_free_ref_entries(refs, count);
 }
 
 void cgit_add_hidden_formfields(int incl_head, int incl_search,
@@ -1054,13 +1119,7 @@ static void print_header(void)
 			html("</td><td class='form'>");
 			html("<form method='get'>\n");
 			cgit_add_hidden_formfields(0, 1, ctx.qry.page);
-			html("<select name='h' onchange='this.form.submit();'>\n");
-			refs_for_each_branch_ref(get_main_ref_store(the_repository),
-						 print_branch_option, ctx.qry.head);
-			if (ctx.repo->enable_remote_branches)
-				refs_for_each_remote_ref(get_main_ref_store(the_repository),
-							 print_branch_option, ctx.qry.head);
-			html("</select> ");
+			print_branch_select();
 			html("<input type='submit' value='switch'/>");
 			html("</form>");
 		}
@@ -1233,6 +1292,7 @@ void cgit_print_snapshot_links(const struct cgit_repo *repo, const char *ref,
 	struct strbuf filename = STRBUF_INIT;
 	const char *basename;
 	size_t prefixlen;
+	unsigned sigs = cgit_snapshot_sig_formats(ref);
 
 	basename = cgit_snapshot_prefix(repo);
 	if (starts_with(ref, basename))
@@ -1248,13 +1308,13 @@ void cgit_print_snapshot_links(const struct cgit_repo *repo, const char *ref,
 		strbuf_addstr(&filename, f->suffix);
 		cgit_snapshot_link(filename.buf, NULL, NULL, NULL, NULL,
 				   filename.buf);
-		if (cgit_snapshot_get_sig(ref, f)) {
+		if (sigs & cgit_snapshot_format_bit(f)) {
 			strbuf_addstr(&filename, ".asc");
 			html(" (");
 			cgit_snapshot_link("sig", NULL, NULL, NULL, NULL,
 					   filename.buf);
 			html(")");
-		} else if (starts_with(f->suffix, ".tar") && cgit_snapshot_get_sig(ref, &cgit_snapshot_formats[0])) {
+		} else if (starts_with(f->suffix, ".tar") && (sigs & cgit_snapshot_format_bit(&cgit_snapshot_formats[0]))) {
 			strbuf_setlen(&filename, strlen(filename.buf) - strlen(f->suffix));
 			strbuf_addstr(&filename, ".tar.asc");
 			html(" (");
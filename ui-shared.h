@@ -24,6 +24,10 @@ extern void cgit_tag_link(const char *name, const char *title,
 extern void cgit_tree_link(const char *name, const char *title,
 			   const char *class, const char *head,
 			   const char *rev, const char *path);
+extern void cgit_tree_page_link(const char *name, const char *title,
+				const char *class, const char *head,
+				const char *rev, const char *path,
+				const char *after, const char *search);
 extern void cgit_plain_link(const char *name, const char *title,
 			    const char *class, const char *head,
 			    const char *rev, const char *path);
@@ -13,6 +13,14 @@
 #include "ui-snapshot.h"
 #include "html.h"
 #include "ui-shared.h"
+#include "parallel-gzip.h"
+#include "ref-snapshot.h"
+#include "repo-cache.h"
+#include "strmap.h"
+#include "object-file.h"
+#include "lockfile.h"
+
+static int snapshot_threads(const char *suffix, int def);
 
 static int write_archive_type(const char *format, const char *hex, const char *prefix)
 {
@@ -73,6 +81,21 @@ static int write_compressed_tar_archive(const char *hex,
 static int write_tar_gzip_archive(const char *hex, const char *prefix)
 {
 	char *argv[] = { "gzip", "-n", NULL };
+	int threads = snapshot_threads(".tar.gz", 1);
+
+	if (threads < 0)
+		threads = online_cpus();
+	if (HAVE_THREADS && threads > 1) {
+		struct cgit_gzip_filter f;
+		int rv;
+
+		cgit_gzip_filter_init(&f, threads);
+		cgit_open_filter(&f.base);
+		rv = write_tar_archive(hex, prefix);
+		if (cgit_close_filter(&f.base))
+			rv = -1;
+		return rv;
+	}
 	return write_compressed_tar_archive(hex, prefix, argv);
 }
 
@@ -88,16 +111,34 @@ static int write_tar_lzip_archive(const char *hex, const char *prefix)
 	return write_compressed_tar_archive(hex, prefix, argv);
 }
 
+/* Both xz and zstd take "-T0" to use one thread per processor core. */
+static char *threads_arg(int threads)
+{
+	return xstrfmt("-T%d", threads < 0 ? 0 : threads);
+}
+
 static int write_tar_xz_archive(const char *hex, const char *prefix)
 {
-	char *argv[] = { "xz", NULL };
-	return write_compressed_tar_archive(hex, prefix, argv);
+	char *argv[] = { "xz", NULL, NULL };
+	int threads = snapshot_threads(".tar.xz", 1);
+	int rv;
+
+	if (threads != 1)
+		argv[1] = threads_arg(threads);
+	rv = write_compressed_tar_archive(hex, prefix, argv);
+	free(argv[1]);
+	return rv;
 }
 
 static int write_tar_zstd_archive(const char *hex, const char *prefix)
 {
-	char *argv[] = { "zstd", "-T0", NULL };
-	return write_compressed_tar_archive(hex, prefix, argv);
+	char *argv[] = { "zstd", NULL, NULL };
+	int rv;
+
+	argv[1] = threads_arg(snapshot_threads(".tar.zst", -1));
+	rv = write_compressed_tar_archive(hex, prefix, argv);
+	free(argv[1]);
+	return rv;
 }
 
 const struct cgit_snapshot_format cgit_snapshot_formats[] = {
@@ -114,14 +155,14 @@ const struct cgit_snapshot_format cgit_snapshot_formats[] = {
 
 static struct notes_tree snapshot_sig_notes[ARRAY_SIZE(cgit_snapshot_formats)];
 
-const struct object_id *cgit_snapshot_get_sig(const char *ref,
-					      const struct cgit_snapshot_format *f)
+/* Configured compression threads per format: 0 when unset, -1 for one
+ * per processor core.
+ */
+static int snapshot_thread_counts[ARRAY_SIZE(cgit_snapshot_formats)];
+
+static struct notes_tree *snapshot_sig_tree(const struct cgit_snapshot_format *f)
 {
 	struct notes_tree *tree;
-	struct object_id oid;
-
-	if (repo_get_oid(the_repository, ref, &oid))
-		return NULL;
 
 	tree = &snapshot_sig_notes[f - &cgit_snapshot_formats[0]];
 	if (!tree->initialized) {
@@ -133,8 +174,181 @@ const struct object_id *cgit_snapshot_get_sig(const char *ref,
 		init_notes(tree, notes_ref.buf, combine_notes_ignore, 0);
 		strbuf_release(&notes_ref);
 	}
+	return tree;
+}
+
+const struct object_id *cgit_snapshot_get_sig(const char *ref,
+					      const struct cgit_snapshot_format *f)
+{
+	struct object_id oid;
+
+	if (repo_get_oid(the_repository, ref, &oid))
+		return NULL;
+
+	return get_note(snapshot_sig_tree(f), &oid);
+}
+
+/*
+ * The formats signed for each annotated object are kept in the
+ * "snapshot-sigs" index as sorted "<object>\t<format bits>" lines, built
+ * from all signature notes whenever one of the notes refs changes, and
+ * binary searched in place for each object. Without index-root,
+ * signatures are looked up per object and remembered for the rest of
+ * the request instead.
+ */
+#define SIG_INDEX "snapshot-sigs"
+
+static enum {
+	SIGS_UNLOADED, SIGS_INDEXED, SIGS_COMPLETE, SIGS_MEMO
+} snapshot_sigs_state;
+static struct strintmap snapshot_sigs;
+static struct repo_cache_map sig_index;
+static struct strbuf sig_token = STRBUF_INIT;
+static unsigned snapshot_sig_refs;	/* formats with a notes ref */
+
+static int add_sig_note(const struct object_id *object_oid,
+			const struct object_id *note_oid,
+			char *note_path, void *cb_data)
+{
+	const char *hex = oid_to_hex(object_oid);
+	unsigned bit = *(unsigned *)cb_data;
+
+	strintmap_set(&snapshot_sigs, hex,
+		      strintmap_get(&snapshot_sigs, hex) | bit);
+	return 0;
+}
+
+static int cmp_sig_line(const void *a, const void *b)
+{
+	const struct string_list_item *x = a, *y = b;
+	return strcmp(x->string, y->string);
+}
+
+static void store_sig_index(void)
+{
+	struct string_list lines = STRING_LIST_INIT_DUP;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	struct strbuf buf = STRBUF_INIT;
+	size_t i;
+
+	strintmap_for_each_entry(&snapshot_sigs, &iter, e) {
+		strbuf_reset(&buf);
+		strbuf_addf(&buf, "%s\t%x\n", e->key,
+			    (unsigned)(intptr_t)e->value);
+		string_list_append(&lines, buf.buf);
+	}
+	QSORT(lines.items, lines.nr, cmp_sig_line);
+
+	strbuf_reset(&buf);
+	for (i = 0; i < lines.nr; i++)
+		strbuf_addstr(&buf, lines.items[i].string);
+	repo_cache_store(SIG_INDEX, sig_token.buf, buf.buf, buf.len);
+	strbuf_release(&buf);
+	string_list_clear(&lines, 0);
+}
+
+/* Read all signature notes and store them as a new index. */
+static void build_sig_index(void)
+{
+	const struct cgit_snapshot_format *f;
+
+	for (f = cgit_snapshot_formats; f->suffix; f++) {
+		unsigned bit = cgit_snapshot_format_bit(f);
+
+		if (snapshot_sig_refs & bit)
+			for_each_note(snapshot_sig_tree(f), 0, add_sig_note,
+				      &bit);
+	}
+	store_sig_index();
+	snapshot_sigs_state = SIGS_COMPLETE;
+}
+
+/* Find the formats `hex` is signed for in the mapped index. Returns -1
+ * if its line is malformed, so that the index gets rebuilt.
+ */
+static int read_sig_index(const char *hex, unsigned *formats)
+{
+	const char *end = sig_index.buf + sig_index.len;
+	const char *line;
+	char *p;
+
+	*formats = 0;
+	line = repo_cache_lookup(sig_index.buf, sig_index.len, hex);
+	if (!line)
+		return 0;
+	line += strlen(hex);
+	if (line >= end || *line++ != '\t')
+		return -1;
+	*formats = strtoul(line, &p, 16);
+	if (p == line || p >= end || *p != '\n')
+		return -1;
+	return 0;
+}
+
+static void load_snapshot_sigs(void)
+{
+	const struct cgit_snapshot_format *f;
+	struct object_id oid;
+
+	strintmap_init(&snapshot_sigs, 0);
+	snapshot_sigs_state = SIGS_COMPLETE;
+
+	strbuf_addstr(&sig_token, "sigs 1");
+	for (f = cgit_snapshot_formats; f->suffix; f++) {
+		char *ref = xstrfmt("refs/notes/signatures/%s", f->suffix + 1);
+
+		if (!repo_get_oid(the_repository, ref, &oid)) {
+			snapshot_sig_refs |= cgit_snapshot_format_bit(f);
+			strbuf_addf(&sig_token, " %s", oid_to_hex(&oid));
+		} else {
+			strbuf_addstr(&sig_token, " -");
+		}
+		free(ref);
+	}
 
-	return get_note(tree, &oid);
+	if (!snapshot_sig_refs)
+		return;
+	if (!repo_cache_enabled())
+		snapshot_sigs_state = SIGS_MEMO;
+	else if (!repo_cache_open(&sig_index, SIG_INDEX, sig_token.buf))
+		snapshot_sigs_state = SIGS_INDEXED;
+	else
+		build_sig_index();
+}
+
+unsigned cgit_snapshot_sig_formats(const char *ref)
+{
+	const struct cgit_snapshot_format *f;
+	struct object_id oid;
+	const char *hex;
+	unsigned formats = 0;
+
+	if (snapshot_sigs_state == SIGS_UNLOADED)
+		load_snapshot_sigs();
+	if (!snapshot_sig_refs || repo_get_oid(the_repository, ref, &oid))
+		return 0;
+
+	hex = oid_to_hex(&oid);
+	if (snapshot_sigs_state == SIGS_INDEXED) {
+		if (!read_sig_index(hex, &formats))
+			return formats;
+		repo_cache_close(&sig_index);
+		build_sig_index();
+	}
+	if (snapshot_sigs_state == SIGS_COMPLETE ||
+	    strintmap_contains(&snapshot_sigs, hex))
+		return strintmap_get(&snapshot_sigs, hex);
+
+	for (f = cgit_snapshot_formats; f->suffix; f++) {
+		unsigned bit = cgit_snapshot_format_bit(f);
+
+		if ((snapshot_sig_refs & bit) &&
+		    get_note(snapshot_sig_tree(f), &oid))
+			formats |= bit;
+	}
+	strintmap_set(&snapshot_sigs, hex, formats);
+	return formats;
 }
 
 static const struct cgit_snapshot_format *get_format(const char *filename)
@@ -153,18 +367,82 @@ const unsigned cgit_snapshot_format_bit(const struct cgit_snapshot_format *f)
 	return BIT(f - &cgit_snapshot_formats[0]);
 }
 
+void cgit_set_snapshot_threads(const char *format, const char *value)
+{
+	const struct cgit_snapshot_format *f;
+	int threads = atoi(value);
+
+	for (f = cgit_snapshot_formats; f->suffix; f++) {
+		if (!strcmp(format, f->suffix) || !strcmp(format, f->suffix + 1)) {
+			snapshot_thread_counts[f - &cgit_snapshot_formats[0]] =
+				threads > 0 ? threads : -1;
+			return;
+		}
+	}
+}
+
+/* Return the number of threads to compress `suffix` archives with, or
+ * -1 for one per processor core.
+ */
+static int snapshot_threads(const char *suffix, int def)
+{
+	const struct cgit_snapshot_format *f = get_format(suffix);
+	int threads = f ? snapshot_thread_counts[f - &cgit_snapshot_formats[0]] : 0;
+
+	return threads ? threads : def;
+}
+
+/* Pre-generated snapshots are kept in snapshot-store as
+ * "<repo url>/<commit>/<prefix><suffix>", since the archive only depends
+ * on the commit, the prefix and the format.
+ */
+static int snapshot_store_path(struct strbuf *path,
+			       const struct cgit_snapshot_format *format,
+			       const struct object_id *commit,
+			       const char *prefix)
+{
+	if (!ctx.cfg.snapshot_store || !*prefix || strchr(prefix, '/') ||
+	    !strcmp(prefix, ".") || !strcmp(prefix, ".."))
+		return -1;
+	strbuf_addf(path, "%s/%s/%s/%s%s", ctx.cfg.snapshot_store,
+		    ctx.repo->url, oid_to_hex(commit), prefix, format->suffix);
+	return 0;
+}
+
+static int open_stored_snapshot(const struct cgit_snapshot_format *format,
+				const struct object_id *commit,
+				const char *prefix, struct stat *st)
+{
+	struct strbuf path = STRBUF_INIT;
+	int fd = -1;
+
+	if (!snapshot_store_path(&path, format, commit, prefix)) {
+		fd = open(path.buf, O_RDONLY);
+		if (fd >= 0 && (fstat(fd, st) || !S_ISREG(st->st_mode))) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	strbuf_release(&path);
+	return fd;
+}
+
 static int make_snapshot(const struct cgit_snapshot_format *format,
 			 const char *hex, const char *prefix,
 			 const char *filename)
 {
 	struct object_id oid;
+	struct commit *commit;
+	struct stat st;
+	int fd;
 
 	if (repo_get_oid(the_repository, hex, &oid)) {
 		cgit_print_error_page(404, "Not found",
 				"Bad object id: %s", hex);
 		return 1;
 	}
-	if (!lookup_commit_reference(the_repository, &oid)) {
+	commit = lookup_commit_reference(the_repository, &oid);
+	if (!commit) {
 		cgit_print_error_page(400, "Bad request",
 				"Not a commit reference: %s", hex);
 		return 1;
@@ -172,6 +450,16 @@ static int make_snapshot(const struct cgit_snapshot_format *format,
 	ctx.page.etag = oid_to_hex(&oid);
 	ctx.page.mimetype = xstrdup(format->mimetype);
 	ctx.page.filename = xstrdup(filename);
+
+	fd = open_stored_snapshot(format, &commit->object.oid, prefix, &st);
+	if (fd >= 0) {
+		ctx.page.size = st.st_size;
+		cgit_print_http_headers();
+		html_sendfile(fd, 0, st.st_size);
+		close(fd);
+		return 0;
+	}
+
 	cgit_print_http_headers();
 	init_archivers();
 	format->write_func(hex, prefix);
@@ -317,3 +605,127 @@ void cgit_print_snapshot(const char *head, const char *hex,
 	free(prefix);
 	free(adj_filename);
 }
+
+/* Write the archive to its place in snapshot-store, unless it is there
+ * already or being written by another process.
+ */
+static int store_snapshot(const struct cgit_snapshot_format *format,
+			  const struct object_id *commit, const char *prefix)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf path = STRBUF_INIT;
+	struct stat st;
+	int fd, old_stdout, rv = 0;
+
+	if (snapshot_store_path(&path, format, commit, prefix) ||
+	    !stat(path.buf, &st))
+		goto out;
+	if (safe_create_leading_directories_const(path.buf)) {
+		rv = error_errno("unable to create directory for %s", path.buf);
+		goto out;
+	}
+	/* The lockfile is removed again if we die or get killed. */
+	fd = hold_lock_file_for_update(&lock, path.buf, 0);
+	if (fd < 0) {
+		if (errno != EEXIST)
+			rv = error_errno("unable to lock %s", path.buf);
+		goto out;
+	}
+
+	fflush(stdout);
+	old_stdout = chk_positive(dup(STDOUT_FILENO),
+		"Unable to duplicate STDOUT");
+	chk_non_negative(dup2(fd, STDOUT_FILENO),
+		"Unable to redirect STDOUT");
+	rv = format->write_func(oid_to_hex(commit), prefix);
+	chk_non_negative(dup2(old_stdout, STDOUT_FILENO),
+		"Unable to restore STDOUT");
+	close(old_stdout);
+
+	if (rv) {
+		error("unable to write %s", get_lock_file_path(&lock));
+		rollback_lock_file(&lock);
+	} else if (commit_lock_file(&lock)) {
+		rv = error_errno("unable to rename lockfile to %s", path.buf);
+	} else {
+		printf("%s\n", path.buf);
+	}
+out:
+	strbuf_release(&path);
+	return rv;
+}
+
+static int pregenerate_repo_snapshots(struct cgit_repo *repo, int max_tags)
+{
+	const char *prefixes[] = { "refs/tags/", NULL };
+	const struct cgit_snapshot_format *f;
+	struct cgit_ref_entry **refs;
+	struct strbuf prefix = STRBUF_INIT;
+	const char *basename;
+	int i, count, total, nongit = 0, rv = 0;
+
+	ctx.repo = repo;
+	setenv("GIT_DIR", repo->path, 1);
+	setup_git_directory_gently(&nongit);
+	if (nongit)
+		return error("%s is not a valid git repository", repo->path);
+	init_archivers();
+
+	basename = cgit_snapshot_prefix(repo);
+	refs = cgit_recent_snapshot_refs(prefixes, max_tags, &count, &total);
+	for (i = 0; i < count; i++) {
+		const char *ref = cgit_ref_entry_name(refs[i]);
+
+		if (refs[i]->peeled_type != OBJ_COMMIT)
+			continue;
+
+		/* Name the archive the way cgit_print_snapshot_links()
+		 * does, which is what the snapshot page uses as prefix.
+		 */
+		strbuf_reset(&prefix);
+		if (starts_with(ref, basename))
+			strbuf_addstr(&prefix, ref);
+		else
+			cgit_compose_snapshot_prefix(&prefix, basename, ref);
+
+		for (f = cgit_snapshot_formats; f->suffix; f++) {
+			if (!(repo->snapshots & cgit_snapshot_format_bit(f)))
+				continue;
+			if (store_snapshot(f, &refs[i]->peeled, prefix.buf))
+				rv = 1;
+		}
+	}
+	cgit_free_ref_entries(refs, count);
+	strbuf_release(&prefix);
+	return rv;
+}
+
+int cgit_pregenerate_snapshots(int max_tags)
+{
+	int i, status, rv = 0;
+	pid_t pid;
+
+	if (!ctx.cfg.snapshot_store)
+		return error("snapshot-store is not set");
+
+	for (i = 0; i < cgit_repolist.count; i++) {
+		struct cgit_repo *repo = &cgit_repolist.repos[i];
+
+		if (ctx.qry.repo && strcmp(ctx.qry.repo, repo->url))
+			continue;
+		if (!repo->snapshots)
+			continue;
+
+		/* The git environment can only be set up once per process. */
+		fflush(stdout);
+		pid = fork();
+		if (pid < 0)
+			return error_errno("unable to fork");
+		if (!pid)
+			exit(pregenerate_repo_snapshots(repo, max_tags));
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			rv = 1;
+	}
+	return rv;
+}
@@ -4,4 +4,10 @@
 extern void cgit_print_snapshot(const char *head, const char *hex,
 				const char *filename, int dwim);
 
+/* Write the configured snapshot formats of the `max_tags` most recent
+ * tags (all tags if 0) of every repository, or only of the one selected
+ * with --repo, to snapshot-store. Archives already stored are skipped.
+ */
+extern int cgit_pregenerate_snapshots(int max_tags);
+
 #endif /* UI_SNAPSHOT_H */
@@ -13,11 +13,9 @@
 #include "ui-stats.h"
 #include "html.h"
 #include "ui-shared.h"
-
-struct authorstat {
-	long total;
-	struct string_list list;
-};
+#include "repo-cache.h"
+#include "strmap.h"
+#include "commit-reach.h"
 
 #define DAY_SECS (60 * 60 * 24)
 #define WEEK_SECS (DAY_SECS * 7)
@@ -169,78 +167,141 @@ const char *cgit_find_stats_periodname(int idx)
 		return "";
 }
 
-static void add_commit(struct string_list *authors, struct commit *commit,
-	const struct cgit_period *period)
+/*
+ * Commits are counted in a dense matrix with one row per author and one
+ * column per shown period. Author names are interned to row numbers and
+ * commits are mapped to columns by their day, so no strings are built
+ * or compared per commit or per cell.
+ */
+struct stats {
+	const struct cgit_period *period;
+	long *bounds;		/* first day of each column and of the next */
+	struct strmap ids;	/* author name -> row + 1 */
+	char **names;
+	long *totals;		/* including commits outside of the columns */
+	long *counts;		/* nr rows of period->count columns */
+	size_t nr, alloc;
+};
+
+static void init_stats(struct stats *stats, const struct cgit_period *period)
 {
-	struct commitinfo *info;
-	struct string_list_item *author, *item;
-	struct authorstat *authorstat;
-	struct string_list *items;
-	char *tmp;
-	struct tm date;
-	time_t t;
-	uintptr_t *counter;
+	time_t now;
+	struct tm tm;
+	int i;
 
-	info = cgit_parse_commit(commit);
-	tmp = xstrdup(info->author);
-	author = string_list_insert(authors, tmp);
-	if (!author->util)
-		author->util = xcalloc(1, sizeof(struct authorstat));
-	else
-		free(tmp);
-	authorstat = author->util;
-	items = &authorstat->list;
-	t = info->committer_date;
-	gmtime_r(&t, &date);
-	period->trunc(&date);
-	tmp = xstrdup(period->pretty(&date));
-	item = string_list_insert(items, tmp);
-	counter = (uintptr_t *)&item->util;
-	if (*counter)
-		free(tmp);
-	(*counter)++;
-
-	authorstat->total++;
-	cgit_free_commitinfo(info);
+	memset(stats, 0, sizeof(*stats));
+	stats->period = period;
+	strmap_init_with_options(&stats->ids, NULL, 0);
+	ALLOC_ARRAY(stats->bounds, period->count + 1);
+
+	time(&now);
+	gmtime_r(&now, &tm);
+	period->trunc(&tm);
+	for (i = 1; i < period->count; i++)
+		period->dec(&tm);
+	for (i = 0; i <= period->count; i++) {
+		stats->bounds[i] = timegm(&tm) / DAY_SECS;
+		period->inc(&tm);
+	}
+}
+
+static void free_stats(struct stats *stats)
+{
+	size_t i;
+
+	for (i = 0; i < stats->nr; i++)
+		free(stats->names[i]);
+	strmap_clear(&stats->ids, 0);
+	free(stats->names);
+	free(stats->totals);
+	free(stats->counts);
+	free(stats->bounds);
 }
 
+static size_t stats_author(struct stats *stats, const char *name)
+{
+	size_t id = (uintptr_t)strmap_get(&stats->ids, name);
+	size_t ncols = stats->period->count, old = stats->alloc;
+
+	if (id)
+		return id - 1;
+	if (stats->nr == stats->alloc) {
+		stats->alloc = alloc_nr(stats->alloc);
+		REALLOC_ARRAY(stats->names, stats->alloc);
+		REALLOC_ARRAY(stats->totals, stats->alloc);
+		REALLOC_ARRAY(stats->counts, st_mult(stats->alloc, ncols));
+		memset(stats->totals + old, 0,
+		       (stats->alloc - old) * sizeof(*stats->totals));
+		memset(stats->counts + old * ncols, 0,
+		       st_mult(stats->alloc - old, ncols) * sizeof(*stats->counts));
+	}
+	stats->names[stats->nr] = xstrdup(name);
+	strmap_put(&stats->ids, stats->names[stats->nr],
+		   (void *)(uintptr_t)(stats->nr + 1));
+	return stats->nr++;
+}
+
+static void add_count(struct stats *stats, const char *name, long day,
+		      long count)
+{
+	size_t id = stats_author(stats, name);
+	int col;
+
+	stats->totals[id] += count;
+	for (col = stats->period->count - 1; col >= 0; col--)
+		if (day >= stats->bounds[col])
+			break;
+	if (col >= 0 && day < stats->bounds[stats->period->count])
+		stats->counts[id * stats->period->count + col] += count;
+}
+
+static const struct stats *sort_stats;
+
 static int cmp_total_commits(const void *a1, const void *a2)
 {
-	const struct string_list_item *i1 = a1;
-	const struct string_list_item *i2 = a2;
-	const struct authorstat *auth1 = i1->util;
-	const struct authorstat *auth2 = i2->util;
+	size_t i1 = *(const size_t *)a1;
+	size_t i2 = *(const size_t *)a2;
+	long t1 = sort_stats->totals[i1], t2 = sort_stats->totals[i2];
 
-	return auth2->total - auth1->total;
+	if (t1 != t2)
+		return t1 < t2 ? 1 : -1;
+	return strcmp(sort_stats->names[i1], sort_stats->names[i2]);
 }
 
-/* Walk the commit DAG and collect number of commits per author per
- * timeperiod into a nested string_list collection.
- */
-static struct string_list collect_stats(const struct cgit_period *period)
+/* Return the day (since the epoch) the shown part of `period` starts at. */
+static long period_start_day(const struct cgit_period *period)
 {
-	struct string_list authors;
-	struct rev_info rev;
-	struct commit *commit;
-	const char *argv[] = {NULL, ctx.qry.head, NULL, NULL, NULL, NULL};
-	int argc = 3;
 	time_t now;
-	long i;
 	struct tm tm;
-	char tmp[11];
+	long i;
 
 	time(&now);
 	gmtime_r(&now, &tm);
 	period->trunc(&tm);
 	for (i = 1; i < period->count; i++)
 		period->dec(&tm);
+	return timegm(&tm) / DAY_SECS;
+}
+
+static char *since_arg(long day)
+{
+	time_t t = day * DAY_SECS;
+	struct tm tm;
+	char tmp[11];
+
+	gmtime_r(&t, &tm);
 	strftime(tmp, sizeof(tmp), "%Y-%m-%d", &tm);
-	argv[2] = xstrdup(fmt("--since=%s", tmp));
-	if (ctx.qry.path) {
-		argv[3] = "--";
-		argv[4] = ctx.qry.path;
-		argc += 2;
-	}
+	return xstrfmt("--since=%s", tmp);
+}
+
+typedef void (*stats_commit_fn)(struct commit *commit, void *cb_data);
+
+static void walk_commits(int argc, const char **argv, stats_commit_fn fn,
+			 void *cb_data)
+{
+	struct rev_info rev;
+	struct commit *commit;
+
 	repo_init_revisions(the_repository, &rev, NULL);
 	rev.abbrev = DEFAULT_ABBREV;
 	rev.commit_format = CMIT_FMT_DEFAULT;
@@ -249,128 +310,276 @@ static struct string_list collect_stats(const struct cgit_period *period)
 	rev.show_root_diff = 0;
 	setup_revisions(argc, argv, &rev, NULL);
 	prepare_revision_walk(&rev);
-	memset(&authors, 0, sizeof(authors));
 	while ((commit = get_revision(&rev)) != NULL) {
-		add_commit(&authors, commit, period);
+		fn(commit, cb_data);
 		release_commit_memory(the_repository->parsed_objects, commit);
 		commit->parents = NULL;
 	}
-	return authors;
 }
 
-static void print_combined_authorrow(struct string_list *authors, int from,
-				     int to, const char *name,
+/*
+ * Commits per author per day in the history of a head are kept in the
+ * "stats/<head>" index as sorted "day<TAB>author<TAB>count" lines, where
+ * day counts from the epoch. The header records the head commit and the
+ * first day covered, which is the start of the longest enabled period.
+ * When the head moves forward only the new commits are walked; when it
+ * was rewound, or a period reaches further back, the index is rebuilt.
+ */
+#define STATS_INDEX_VERSION "stats 1"
+
+static void stats_index_name(struct strbuf *name)
+{
+	const char *p;
+
+	strbuf_addstr(name, "stats/");
+	for (p = ctx.qry.head; *p; p++)
+		strbuf_addch(name, isalnum(*p) || *p == '-' ? *p : '_');
+}
+
+static void add_daily_commit(struct commit *commit, void *cb_data)
+{
+	struct strmap *counts = cb_data;
+	char *author = cgit_parse_commit_author(commit);
+	struct strbuf key = STRBUF_INIT;
+	const char *p;
+	uintptr_t count;
+
+	strbuf_addf(&key, "%08ld\t", (long)(commit->date / DAY_SECS));
+	for (p = author; *p; p++)
+		strbuf_addch(&key, *p == '\t' ? ' ' : *p);
+	count = (uintptr_t)strmap_get(counts, key.buf);
+	strmap_put(counts, key.buf, (void *)(count + 1));
+	strbuf_release(&key);
+	free(author);
+}
+
+/* Load the index if it can be extended to `tip`, returning its head. */
+static int read_stats_index(const char *name, long first_day,
+			    const struct object_id *tip,
+			    struct object_id *base, struct strmap *counts)
+{
+	struct repo_cache_map map;
+	struct commit *old, *new;
+	const char *header, *line, *end, *eol, *tab;
+	long day;
+	char *p;
+
+	if (repo_cache_open(&map, name, NULL))
+		return -1;
+	header = map.map;
+	if (!skip_prefix(header, STATS_INDEX_VERSION " ", &header))
+		goto fail;
+	day = strtol(header, &p, 10);
+	if (*p != ' ' || parse_oid_hex(p + 1, base, &header) ||
+	    *header != '\n' || day > first_day)
+		goto fail;
+	if (!oideq(base, tip)) {
+		old = lookup_commit_reference_gently(the_repository, base, 1);
+		new = lookup_commit_reference(the_repository, tip);
+		if (!old || !new ||
+		    repo_in_merge_bases(the_repository, old, new) <= 0)
+			goto fail;
+	}
+
+	end = map.buf + map.len;
+	for (line = map.buf; line < end; line = eol + 1) {
+		eol = memchr(line, '\n', end - line);
+		if (!eol)
+			break;
+		for (tab = eol; tab > line && *tab != '\t'; tab--)
+			;
+		if (tab == line || strtol(line, NULL, 10) < first_day)
+			continue;
+		p = xstrndup(line, tab - line);
+		strmap_put(counts, p, (void *)(uintptr_t)strtoul(tab + 1, NULL, 10));
+		free(p);
+	}
+	repo_cache_close(&map);
+	return 0;
+
+fail:
+	repo_cache_close(&map);
+	return -1;
+}
+
+static void store_stats_index(const char *name, long first_day,
+			      const struct object_id *tip,
+			      struct strmap *counts)
+{
+	struct string_list lines = STRING_LIST_INIT_NODUP;
+	struct string_list_item *item;
+	struct strbuf buf = STRBUF_INIT;
+	struct hashmap_iter iter;
+	struct strmap_entry *entry;
+	char *token;
+
+	strmap_for_each_entry(counts, &iter, entry)
+		if (strtol(entry->key, NULL, 10) >= first_day)
+			string_list_append(&lines, entry->key)->util = entry->value;
+	string_list_sort(&lines);
+	for_each_string_list_item(item, &lines)
+		strbuf_addf(&buf, "%s\t%"PRIuMAX"\n", item->string,
+			    (uintmax_t)(uintptr_t)item->util);
+
+	token = xstrfmt(STATS_INDEX_VERSION " %ld %s", first_day,
+			oid_to_hex(tip));
+	repo_cache_store(name, token, buf.buf, buf.len);
+	free(token);
+	strbuf_release(&buf);
+	string_list_clear(&lines, 0);
+}
+
+/* Fill `counts` with the commits per "day<TAB>author" since `first_day`. */
+static void collect_daily_stats(struct strmap *counts, long first_day)
+{
+	struct strbuf name = STRBUF_INIT;
+	struct object_id oid, tip, base;
+	struct commit *commit;
+	const char *argv[] = { NULL, NULL, NULL, NULL };
+
+	if (repo_get_oid(the_repository, ctx.qry.head, &oid))
+		return;
+	commit = lookup_commit_reference(the_repository, &oid);
+	if (!commit)
+		return;
+	oidcpy(&tip, &commit->object.oid);
+
+	stats_index_name(&name);
+	if (!read_stats_index(name.buf, first_day, &tip, &base, counts)) {
+		if (oideq(&base, &tip))
+			goto out;
+		argv[2] = xstrfmt("^%s", oid_to_hex(&base));
+	} else {
+		argv[2] = since_arg(first_day);
+	}
+	argv[1] = xstrdup(oid_to_hex(&tip));
+	walk_commits(3, argv, add_daily_commit, counts);
+	store_stats_index(name.buf, first_day, &tip, counts);
+	free((char *)argv[1]);
+	free((char *)argv[2]);
+out:
+	strbuf_release(&name);
+}
+
+static void add_commit(struct commit *commit, void *cb_data)
+{
+	char *author = cgit_parse_commit_author(commit);
+
+	add_count(cb_data, author, commit->date / DAY_SECS, 1);
+	free(author);
+}
+
+/* Count the commits per author per period, from the daily stats index if
+ * there is one or else by walking the commit DAG.
+ */
+static void collect_stats(struct stats *stats)
+{
+	const char *argv[] = {NULL, ctx.qry.head, NULL, NULL, NULL, NULL};
+	int argc = 3;
+	long start = stats->bounds[0];
+
+	if (!ctx.qry.path && repo_cache_enabled()) {
+		struct strmap counts = STRMAP_INIT;
+		struct hashmap_iter iter;
+		struct strmap_entry *entry;
+		long first_day = period_start_day(&periods[ctx.repo->max_stats - 1]);
+
+		collect_daily_stats(&counts, first_day < start ? first_day : start);
+		strmap_for_each_entry(&counts, &iter, entry) {
+			long day = strtol(entry->key, NULL, 10);
+
+			if (day < start)
+				continue;
+			add_count(stats, strchr(entry->key, '\t') + 1, day,
+				  (uintptr_t)entry->value);
+		}
+		strmap_clear(&counts, 0);
+		return;
+	}
+
+	argv[2] = since_arg(start);
+	if (ctx.qry.path) {
+		argv[3] = "--";
+		argv[4] = ctx.qry.path;
+		argc += 2;
+	}
+	walk_commits(argc, argv, add_commit, stats);
+	free((char *)argv[2]);
+}
+
+static void print_combined_authorrow(const struct stats *stats,
+				     const size_t *order, size_t from,
+				     size_t to, const char *name,
 				     const char *leftclass,
 				     const char *centerclass,
-				     const char *rightclass,
-				     const struct cgit_period *period)
+				     const char *rightclass)
 {
-	struct string_list_item *author;
-	struct authorstat *authorstat;
-	struct string_list *items;
-	struct string_list_item *date;
-	time_t now;
-	long i, j, total, subtotal;
-	struct tm tm;
-	char *tmp;
+	int ncols = stats->period->count, j;
+	long total = 0, subtotal;
+	size_t i;
 
-	time(&now);
-	gmtime_r(&now, &tm);
-	period->trunc(&tm);
-	for (i = 1; i < period->count; i++)
-		period->dec(&tm);
-
-	total = 0;
 	htmlf("<tr><td class='%s'>%s</td>", leftclass,
-		fmt(name, to - from + 1));
-	for (j = 0; j < period->count; j++) {
-		tmp = period->pretty(&tm);
-		period->inc(&tm);
+		fmt(name, (long)(to - from)));
+	for (j = 0; j < ncols; j++) {
 		subtotal = 0;
-		for (i = from; i <= to; i++) {
-			author = &authors->items[i];
-			authorstat = author->util;
-			items = &authorstat->list;
-			date = string_list_lookup(items, tmp);
-			if (date)
-				subtotal += (uintptr_t)date->util;
-		}
+		for (i = from; i < to; i++)
+			subtotal += stats->counts[order[i] * ncols + j];
 		htmlf("<td class='%s'>%ld</td>", centerclass, subtotal);
 		total += subtotal;
 	}
 	htmlf("<td class='%s'>%ld</td></tr>", rightclass, total);
 }
 
-static void print_authors(struct string_list *authors, int top,
-			  const struct cgit_period *period)
+static void print_authors(const struct stats *stats, const size_t *order,
+			  size_t top)
 {
-	struct string_list_item *author;
-	struct authorstat *authorstat;
-	struct string_list *items;
-	struct string_list_item *date;
-	time_t now;
-	long i, j, total;
+	const struct cgit_period *period = stats->period;
+	int ncols = period->count, j;
+	long total, count;
+	size_t i;
 	struct tm tm;
-	char *tmp;
-
-	time(&now);
-	gmtime_r(&now, &tm);
-	period->trunc(&tm);
-	for (i = 1; i < period->count; i++)
-		period->dec(&tm);
+	time_t t;
 
 	html("<table class='stats'><tr><th>Author</th>");
-	for (j = 0; j < period->count; j++) {
-		tmp = period->pretty(&tm);
-		htmlf("<th>%s</th>", tmp);
-		period->inc(&tm);
+	for (j = 0; j < ncols; j++) {
+		t = (time_t)stats->bounds[j] * DAY_SECS;
+		gmtime_r(&t, &tm);
+		htmlf("<th>%s</th>", period->pretty(&tm));
 	}
 	html("<th>Total</th></tr>\n");
 
-	if (top <= 0 || top > authors->nr)
-		top = authors->nr;
-
 	for (i = 0; i < top; i++) {
-		author = &authors->items[i];
+		const long *row = stats->counts + order[i] * ncols;
+
 		html("<tr><td class='left'>");
-		html_txt(author->string);
+		html_txt(stats->names[order[i]]);
 		html("</td>");
-		authorstat = author->util;
-		items = &authorstat->list;
 		total = 0;
-		for (j = 0; j < period->count; j++)
-			period->dec(&tm);
-		for (j = 0; j < period->count; j++) {
-			tmp = period->pretty(&tm);
-			period->inc(&tm);
-			date = string_list_lookup(items, tmp);
-			if (!date)
-				html("<td>0</td>");
-			else {
-				htmlf("<td>%lu</td>", (uintptr_t)date->util);
-				total += (uintptr_t)date->util;
-			}
+		for (j = 0; j < ncols; j++) {
+			count = row[j];
+			htmlf("<td>%ld</td>", count);
+			total += count;
 		}
 		htmlf("<td class='sum'>%ld</td></tr>", total);
 	}
 
-	if (top < authors->nr)
-		print_combined_authorrow(authors, top, authors->nr - 1,
-			"Others (%ld)", "left", "", "sum", period);
+	if (top < stats->nr)
+		print_combined_authorrow(stats, order, top, stats->nr,
+			"Others (%ld)", "left", "", "sum");
 
-	print_combined_authorrow(authors, 0, authors->nr - 1, "Total",
-		"total", "sum", "sum", period);
+	print_combined_authorrow(stats, order, 0, stats->nr, "Total",
+		"total", "sum", "sum");
 	html("</table>");
 }
 
-/* Create a sorted string_list with one entry per author. The util-field
- * for each author is another string_list which is used to calculate the
- * number of commits per time-interval.
+/* Count the commits of each author per time-interval and show the most
+ * active authors first.
  */
 void cgit_show_stats(void)
 {
-	struct string_list authors;
+	struct stats stats;
 	const struct cgit_period *period;
+	size_t *order, k;
 	int top, i;
 	const char *code = "w";
 
@@ -388,9 +597,13 @@ void cgit_show_stats(void)
 			"Statistics type disabled: %s", period->name);
 		return;
 	}
-	authors = collect_stats(period);
-	qsort(authors.items, authors.nr, sizeof(struct string_list_item),
-		cmp_total_commits);
+	init_stats(&stats, period);
+	collect_stats(&stats);
+	ALLOC_ARRAY(order, stats.nr);
+	for (k = 0; k < stats.nr; k++)
+		order[k] = k;
+	sort_stats = &stats;
+	QSORT(order, stats.nr, cmp_total_commits);
 
 	top = ctx.qry.ofs;
 	if (!top)
@@ -430,7 +643,10 @@ void cgit_show_stats(void)
 		html("')");
 	}
 	html("</h2>");
-	print_authors(&authors, top, period);
+	print_authors(&stats, order,
+		      top <= 0 || top > stats.nr ? stats.nr : top);
 	cgit_print_layout_end();
+	free(order);
+	free_stats(&stats);
 }
 
@@ -17,6 +17,9 @@
 #include "ui-plain.h"
 #include "ui-refs.h"
 #include "ui-shared.h"
+#include "ref-snapshot.h"
+#include "repo-cache.h"
+#include "tree-walk.h"
 
 static int urls;
 #define MAX_METADATA_BYTES (64 * 1024)
@@ -63,38 +66,247 @@ static char *find_spdx_identifier(const char *buf, size_t size)
 	return NULL;
 }
 
-static char *detect_spdx_for_path(const char *path)
+static const char *const license_paths[] = {
+	"LICENSE",
+	"LICENSE.md",
+	"LICENSE.txt",
+	"LICENCE",
+	"LICENCE.md",
+	"LICENCE.txt",
+	"COPYING",
+	"COPYING.md",
+	"COPYING.txt",
+};
+
+static const char *const codeowners_paths[] = {
+	"CODEOWNERS",
+	".github/CODEOWNERS",
+	"docs/CODEOWNERS",
+	".gitlab/CODEOWNERS",
+};
+
+static const char *const maintainers_paths[] = {
+	"MAINTAINERS",
+	"MAINTAINERS.md",
+	"MAINTAINERS.txt",
+	"MAINTAINER",
+	"MAINTAINER.md",
+	"MAINTAINER.txt",
+};
+
+enum metadata_kind {
+	META_LICENSE,
+	META_CODEOWNERS,
+	META_MAINTAINERS,
+	META_NR
+};
+
+static const struct {
+	const char *const *paths;
+	size_t nr;
+} metadata_candidates[META_NR] = {
+	{ license_paths, ARRAY_SIZE(license_paths) },
+	{ codeowners_paths, ARRAY_SIZE(codeowners_paths) },
+	{ maintainers_paths, ARRAY_SIZE(maintainers_paths) },
+};
+
+struct repo_metadata {
+	char *path[META_NR];
+	char *license_spdx;
+};
+
+struct metadata_scan {
+	size_t best[META_NR];	/* index of the best candidate found so far */
+	struct object_id license_oid;
+};
+
+/*
+ * The metadata box only depends on the root tree, so it is resolved in
+ * a single pass over the root tree and the subtrees candidates live in,
+ * and kept in the "summary-metadata" index as one line per tree:
+ *
+ *   tree<TAB>license<TAB>spdx<TAB>codeowners<TAB>maintainers
+ *
+ * with empty fields for what the tree does not have.
+ */
+#define METADATA_INDEX "summary-metadata"
+#define METADATA_INDEX_MAX_LINES 4096
+
+static int is_metadata_dir(const char *path, size_t len)
+{
+	size_t k, i;
+
+	for (k = 0; k < META_NR; k++)
+		for (i = 0; i < metadata_candidates[k].nr; i++) {
+			const char *candidate = metadata_candidates[k].paths[i];
+
+			if (!strncmp(candidate, path, len) &&
+			    candidate[len] == '/')
+				return 1;
+		}
+	return 0;
+}
+
+static void match_metadata_path(struct metadata_scan *scan, const char *path,
+				const struct object_id *oid)
+{
+	size_t k, i;
+
+	for (k = 0; k < META_NR; k++)
+		for (i = 0; i < scan->best[k]; i++) {
+			if (strcmp(metadata_candidates[k].paths[i], path))
+				continue;
+			scan->best[k] = i;
+			if (k == META_LICENSE)
+				oidcpy(&scan->license_oid, oid);
+			break;
+		}
+}
+
+static void scan_metadata_tree(struct metadata_scan *scan,
+			       const struct object_id *tree, const char *prefix)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct tree_desc desc;
+	struct name_entry entry;
+	void *buf;
+
+	buf = fill_tree_descriptor(the_repository, &desc, tree);
+	if (!buf)
+		return;
+	while (tree_entry(&desc, &entry)) {
+		strbuf_reset(&path);
+		strbuf_addstr(&path, prefix);
+		strbuf_add(&path, entry.path, entry.pathlen);
+		if (S_ISREG(entry.mode))
+			match_metadata_path(scan, path.buf, &entry.oid);
+		else if (S_ISDIR(entry.mode) && !*prefix &&
+			 is_metadata_dir(path.buf, path.len)) {
+			strbuf_addch(&path, '/');
+			scan_metadata_tree(scan, &entry.oid, path.buf);
+		}
+	}
+	strbuf_release(&path);
+	free(buf);
+}
+
+static char *detect_spdx(const struct object_id *oid)
 {
-	char *buf = NULL;
-	unsigned long size = 0;
-	char *spdx = NULL;
+	enum object_type type;
+	unsigned long size;
+	char *buf, *spdx = NULL, *p;
 
-	if (!path || !ctx.qry.head)
+	if (oid_object_info(the_repository, oid, &size) != OBJ_BLOB ||
+	    size > MAX_METADATA_BYTES)
 		return NULL;
-	if (cgit_ref_read_file(path, ctx.qry.head, 1, &buf, &size))
+	buf = repo_read_object_file(the_repository, oid, &type, &size);
+	if (!buf)
 		return NULL;
-	if (size > MAX_METADATA_BYTES)
-		goto out;
 	spdx = find_spdx_identifier(buf, size);
-
-out:
 	free(buf);
+
+	/* the identifier is kept in a tab separated index */
+	for (p = spdx; p && *p; p++)
+		if (*p == '\t')
+			*p = ' ';
 	return spdx;
 }
 
-static char *find_first_repo_path(const char **candidates, size_t nr)
+static void resolve_metadata(const struct object_id *tree,
+			     struct repo_metadata *meta)
 {
-	size_t i;
-	const char *ref = ctx.qry.head;
+	struct metadata_scan scan;
+	size_t k;
+
+	for (k = 0; k < META_NR; k++)
+		scan.best[k] = metadata_candidates[k].nr;
+	scan_metadata_tree(&scan, tree, "");
+
+	for (k = 0; k < META_NR; k++)
+		if (scan.best[k] < metadata_candidates[k].nr)
+			meta->path[k] = xstrdup(metadata_candidates[k].paths[scan.best[k]]);
+	if (meta->path[META_LICENSE])
+		meta->license_spdx = detect_spdx(&scan.license_oid);
+}
 
-	if (!ref)
-		return NULL;
+static char **metadata_field(struct repo_metadata *meta, int i)
+{
+	switch (i) {
+	case 0:
+		return &meta->path[META_LICENSE];
+	case 1:
+		return &meta->license_spdx;
+	case 2:
+		return &meta->path[META_CODEOWNERS];
+	default:
+		return &meta->path[META_MAINTAINERS];
+	}
+}
 
-	for (i = 0; i < nr; i++) {
-		if (cgit_ref_path_exists(candidates[i], ref, 1))
-			return xstrdup(candidates[i]);
+static int parse_metadata(const char *line, const char *end,
+			  struct repo_metadata *meta)
+{
+	const char *fields[4], *eol = memchr(line, '\n', end - line);
+	int i;
+
+	if (!eol)
+		return -1;
+	for (i = 0; i < 4; i++) {
+		fields[i] = memchr(line, '\t', eol - line);
+		if (!fields[i])
+			return -1;
+		line = fields[i] + 1;
 	}
-	return NULL;
+	for (i = 0; i < 4; i++) {
+		const char *next = i < 3 ? fields[i + 1] : eol;
+
+		if (next > fields[i] + 1)
+			*metadata_field(meta, i) = xstrndup(fields[i] + 1,
+							    next - fields[i] - 1);
+	}
+	return 0;
+}
+
+static void load_metadata(struct repo_metadata *meta)
+{
+	struct string_list lines = STRING_LIST_INIT_NODUP;
+	struct repo_cache_map index;
+	struct strbuf line = STRBUF_INIT;
+	struct object_id oid;
+	struct commit *commit;
+	const char *hex, *found;
+	int i;
+
+	if (!ctx.qry.head || repo_get_oid(the_repository, ctx.qry.head, &oid))
+		return;
+	commit = lookup_commit_reference(the_repository, &oid);
+	if (!commit || repo_parse_commit(the_repository, commit))
+		return;
+	hex = oid_to_hex(get_commit_tree_oid(commit));
+
+	repo_cache_open(&index, METADATA_INDEX, "1");
+	found = repo_cache_lookup(index.buf, index.len, hex);
+	if (found && !parse_metadata(found, index.buf + index.len, meta)) {
+		repo_cache_close(&index);
+		return;
+	}
+
+	resolve_metadata(get_commit_tree_oid(commit), meta);
+	if (repo_cache_enabled()) {
+		strbuf_addstr(&line, hex);
+		for (i = 0; i < 4; i++) {
+			const char *field = *metadata_field(meta, i);
+
+			strbuf_addf(&line, "\t%s", field ? field : "");
+		}
+		strbuf_addch(&line, '\n');
+		string_list_append(&lines, line.buf);
+		repo_cache_update(METADATA_INDEX, "1", &index, &lines,
+				  METADATA_INDEX_MAX_LINES);
+		string_list_clear(&lines, 0);
+		strbuf_release(&line);
+	}
+	repo_cache_close(&index);
 }
 
 static void print_repo_file_link(const char *path)
@@ -106,38 +318,14 @@ static void print_repo_file_link(const char *path)
 
 static void print_repo_metadata(void)
 {
-	static const char *license_candidates[] = {
-		"LICENSE",
-		"LICENSE.md",
-		"LICENSE.txt",
-		"LICENCE",
-		"LICENCE.md",
-		"LICENCE.txt",
-		"COPYING",
-		"COPYING.md",
-		"COPYING.txt",
-	};
-	static const char *codeowners_candidates[] = {
-		"CODEOWNERS",
-		".github/CODEOWNERS",
-		"docs/CODEOWNERS",
-		".gitlab/CODEOWNERS",
-	};
-	static const char *maintainers_candidates[] = {
-		"MAINTAINERS",
-		"MAINTAINERS.md",
-		"MAINTAINERS.txt",
-		"MAINTAINER",
-		"MAINTAINER.md",
-		"MAINTAINER.txt",
-	};
-	char *license_path = find_first_repo_path(license_candidates,
-						  ARRAY_SIZE(license_candidates));
-	char *license_spdx = license_path ? detect_spdx_for_path(license_path) : NULL;
-	char *codeowners_path = find_first_repo_path(codeowners_candidates,
-						     ARRAY_SIZE(codeowners_candidates));
-	char *maintainers_path = find_first_repo_path(maintainers_candidates,
-						      ARRAY_SIZE(maintainers_candidates));
+	struct repo_metadata meta = { { NULL } };
+	const char *license_path, *codeowners_path, *maintainers_path;
+	size_t k;
+
+	load_metadata(&meta);
+	license_path = meta.path[META_LICENSE];
+	codeowners_path = meta.path[META_CODEOWNERS];
+	maintainers_path = meta.path[META_MAINTAINERS];
 
 	if (!license_path && !codeowners_path && !maintainers_path)
 		goto cleanup;
@@ -150,8 +338,8 @@ static void print_repo_metadata(void)
 
 	if (license_path) {
 		html("<tr><td class='left'>License</td><td class='left'>");
-		if (license_spdx) {
-			html_txt(license_spdx);
+		if (meta.license_spdx) {
+			html_txt(meta.license_spdx);
 			html(" (");
 			print_repo_file_link(license_path);
 			html(")");
@@ -177,54 +365,34 @@ static void print_repo_metadata(void)
 	html("</div>");
 
 cleanup:
-	free(license_spdx);
-	free(license_path);
-	free(codeowners_path);
-	free(maintainers_path);
+	free(meta.license_spdx);
+	for (k = 0; k < META_NR; k++)
+		free(meta.path[k]);
 }
 
-static unsigned long ref_age(const struct refinfo *ref)
-{
-	if (!ref || !ref->object)
-		return 0;
-	switch (ref->object->type) {
-	case OBJ_TAG:
-		return ref->tag ? ref->tag->tagger_date : 0;
-	case OBJ_COMMIT:
-		return ref->commit ? ref->commit->committer_date : 0;
-	default:
-		return 0;
-	}
-}
+struct latest_tag {
+	char *name;
+	timestamp_t date;
+};
 
-static int cmp_ref_age_desc(const void *a, const void *b)
+static int find_latest_tag(const struct cgit_ref_entry *ref, void *cb_data)
 {
-	const struct refinfo *r1 = *(const struct refinfo **)a;
-	const struct refinfo *r2 = *(const struct refinfo **)b;
-	unsigned long age1 = ref_age(r1);
-	unsigned long age2 = ref_age(r2);
+	struct latest_tag *latest = cb_data;
 
-	if (age1 == age2)
+	if (latest->name && ref->date <= latest->date)
 		return 0;
-	return (age1 > age2) ? -1 : 1;
+	free(latest->name);
+	latest->name = xstrdup(ref->refname + strlen("refs/tags/"));
+	latest->date = ref->date;
+	return 0;
 }
 
 static char *get_latest_tag_name(void)
 {
-	struct reflist list;
-	char *result = NULL;
+	struct latest_tag latest = { NULL, 0 };
 
-	memset(&list, 0, sizeof(list));
-	refs_for_each_tag_ref(get_main_ref_store(the_repository),
-			      cgit_refs_cb, &list);
-	if (!list.count)
-		goto cleanup;
-	qsort(list.refs, list.count, sizeof(*list.refs), cmp_ref_age_desc);
-	result = xstrdup(list.refs[0]->refname);
-
-cleanup:
-	cgit_free_reflist_inner(&list);
-	return result;
+	cgit_for_each_snapshot_ref("refs/tags/", find_latest_tag, &latest);
+	return latest.name;
 }
 
 static void print_repo_badges(void)
@@ -372,6 +540,7 @@ static char* append_readme_path(const char *filename, const char *ref, const cha
 void cgit_print_repo_readme(const char *path)
 {
 	char *filename, *ref, *mimetype;
+	struct object_id blob;
 	int free_filename = 0;
 
 	mimetype = get_mimetype_for_filename(path);
@@ -403,9 +572,10 @@ void cgit_print_repo_readme(const char *path)
 	 */
 	html("<div id='summary'>");
 	cgit_open_filter(ctx.repo->about_filter, filename);
-	if (ref)
-		cgit_print_file(filename, ref, 1);
-	else
+	if (ref) {
+		if (!cgit_print_file(filename, ref, 1, &blob))
+			cgit_set_filter_blob(ctx.repo->about_filter, &blob);
+	} else
 		html_include(filename);
 	cgit_close_filter(ctx.repo->about_filter);
 
@@ -13,12 +13,21 @@
 #include "ui-tree.h"
 #include "html.h"
 #include "ui-shared.h"
+#include "repo-cache.h"
+#include "oidset.h"
+#include "prio-queue.h"
+#include "packfile.h"
+#include "tree-walk.h"
+#include "read-cache-ll.h"
 
 struct walk_tree_context {
 	char *curr_rev;
 	char *match_path;
 	int state;
+	struct object_id tree_oid;
+	struct commit *commit;
 	struct string_list *subtrees;
+	struct string_list commits;
 };
 
 static const char *commit_message_body(const char *buf)
@@ -54,7 +63,7 @@ static void add_subtree_dir(struct string_list *subtrees, const char *dir,
 
 	if (!dir || !*dir)
 		return;
-	if (string_list_lookup(subtrees, dir))
+	if (unsorted_string_list_lookup(subtrees, dir))
 		return;
 	item = string_list_append(subtrees, dir);
 	if (split && *split)
@@ -104,44 +113,166 @@ static void parse_subtree_trailers(const char *buf, struct string_list *subtrees
 	free(split);
 }
 
-static void collect_subtrees(const char *rev, struct string_list *subtrees)
+/*
+ * The subtree directories known at a commit are recorded in the
+ * "subtrees" index, one "commit<TAB>dir<TAB>split" line per directory
+ * (or a bare "commit" line if there are none). Only tips we were asked
+ * about are recorded, and the walk for a new tip stops at any recorded
+ * ancestor, so that moving a branch forward only scans the new commits.
+ */
+#define SUBTREE_INDEX "subtrees"
+#define SUBTREE_INDEX_MAX_TIPS 1024
+
+static void add_indexed_subtrees(struct repo_cache_map *index,
+				 const char *line, struct string_list *subtrees)
 {
-	struct rev_info revs;
-	struct commit *commit;
-	struct strvec rev_argv = STRVEC_INIT;
+	const char *end = index->buf + index->len;
+
+	for (; line; line = repo_cache_next(index->buf, index->len, line)) {
+		const char *eol = memchr(line, '\n', end - line);
+		const char *dir, *split;
+		char *d, *s;
+
+		if (!eol)
+			eol = end;
+		dir = memchr(line, '\t', eol - line);
+		if (!dir)
+			continue;
+		dir++;
+		split = memchr(dir, '\t', eol - dir);
+		d = xmemdupz(dir, (split ? split : eol) - dir);
+		s = split ? xmemdupz(split + 1, eol - split - 1) : NULL;
+		add_subtree_dir(subtrees, d, s);
+		free(d);
+		free(s);
+	}
+}
+
+static int count_indexed_tips(struct repo_cache_map *index)
+{
+	const char *line = index->buf, *end = index->buf + index->len;
 	int count = 0;
-	int limit;
 
-	if (!ctx.repo->enable_subtree || !rev)
+	while (line < end) {
+		const char *eol = memchr(line, '\n', end - line);
+
+		if (!repo_cache_next(index->buf, index->len, line))
+			count++;
+		line = eol ? eol + 1 : end;
+	}
+	return count;
+}
+
+static void store_subtrees(struct repo_cache_map *index, const char *token,
+			   const struct commit *tip,
+			   const struct string_list *subtrees)
+{
+	const char *hex = oid_to_hex(&tip->object.oid);
+	struct strbuf buf = STRBUF_INIT;
+	const char *pos = NULL;
+	size_t i;
+
+	if (!repo_cache_enabled())
 		return;
 
-	strvec_push(&rev_argv, "subtree_rev_setup");
-	strvec_push(&rev_argv, rev);
+	/* Start over rather than letting the index grow forever; recent
+	 * tips are recorded again as soon as they are viewed.
+	 */
+	if (index->buf && count_indexed_tips(index) < SUBTREE_INDEX_MAX_TIPS) {
+		pos = repo_cache_seek(index->buf, index->len, hex);
+		strbuf_add(&buf, index->buf, pos - index->buf);
+	}
+	for (i = 0; i < subtrees->nr; i++) {
+		const char *dir = subtrees->items[i].string;
+		const char *split = subtrees->items[i].util;
 
-	repo_init_revisions(the_repository, &revs, NULL);
-	revs.abbrev = DEFAULT_ABBREV;
-	revs.commit_format = CMIT_FMT_DEFAULT;
-	revs.ignore_missing = 1;
-	setup_revisions(rev_argv.nr, rev_argv.v, &revs, NULL);
-	prepare_revision_walk(&revs);
+		if (strchr(dir, '\t') || (split && strchr(split, '\t')))
+			goto out;
+		strbuf_addf(&buf, "%s\t%s\t%s\n", hex, dir, split ? split : "");
+	}
+	if (!subtrees->nr)
+		strbuf_addf(&buf, "%s\n", hex);
+	if (pos)
+		strbuf_add(&buf, pos, index->buf + index->len - pos);
+	repo_cache_store(SUBTREE_INDEX, token, buf.buf, buf.len);
+out:
+	strbuf_release(&buf);
+}
+
+static void collect_subtrees(struct commit *tip, struct string_list *subtrees)
+{
+	struct repo_cache_map index;
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct oidset seen = OIDSET_INIT;
+	const char **indexed = NULL;
+	size_t indexed_nr = 0, indexed_alloc = 0, i;
+	struct commit *commit;
+	const char *line;
+	char *token;
+	int count = 0;
+	int limit;
 
 	limit = ctx.repo->max_subtree_commits;
 	if (limit <= 0)
 		limit = INT_MAX;
 
-	while (count < limit && (commit = get_revision(&revs)) != NULL) {
-		const char *buf = repo_get_commit_buffer(the_repository, commit, NULL);
+	/* The recorded directories depend on how far we were allowed to
+	 * look, so a different limit needs a different index.
+	 */
+	token = xstrfmt("subtree %d", limit);
+	repo_cache_open(&index, SUBTREE_INDEX, token);
+
+	line = repo_cache_lookup(index.buf, index.len,
+				 oid_to_hex(&tip->object.oid));
+	if (line) {
+		add_indexed_subtrees(&index, line, subtrees);
+		goto out;
+	}
+
+	oidset_insert(&seen, &tip->object.oid);
+	prio_queue_put(&queue, tip);
+	while (count < limit && (commit = prio_queue_get(&queue)) != NULL) {
+		struct commit_list *parents;
+		const char *buf;
+
+		line = repo_cache_lookup(index.buf, index.len,
+					 oid_to_hex(&commit->object.oid));
+		if (line) {
+			/* Applied after the walk, so that trailers of newer
+			 * commits take precedence.
+			 */
+			ALLOC_GROW(indexed, indexed_nr + 1, indexed_alloc);
+			indexed[indexed_nr++] = line;
+			continue;
+		}
+		if (repo_parse_commit(the_repository, commit))
+			continue;
+		buf = repo_get_commit_buffer(the_repository, commit, NULL);
 		if (buf)
 			parse_subtree_trailers(buf, subtrees);
-		release_commit_memory(the_repository->parsed_objects, commit);
-		commit->parents = NULL;
+		repo_unuse_commit_buffer(the_repository, commit, buf);
+		for (parents = commit->parents; parents; parents = parents->next) {
+			struct commit *parent = parents->item;
+
+			if (!oidset_insert(&seen, &parent->object.oid))
+				prio_queue_put(&queue, parent);
+		}
 		count++;
 	}
-
-	strvec_clear(&rev_argv);
+	for (i = 0; i < indexed_nr; i++)
+		add_indexed_subtrees(&index, indexed[i], subtrees);
+
+	store_subtrees(&index, token, tip, subtrees);
+	free(indexed);
+	clear_prio_queue(&queue);
+	oidset_clear(&seen);
+out:
+	repo_cache_close(&index);
+	free(token);
 }
 
-static void print_text_buffer(const char *name, char *buf, unsigned long size)
+static void print_text_buffer(const char *name, const struct object_id *oid,
+			      char *buf, unsigned long size)
 {
 	unsigned long lineno, idx;
 	const char *numberfmt = "<a id='n%1$d' href='#n%1$d'>%1$d</a>\n";
@@ -170,6 +301,7 @@ static void print_text_buffer(const char *name, char *buf, unsigned long size)
 	if (ctx.repo->source_filter) {
 		char *filter_arg = xstrdup(name);
 		html("<td class='lines'><pre><code>");
+		cgit_set_filter_blob(ctx.repo->source_filter, oid);
 		cgit_open_filter(ctx.repo->source_filter, filter_arg);
 		html_raw(buf, size);
 		cgit_close_filter(ctx.repo->source_filter);
@@ -252,13 +384,24 @@ static void print_object(const struct object_id *oid, const char *path, const ch
 	if (is_binary)
 		print_binary_buffer(buf, size);
 	else
-		print_text_buffer(basename, buf, size);
+		print_text_buffer(basename, oid, buf, size);
 
 	free(buf);
 }
 
+/*
+ * Directories with a single subdirectory and nothing else are shown as
+ * one "a / b / c" entry. Which names such a chain is made of only
+ * depends on the tree, so the chains of the subdirectories of a listed
+ * tree are kept in its "chains/<tree>" index, one "tree<TAB>b/c" line
+ * per subdirectory (with an empty chain if it does not collapse).
+ */
+#define CHAIN_INDEX "chains"
+
+static struct repo_cache_map chain_index;
+static struct string_list new_chains = STRING_LIST_INIT_DUP;
+
 struct single_tree_ctx {
-	struct strbuf *path;
 	struct object_id oid;
 	char *name;
 	size_t count;
@@ -279,32 +422,22 @@ static int single_tree_cb(const struct object_id *oid, struct strbuf *base,
 
 	ctx->name = xstrdup(pathname);
 	oidcpy(&ctx->oid, oid);
-	strbuf_addf(ctx->path, "/%s", pathname);
 	return 0;
 }
 
-static void write_tree_link(const struct object_id *oid, char *name,
-			    char *rev, struct strbuf *fullpath)
+static void find_tree_chain(const struct object_id *oid, struct strbuf *chain)
 {
-	size_t initial_length = fullpath->len;
-	struct tree *tree;
-	struct single_tree_ctx tree_ctx = {
-		.path = fullpath,
-		.count = 1,
-	};
+	struct single_tree_ctx tree_ctx = { .count = 1 };
 	struct pathspec paths = {
 		.nr = 0
 	};
+	struct tree *tree;
 
 	oidcpy(&tree_ctx.oid, oid);
-
 	while (tree_ctx.count == 1) {
-		cgit_tree_link(name, NULL, "ls-dir", ctx.qry.head, rev,
-			       fullpath->buf);
-
 		tree = lookup_tree(the_repository, &tree_ctx.oid);
 		if (!tree)
-			return;
+			break;
 
 		free(tree_ctx.name);
 		tree_ctx.name = NULL;
@@ -315,27 +448,438 @@ static void write_tree_link(const struct object_id *oid, char *name,
 		if (tree_ctx.count != 1)
 			break;
 
+		if (chain->len)
+			strbuf_addch(chain, '/');
+		strbuf_addstr(chain, tree_ctx.name);
+	}
+	free(tree_ctx.name);
+}
+
+static void get_tree_chain(const struct object_id *oid, struct strbuf *chain)
+{
+	const char *hex = oid_to_hex(oid);
+	const char *line = repo_cache_lookup(chain_index.buf, chain_index.len,
+					     hex);
+
+	if (line) {
+		const char *end = chain_index.buf + chain_index.len;
+		const char *eol = memchr(line, '\n', end - line);
+		const char *names = line + strlen(hex) + 1;
+
+		if (eol && names <= eol) {
+			strbuf_add(chain, names, eol - names);
+			return;
+		}
+	}
+
+	find_tree_chain(oid, chain);
+	if (!strchr(chain->buf, '\t') && !strchr(chain->buf, '\n'))
+		string_list_append_nodup(&new_chains,
+					 xstrfmt("%s\t%s\n", hex, chain->buf));
+}
+
+static void write_tree_link(const struct object_id *oid, char *name,
+			    char *rev, struct strbuf *fullpath)
+{
+	size_t initial_length = fullpath->len;
+	struct strbuf chain = STRBUF_INIT;
+	struct string_list names = STRING_LIST_INIT_NODUP;
+	size_t i;
+
+	cgit_tree_link(name, NULL, "ls-dir", ctx.qry.head, rev,
+		       fullpath->buf);
+
+	get_tree_chain(oid, &chain);
+	if (chain.len)
+		string_list_split_in_place(&names, chain.buf, "/", -1);
+	for (i = 0; i < names.nr; i++) {
 		html(" / ");
-		name = tree_ctx.name;
+		strbuf_addf(fullpath, "/%s", names.items[i].string);
+		cgit_tree_link(names.items[i].string, NULL, "ls-dir",
+			       ctx.qry.head, rev, fullpath->buf);
 	}
 
+	string_list_clear(&names, 0);
+	strbuf_release(&chain);
 	strbuf_setlen(fullpath, initial_length);
 }
 
-static int ls_item(const struct object_id *oid, struct strbuf *base,
-		const char *pathname, unsigned mode, void *cbdata)
+struct ls_entry {
+	struct object_id oid;
+	char *name;
+	unsigned mode;
+	enum object_type type;
+	unsigned long size;
+	struct pack_entry pack;
+	struct object_id last_commit;
+	int has_last_commit;
+};
+
+struct ls_entries {
+	struct ls_entry *items;
+	size_t nr, alloc;
+};
+
+static int collect_entry(const struct object_id *oid, struct strbuf *base,
+			 const char *pathname, unsigned mode, void *cbdata)
 {
-	struct walk_tree_context *walk_tree_ctx = cbdata;
+	struct ls_entries *entries = cbdata;
+	struct ls_entry *entry;
+
+	ALLOC_GROW(entries->items, entries->nr + 1, entries->alloc);
+	entry = &entries->items[entries->nr++];
+	memset(entry, 0, sizeof(*entry));
+	oidcpy(&entry->oid, oid);
+	entry->name = xstrdup(pathname);
+	entry->mode = mode;
+	return 0;
+}
+
+static int cmp_pack_position(const void *a, const void *b)
+{
+	const struct ls_entry *e1 = *(const struct ls_entry **)a;
+	const struct ls_entry *e2 = *(const struct ls_entry **)b;
+
+	/* Group by pack, loose objects last, then in pack order. */
+	if (e1->pack.p != e2->pack.p) {
+		if (!e1->pack.p || !e2->pack.p)
+			return e1->pack.p ? -1 : 1;
+		return (uintptr_t)e1->pack.p < (uintptr_t)e2->pack.p ? -1 : 1;
+	}
+	if (e1->pack.offset != e2->pack.offset)
+		return e1->pack.offset < e2->pack.offset ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Looking up the sizes in tree order jumps all over the packs; doing it
+ * in pack order instead reads each pack front to back, which the page
+ * cache and readahead handle well.
+ */
+static void load_entry_sizes(struct ls_entry *entries, size_t count)
+{
+	struct ls_entry **order;
+	size_t i, nr = 0;
+
+	ALLOC_ARRAY(order, count);
+	for (i = 0; i < count; i++) {
+		struct ls_entry *entry = &entries[i];
+
+		if (S_ISGITLINK(entry->mode))
+			continue;
+		if (!find_pack_entry(the_repository, &entry->oid, &entry->pack))
+			entry->pack.p = NULL;
+		order[nr++] = entry;
+	}
+	qsort(order, nr, sizeof(*order), cmp_pack_position);
+
+	for (i = 0; i < nr; i++) {
+		struct ls_entry *entry = order[i];
+		struct object_info oi = OBJECT_INFO_INIT;
+
+		oi.typep = &entry->type;
+		oi.sizep = &entry->size;
+		if (!entry->pack.p ||
+		    packed_object_info(the_repository, entry->pack.p,
+				       entry->pack.offset, &oi) < 0)
+			entry->type = oid_object_info(the_repository, &entry->oid,
+						      &entry->size);
+	}
+	free(order);
+}
+
+/*
+ * The commit which last changed an entry is recorded in one
+ * "lastcommit/<tree>" index per listed tree, one "name<TAB>commit" line
+ * per entry. To answer for a new tree, the first-parent history is
+ * followed back only until the directory's tree is one which was listed
+ * before, so the cost of a listing is proportional to the number of
+ * commits made since, not to the age of its entries. A walk which gives
+ * up after LASTCOMMIT_MAX_COMMITS records the commit it stopped at in a
+ * "<TAB>commit" line, and the next listing resumes from there.
+ */
+#define LASTCOMMIT_INDEX "lastcommit"
+#define LASTCOMMIT_MAX_COMMITS 10000
+
+struct lastcommit_walk {
+	struct repo_cache_map index;
+	struct string_list unresolved;	/* entry name -> struct ls_entry */
+	struct string_list new_lines;
+	char start_tree[GIT_MAX_HEXSZ + 1];
+};
+
+static int tree_at(struct commit *commit, const char *path,
+		   struct object_id *oid)
+{
+	unsigned short mode;
+
+	if (repo_parse_commit(the_repository, commit))
+		return -1;
+	if (!path || !*path) {
+		oidcpy(oid, get_commit_tree_oid(commit));
+		return 0;
+	}
+	if (get_tree_entry(the_repository, get_commit_tree_oid(commit), path,
+			   oid, &mode) || !S_ISDIR(mode))
+		return -1;
+	return 0;
+}
+
+static int add_entry_oid(const struct object_id *oid, struct strbuf *base,
+			 const char *pathname, unsigned mode, void *cbdata)
+{
+	string_list_append(cbdata, pathname)->util = oiddup(oid);
+	return 0;
+}
+
+static void read_entry_oids(const struct object_id *oid,
+			    struct string_list *entries)
+{
+	struct tree *tree = parse_tree_indirect(oid);
+	struct pathspec paths = {
+		.nr = 0
+	};
+
+	if (tree)
+		read_tree(the_repository, tree, &paths, add_entry_oid, entries);
+	string_list_sort(entries);
+}
+
+static void set_last_commit(struct lastcommit_walk *walk,
+			    struct ls_entry *entry,
+			    const struct object_id *commit, int record)
+{
+	oidcpy(&entry->last_commit, commit);
+	entry->has_last_commit = 1;
+	if (record && !strchr(entry->name, '\t') && !strchr(entry->name, '\n'))
+		string_list_append_nodup(&walk->new_lines,
+			xstrfmt("%s\t%s\n", entry->name, oid_to_hex(commit)));
+}
+
+static void drop_resolved(struct string_list *unresolved)
+{
+	size_t i, nr = 0;
+
+	for (i = 0; i < unresolved->nr; i++) {
+		struct ls_entry *entry = unresolved->items[i].util;
+
+		if (!entry->has_last_commit)
+			unresolved->items[nr++] = unresolved->items[i];
+	}
+	unresolved->nr = nr;
+}
+
+static int open_lastcommit_index(struct repo_cache_map *index,
+				 const char *tree)
+{
+	char *name = xstrfmt("%s/%s", LASTCOMMIT_INDEX, tree);
+	int ret = repo_cache_open(index, name, "1");
+
+	free(name);
+	return ret;
+}
+
+/* Resolve the entries `index` knows about. Returns 1 and sets `resume`
+ * if the walk which built it stopped before resolving all of its entries.
+ */
+static int resolve_indexed(struct lastcommit_walk *walk,
+			   const struct repo_cache_map *index, int record,
+			   struct object_id *resume)
+{
+	const char *line = index->buf;
+	const char *end = index->buf + index->len;
+	int stopped = 0;
+
+	while (line && line < end) {
+		const char *eol = memchr(line, '\n', end - line);
+		const char *hex = memchr(line, '\t', end - line);
+		struct string_list_item *item;
+		struct object_id commit;
+		char *name;
+
+		if (!eol)
+			break;
+		if (hex && hex < eol && eol - ++hex >= the_hash_algo->hexsz &&
+		    !get_oid_hex(hex, &commit)) {
+			if (hex - 1 == line) {
+				oidcpy(resume, &commit);
+				stopped = 1;
+				line = eol + 1;
+				continue;
+			}
+			name = xmemdupz(line, hex - 1 - line);
+			item = string_list_lookup(&walk->unresolved, name);
+			if (item)
+				set_last_commit(walk, item->util, &commit,
+						record);
+			free(name);
+		}
+		line = eol + 1;
+	}
+	drop_resolved(&walk->unresolved);
+	return stopped;
+}
+
+/* Skip to the commit an earlier walk stopped at, if it has `path`. */
+static void resume_walk(const struct object_id *resume, const char *path,
+			struct commit **commit, struct object_id *tree)
+{
+	struct commit *stopped = lookup_commit(the_repository, resume);
+	struct object_id oid;
+
+	if (stopped && !tree_at(stopped, path, &oid)) {
+		*commit = stopped;
+		oidcpy(tree, &oid);
+	}
+}
+
+static void find_last_commits(struct commit *start, const char *path,
+			      struct ls_entry *entries, size_t nr)
+{
+	struct lastcommit_walk walk = {
+		.unresolved = STRING_LIST_INIT_NODUP,
+		.new_lines = STRING_LIST_INIT_DUP,
+	};
+	struct object_id tree, parent_tree, resume;
+	struct commit *commit = start;
+	struct repo_cache_map old;
 	char *name;
+	int count = 0;
+	size_t i;
+
+	if (tree_at(start, path, &tree))
+		return;
+	oid_to_hex_r(walk.start_tree, &tree);
+	for (i = 0; i < nr; i++)
+		string_list_append(&walk.unresolved, entries[i].name)->util =
+			&entries[i];
+	string_list_sort(&walk.unresolved);
+
+	open_lastcommit_index(&walk.index, walk.start_tree);
+	if (resolve_indexed(&walk, &walk.index, 0, &resume) &&
+	    walk.unresolved.nr)
+		resume_walk(&resume, path, &commit, &tree);
+
+	while (walk.unresolved.nr && count++ < LASTCOMMIT_MAX_COMMITS) {
+		struct string_list parent_entries = STRING_LIST_INIT_DUP;
+		struct commit *parent = NULL;
+		struct repo_cache_map index;
+
+		if (commit->parents)
+			parent = commit->parents->item;
+		if (parent && !tree_at(parent, path, &parent_tree)) {
+			if (oideq(&parent_tree, &tree)) {
+				commit = parent;
+				continue;
+			}
+			read_entry_oids(&parent_tree, &parent_entries);
+		} else {
+			parent = NULL;
+		}
+
+		/* Whatever is not the same in the parent was changed here. */
+		for (i = 0; i < walk.unresolved.nr; i++) {
+			struct ls_entry *entry = walk.unresolved.items[i].util;
+			struct string_list_item *item;
+
+			item = string_list_lookup(&parent_entries, entry->name);
+			if (!item || !oideq(item->util, &entry->oid))
+				set_last_commit(&walk, entry,
+						&commit->object.oid, 1);
+		}
+		drop_resolved(&walk.unresolved);
+		string_list_clear(&parent_entries, 1);
+
+		if (!parent)
+			break;
+		commit = parent;
+		oidcpy(&tree, &parent_tree);
+		open_lastcommit_index(&index, oid_to_hex(&tree));
+		if (resolve_indexed(&walk, &index, 1, &resume) &&
+		    walk.unresolved.nr)
+			resume_walk(&resume, path, &commit, &tree);
+		repo_cache_close(&index);
+	}
+
+	/* Replace the line of where an earlier walk stopped, if any. */
+	old = walk.index;
+	if (old.len && *old.buf == '\t') {
+		const char *eol = memchr(old.buf, '\n', old.len);
+
+		if (eol) {
+			old.len -= eol + 1 - old.buf;
+			old.buf = eol + 1;
+		}
+	}
+	if (walk.unresolved.nr)
+		string_list_append_nodup(&walk.new_lines,
+			xstrfmt("\t%s\n", oid_to_hex(&commit->object.oid)));
+
+	string_list_sort(&walk.new_lines);
+	name = xstrfmt("%s/%s", LASTCOMMIT_INDEX, walk.start_tree);
+	repo_cache_update_bounded(name, "1", &old, &walk.new_lines);
+	free(name);
+	string_list_clear(&walk.new_lines, 0);
+	string_list_clear(&walk.unresolved, 0);
+	repo_cache_close(&walk.index);
+}
+
+static void print_last_commit(struct ls_entry *entry,
+			      struct walk_tree_context *walk_tree_ctx)
+{
+	struct string_list_item *item;
+	struct commitinfo *info;
+	const char *hex;
+
+	html("<td>");
+	if (!entry->has_last_commit) {
+		html("</td><td></td>");
+		return;
+	}
+	hex = oid_to_hex(&entry->last_commit);
+	item = string_list_lookup(&walk_tree_ctx->commits, hex);
+	if (!item) {
+		struct commit *commit = lookup_commit(the_repository,
+						      &entry->last_commit);
+
+		item = string_list_insert(&walk_tree_ctx->commits, hex);
+		if (commit && !repo_parse_commit(the_repository, commit))
+			item->util = cgit_parse_commit(commit);
+	}
+	info = item->util;
+	if (!info) {
+		html("</td><td></td>");
+		return;
+	}
+	cgit_commit_link(info->subject, NULL, NULL, ctx.qry.head, hex, NULL);
+	html("</td><td>");
+	cgit_print_age(info->committer_date, info->committer_tz, -1);
+	html("</td>");
+}
+
+static void free_entries(struct ls_entries *entries)
+{
+	size_t i;
+
+	for (i = 0; i < entries->nr; i++)
+		free(entries->items[i].name);
+	free(entries->items);
+}
+
+static void ls_item(struct ls_entry *entry,
+		    struct walk_tree_context *walk_tree_ctx)
+{
+	const struct object_id *oid = &entry->oid;
+	const char *name = entry->name;
+	unsigned mode = entry->mode;
 	struct strbuf fullpath = STRBUF_INIT;
 	struct strbuf linkpath = STRBUF_INIT;
 	struct strbuf class = STRBUF_INIT;
 	struct string_list_item *subtree_item = NULL;
 	enum object_type type;
-	unsigned long size = 0;
+	unsigned long size = entry->size;
 	char *buf;
 
-	name = xstrdup(pathname);
 	strbuf_addf(&fullpath, "%s%s%s", ctx.qry.path ? ctx.qry.path : "",
 		    ctx.qry.path ? "/" : "", name);
 
@@ -343,14 +887,11 @@ static int ls_item(const struct object_id *oid, struct strbuf *base,
 		subtree_item = string_list_lookup(walk_tree_ctx->subtrees,
 						  fullpath.buf);
 
-	if (!S_ISGITLINK(mode)) {
-		type = oid_object_info(the_repository, oid, &size);
-		if (type == OBJ_BAD) {
-			htmlf("<tr><td colspan='3'>Bad object: %s %s</td></tr>",
-			      name,
-			      oid_to_hex(oid));
-			goto cleanup;
-		}
+	if (!S_ISGITLINK(mode) && entry->type == OBJ_BAD) {
+		htmlf("<tr><td colspan='3'>Bad object: %s %s</td></tr>",
+		      name,
+		      oid_to_hex(oid));
+		goto cleanup;
 	}
 
 	html("<tr");
@@ -366,7 +907,7 @@ static int ls_item(const struct object_id *oid, struct strbuf *base,
 	if (S_ISGITLINK(mode)) {
 		cgit_submodule_link("ls-mod", fullpath.buf, oid_to_hex(oid));
 	} else if (S_ISDIR(mode)) {
-		write_tree_link(oid, name, walk_tree_ctx->curr_rev,
+		write_tree_link(oid, entry->name, walk_tree_ctx->curr_rev,
 				&fullpath);
 		if (subtree_item) {
 			html(" <span class='subtree-badge'");
@@ -401,6 +942,8 @@ static int ls_item(const struct object_id *oid, struct strbuf *base,
 		strbuf_release(&linkpath);
 	}
 	htmlf("</td><td class='ls-size'>%li</td>", size);
+	if (ctx.repo->enable_tree_lastcommit)
+		print_last_commit(entry, walk_tree_ctx);
 
 	html("<td>");
 	cgit_log_link("log", NULL, "button", ctx.qry.head,
@@ -418,42 +961,136 @@ static int ls_item(const struct object_id *oid, struct strbuf *base,
 	html("</td></tr>\n");
 
 cleanup:
-	free(name);
 	strbuf_release(&fullpath);
 	strbuf_release(&class);
-	return 0;
 }
 
-static void ls_head(void)
+/* Case-insensitive substring match, like the filter in cgit.js. */
+static int name_matches(const char *name, const char *search)
+{
+	size_t len = strlen(search);
+
+	for (; *name; name++)
+		if (!strncasecmp(name, search, len))
+			return 1;
+	return !len;
+}
+
+static void filter_entries(struct ls_entries *entries, const char *search)
+{
+	size_t i, nr = 0;
+
+	for (i = 0; i < entries->nr; i++) {
+		if (name_matches(entries->items[i].name, search))
+			entries->items[nr++] = entries->items[i];
+		else
+			free(entries->items[i].name);
+	}
+	entries->nr = nr;
+}
+
+/*
+ * Pages are addressed by the name of the last entry of the previous
+ * page rather than by an offset, so that following "next" keeps going
+ * where the previous page stopped even if entries were added or
+ * removed in between. Directories are named with a trailing slash, as
+ * tree order sorts them as if their name ended with one.
+ */
+static size_t find_page_start(struct ls_entries *entries, const char *after)
+{
+	size_t i, len;
+	unsigned mode = S_IFREG;
+
+	if (!after || !*after)
+		return 0;
+	len = strlen(after);
+	if (after[len - 1] == '/') {
+		mode = S_IFDIR;
+		len--;
+	}
+	for (i = 0; i < entries->nr; i++) {
+		const struct ls_entry *entry = &entries->items[i];
+
+		if (base_name_compare(entry->name, strlen(entry->name),
+				      entry->mode, after, len, mode) > 0)
+			break;
+	}
+	return i;
+}
+
+static void ls_head(int partial, size_t total)
 {
 	cgit_print_layout_start();
-	html("<div class='tree-toolbar'>");
+	html("<form class='tree-toolbar' method='get' action='");
+	if (ctx.cfg.virtual_root) {
+		char *fileurl = cgit_fileurl(ctx.qry.repo, "tree",
+					     ctx.qry.vpath, NULL);
+		html_url_path(fileurl);
+		free(fileurl);
+	}
+	html("'>");
+	cgit_add_hidden_formfields(1, 0, "tree");
 	html("<input id='tree-filter' class='tree-filter' type='search' ");
-	html("placeholder='Filter files and folders' ");
+	html("name='q' value='");
+	html_attr(ctx.qry.search);
+	html("' placeholder='Filter files and folders' ");
 	html("autocomplete='off' aria-label='Filter files'/>");
 	html("<span id='tree-filter-count' class='tree-filter-count'></span>");
-	html("</div>");
+	html("</form>");
+	html("<div id='tree-listing'");
+	if (partial)
+		htmlf(" data-partial='1' data-total='%"PRIuMAX"'",
+		      (uintmax_t)total);
+	html(">");
 	html("<table summary='tree listing' class='list'>\n");
 	html("<tr class='nohover'>");
 	html("<th class='left'>Mode</th>");
 	html("<th class='left'>Name</th>");
 	html("<th class='right'>Size</th>");
+	if (ctx.repo->enable_tree_lastcommit) {
+		html("<th class='left'>Last commit</th>");
+		html("<th class='left'>Age</th>");
+	}
 	html("<th/>");
 	html("</tr>\n");
 }
 
-static void ls_tail(void)
+static void ls_tail(struct walk_tree_context *walk_tree_ctx, const char *last)
 {
 	html("</table>\n");
+	if ((ctx.qry.after && *ctx.qry.after) || last) {
+		html("<ul class='pager'>");
+		if (ctx.qry.after && *ctx.qry.after) {
+			html("<li>");
+			cgit_tree_page_link("[first]", NULL, NULL, ctx.qry.head,
+					    walk_tree_ctx->curr_rev,
+					    ctx.qry.path, NULL,
+					    ctx.qry.search);
+			html("</li>");
+		}
+		if (last) {
+			html("<li>");
+			cgit_tree_page_link("[next]", NULL, NULL, ctx.qry.head,
+					    walk_tree_ctx->curr_rev,
+					    ctx.qry.path, last,
+					    ctx.qry.search);
+			html("</li>");
+		}
+		html("</ul>");
+	}
+	html("</div>");
 	cgit_print_layout_end();
 }
 
 static void ls_tree(const struct object_id *oid, const char *path, struct walk_tree_context *walk_tree_ctx)
 {
+	struct ls_entries entries = { 0 };
 	struct tree *tree;
 	struct pathspec paths = {
 		.nr = 0
 	};
+	char *last = NULL, *chain_name;
+	size_t i, start, end;
 
 	tree = parse_tree_indirect(oid);
 	if (!tree) {
@@ -462,39 +1099,68 @@ static void ls_tree(const struct object_id *oid, const char *path, struct walk_t
 		return;
 	}
 
-	ls_head();
-	read_tree(the_repository, tree, &paths, ls_item, walk_tree_ctx);
-	ls_tail();
+	/* Listing the tree is cheap, only look at the objects of the
+	 * entries which are actually shown.
+	 */
+	read_tree(the_repository, tree, &paths, collect_entry, &entries);
+	if (ctx.qry.search && *ctx.qry.search)
+		filter_entries(&entries, ctx.qry.search);
+	start = find_page_start(&entries, ctx.qry.after);
+	end = entries.nr;
+	if (ctx.cfg.max_tree_entries > 0 &&
+	    end - start > (size_t)ctx.cfg.max_tree_entries) {
+		end = start + ctx.cfg.max_tree_entries;
+		last = xstrfmt("%s%s", entries.items[end - 1].name,
+			       S_ISDIR(entries.items[end - 1].mode) ? "/" : "");
+	}
+	load_entry_sizes(entries.items + start, end - start);
+	if (ctx.repo->enable_tree_lastcommit)
+		find_last_commits(walk_tree_ctx->commit, path,
+				  entries.items + start, end - start);
+	chain_name = xstrfmt("%s/%s", CHAIN_INDEX,
+			     oid_to_hex(&tree->object.oid));
+	repo_cache_open(&chain_index, chain_name, "1");
+
+	ls_head(start > 0 || last || (ctx.qry.search && *ctx.qry.search),
+		entries.nr);
+	for (i = start; i < end; i++)
+		ls_item(&entries.items[i], walk_tree_ctx);
+	ls_tail(walk_tree_ctx, last);
+
+	string_list_sort(&new_chains);
+	repo_cache_update_bounded(chain_name, "1", &chain_index, &new_chains);
+	string_list_clear(&new_chains, 0);
+	repo_cache_close(&chain_index);
+	free(chain_name);
+	free(last);
+	free_entries(&entries);
 }
 
-
 static int walk_tree(const struct object_id *oid, struct strbuf *base,
 		const char *pathname, unsigned mode, void *cbdata)
 {
 	struct walk_tree_context *walk_tree_ctx = cbdata;
+	struct strbuf buffer = STRBUF_INIT;
 
-	if (walk_tree_ctx->state == 0) {
-		struct strbuf buffer = STRBUF_INIT;
+	if (walk_tree_ctx->state != 0)
+		return 0;
 
-		strbuf_addbuf(&buffer, base);
-		strbuf_addstr(&buffer, pathname);
-		if (strcmp(walk_tree_ctx->match_path, buffer.buf))
-			return READ_TREE_RECURSIVE;
+	strbuf_addbuf(&buffer, base);
+	strbuf_addstr(&buffer, pathname);
+	if (strcmp(walk_tree_ctx->match_path, buffer.buf)) {
+		strbuf_release(&buffer);
+		return READ_TREE_RECURSIVE;
+	}
 
-		if (S_ISDIR(mode)) {
-			walk_tree_ctx->state = 1;
-			cgit_set_title_from_path(buffer.buf);
-			strbuf_release(&buffer);
-			ls_head();
-			return READ_TREE_RECURSIVE;
-		} else {
-			walk_tree_ctx->state = 2;
-			print_object(oid, buffer.buf, pathname, walk_tree_ctx->curr_rev);
-			strbuf_release(&buffer);
-			return 0;
-		}
+	if (S_ISDIR(mode)) {
+		walk_tree_ctx->state = 1;
+		oidcpy(&walk_tree_ctx->tree_oid, oid);
+		cgit_set_title_from_path(buffer.buf);
+	} else {
+		walk_tree_ctx->state = 2;
+		print_object(oid, buffer.buf, pathname, walk_tree_ctx->curr_rev);
 	}
-	ls_item(oid, base, pathname, mode, walk_tree_ctx);
+	strbuf_release(&buffer);
 	return 0;
 }
 
@@ -519,8 +1185,10 @@ void cgit_print_tree(const char *rev, char *path)
 	struct walk_tree_context walk_tree_ctx = {
 		.match_path = path,
 		.state = 0,
-		.subtrees = NULL
+		.subtrees = NULL,
+		.commits = STRING_LIST_INIT_DUP
 	};
+	size_t i;
 
 	if (!rev)
 		rev = ctx.qry.head;
@@ -538,8 +1206,10 @@ void cgit_print_tree(const char *rev, char *path)
 	}
 
 	walk_tree_ctx.curr_rev = xstrdup(rev);
+	walk_tree_ctx.commit = commit;
 	if (ctx.repo->enable_subtree) {
-		collect_subtrees(rev, &subtrees);
+		collect_subtrees(commit, &subtrees);
+		string_list_sort(&subtrees);
 		walk_tree_ctx.subtrees = &subtrees;
 	}
 
@@ -551,7 +1221,7 @@ void cgit_print_tree(const char *rev, char *path)
 	read_tree(the_repository, repo_get_commit_tree(the_repository, commit),
 		  &paths, walk_tree, &walk_tree_ctx);
 	if (walk_tree_ctx.state == 1)
-		ls_tail();
+		ls_tree(&walk_tree_ctx.tree_oid, path, &walk_tree_ctx);
 	else if (walk_tree_ctx.state == 2)
 		cgit_print_layout_end();
 	else
@@ -560,4 +1230,8 @@ void cgit_print_tree(const char *rev, char *path)
 cleanup:
 	free(walk_tree_ctx.curr_rev);
 	string_list_clear(&subtrees, 1);
+	for (i = 0; i < walk_tree_ctx.commits.nr; i++)
+		if (walk_tree_ctx.commits.items[i].util)
+			cgit_free_commitinfo(walk_tree_ctx.commits.items[i].util);
+	string_list_clear(&walk_tree_ctx.commits, 0);
 }